@@ -0,0 +1,81 @@
+#ifndef H_DS_BLOOM
+#define H_DS_BLOOM
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A blocked Bloom filter, for answering "definitely not present" without
+ * looking in the structure that holds the items. A check can return a
+ * false positive (an item that was never added is reported as possibly
+ * present) at no more than the rate given when the filter is created, as
+ * long as no more items than the given number are added. There are never
+ * false negatives. Items cannot be removed.
+ *
+ * The filter is an array of 32-byte blocks, each of which is eight
+ * 32-bit words. An item sets exactly one bit in each word of a single
+ * block, so adding or checking an item touches one block (which never
+ * straddles a cache line) and the eight words are tested independently
+ * of one another, which compilers turn into vector instructions.
+ *
+ * Items are given either as keys, which are hashed with ds_hmap_hashfn(),
+ * or as 64-bit hashes computed by the caller. The block is chosen from
+ * the upper 32 bits of the hash and the bits within the block from the
+ * lower 32 bits, so the hash must be of good quality in both halves.
+ *
+ * A filter can also be attached to a hashmap, see ds_hmap_attach_bloom().
+ */
+
+typedef struct ds_bloom_t ds_bloom_t;
+
+typedef struct ds_bloom_stats_t ds_bloom_stats_t;
+struct ds_bloom_stats_t {
+   // The number of items added, and the number of items the filter was
+   // sized for.
+   size_t      nitems;
+   size_t      capacity;
+
+   // The number of 32-byte blocks, and the total memory used by the
+   // filter in bytes.
+   size_t      nblocks;
+   size_t      nbytes;
+
+   // The false positive rate the filter was created with, and the
+   // expected false positive rate for the items added so far.
+   double      fp_rate;
+   double      est_fp_rate;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+   // Creates a filter for capacity items with a false positive rate of
+   // at most fp_rate (between 0 and 1, exclusive; a zero fp_rate gives
+   // the default of 0.01). Returns NULL on error.
+   ds_bloom_t *ds_bloom_new (size_t capacity, double fp_rate);
+
+   void ds_bloom_del (ds_bloom_t *bf);
+
+   // Removes all the items from the filter.
+   void ds_bloom_clear (ds_bloom_t *bf);
+
+   // Adds an item, or checks whether an item may have been added. A
+   // false return from a check means the item was never added.
+   void ds_bloom_add (ds_bloom_t *bf, const void *key, size_t keylen);
+   bool ds_bloom_check (const ds_bloom_t *bf, const void *key, size_t keylen);
+
+   // The same as ds_bloom_add() and ds_bloom_check(), with the item
+   // given as a hash.
+   void ds_bloom_add_hash (ds_bloom_t *bf, uint64_t hash);
+   bool ds_bloom_check_hash (const ds_bloom_t *bf, uint64_t hash);
+
+   // Fills in the size of the filter and its expected false positive
+   // rate.
+   void ds_bloom_stats (const ds_bloom_t *bf, ds_bloom_stats_t *stats);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
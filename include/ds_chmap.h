@@ -0,0 +1,126 @@
+#ifndef H_DS_CHMAP
+#define H_DS_CHMAP
+
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef LOCAL_INLINE
+#define LOCAL_INLINE
+
+#ifdef __GNUC__
+#undef LOCAL_INLINE
+#define LOCAL_INLINE __inline__
+#endif
+#endif
+
+/* Concurrent hashmap. All the functions may be called from any number of
+ * threads at the same time without any locking by the caller.
+ *
+ * As with ds_hmap_t, keys are copied and data is not; the caller remains
+ * responsible for the data. Unlike ds_hmap_set(), ds_chmap_set() does not
+ * return a pointer to the stored key, as another thread may remove the
+ * key at any time.
+ *
+ * The hashmap is split into shards on the high bits of the hash of each
+ * key. Each shard has its own lock, which is only taken by ds_chmap_set()
+ * and ds_chmap_remove(), so writers to different shards never wait for
+ * each other. Readers take no locks at all: ds_chmap_get() runs
+ * concurrently with writers, and removed or replaced entries are only
+ * freed once no reader can still be looking at them (epoch-based
+ * reclamation).
+ *
+ * Each hashmap uses one POSIX thread-specific data key to track the
+ * readers, so at most PTHREAD_KEYS_MAX hashmaps (less those used by the
+ * rest of the program) may exist at the same time.
+ */
+
+typedef struct ds_chmap_t ds_chmap_t;
+
+#define DS_CHMAP_DEFAULT_SHARDS     (64)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+   // Create a new concurrent hashmap with nshards shards, rounded up to a
+   // power of two (DS_CHMAP_DEFAULT_SHARDS when nshards is zero). More
+   // shards allow more writers to proceed at the same time. Returns NULL
+   // on error.
+   ds_chmap_t *ds_chmap_new (size_t nshards);
+
+   // Deletes the hashmap. No other thread may be using the hashmap when
+   // this is called.
+   void ds_chmap_del (ds_chmap_t *cm);
+
+   // Sets the key to the data, replacing any data that the key was
+   // previously set to. Returns false on error (out of memory, or a NULL
+   // key or data).
+   bool ds_chmap_set (ds_chmap_t *cm, const void *key, size_t keylen,
+                                      void *data, size_t datalen);
+
+   // Finds the key and stores the data and the length of the data in
+   // 'data' and 'datalen' (either may be NULL). Returns true if the key
+   // was found and false if it was not.
+   bool ds_chmap_get (ds_chmap_t *cm, const void *key, size_t keylen,
+                                      void **data, size_t *datalen);
+
+   // Removes the key. Returns true if the key was found and removed. The
+   // data is still the responsibility of the caller.
+   bool ds_chmap_remove (ds_chmap_t *cm, const void *key, size_t keylen);
+
+   // Returns the number of entries in the hashmap. While other threads
+   // are modifying the hashmap this is only an estimate.
+   size_t ds_chmap_num_entries (ds_chmap_t *cm);
+
+#ifdef __cplusplus
+};
+#endif
+
+#ifndef DS_CHMAP_IMPLEMENTATION
+// Convenience functions for string keys, in the same way as those for
+// ds_hmap_t.
+
+LOCAL_INLINE
+static bool ds_chmap_set_str_str (ds_chmap_t *cm,
+                                  const char *key, const char *data)
+{
+   return ds_chmap_set (cm, key,  strlen (key) + 1,
+                            (void *)data, strlen (data) + 1);
+}
+
+LOCAL_INLINE
+static bool ds_chmap_get_str_str (ds_chmap_t *cm,
+                                  const char *key, char **data)
+{
+   void *tmp = NULL;
+   bool ret = ds_chmap_get (cm, key, strlen (key) + 1, &tmp, NULL);
+   if (ret && data)
+      *data = tmp;
+   return ret;
+}
+
+LOCAL_INLINE
+static bool ds_chmap_remove_str (ds_chmap_t *cm, const char *key)
+{
+   return ds_chmap_remove (cm, key, strlen (key) + 1);
+}
+
+LOCAL_INLINE
+static bool ds_chmap_set_str_ptr (ds_chmap_t *cm,
+                                  const char *key, void *data)
+{
+   return ds_chmap_set (cm, key,  strlen (key) + 1,
+                            data, sizeof data);
+}
+
+LOCAL_INLINE
+static bool ds_chmap_get_str_ptr (ds_chmap_t *cm,
+                                  const char *key, void **data)
+{
+   return ds_chmap_get (cm, key, strlen (key) + 1, data, NULL);
+}
+
+#endif
+
+#endif
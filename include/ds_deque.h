@@ -0,0 +1,73 @@
+#ifndef H_DS_DEQUE
+#define H_DS_DEQUE
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A double-ended queue of pointers, stored in a ring buffer whose size is
+ * a power of two. Inserting and removing at either end and getting the
+ * element at any index are all O(1); the buffer doubles in size when it
+ * is full.
+ *
+ * As with ds_array_t the deque stores pointers to objects that must be
+ * allocated and freed by the caller, and cannot store NULL pointers.
+ */
+
+typedef struct ds_deque_t ds_deque_t;
+
+// A run of consecutive elements in the buffer, as filled in by
+// ds_deque_spans().
+typedef struct ds_deque_span_t ds_deque_span_t;
+struct ds_deque_span_t {
+   void      **items;
+   size_t      nitems;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+   ds_deque_t *ds_deque_new (void);
+   void ds_deque_del (ds_deque_t *dq);
+
+   size_t ds_deque_length (const ds_deque_t *dq);
+
+   // Returns element i, counting from the head, or NULL if there is no
+   // such element.
+   void *ds_deque_get (const ds_deque_t *dq, size_t i);
+
+   void ds_deque_iterate (const ds_deque_t *dq,
+                          void (*fptr) (void *, void *), void *param);
+
+   // Inserts the element at the tail or the head. Returns the element on
+   // success and NULL on error.
+   void *ds_deque_ins_tail (ds_deque_t *dq, void *el);
+   void *ds_deque_ins_head (ds_deque_t *dq, void *el);
+
+   // Removes and returns the element at the tail or the head, or returns
+   // NULL when the deque is empty.
+   void *ds_deque_rm_tail (ds_deque_t *dq);
+   void *ds_deque_rm_head (ds_deque_t *dq);
+
+   // Removes all the elements, keeping the buffer.
+   void ds_deque_clear (ds_deque_t *dq);
+
+   // The capacity is the number of elements the deque holds before the
+   // buffer has to grow. ds_deque_reserve() grows the buffer to hold at
+   // least nelems elements and returns false on error.
+   size_t ds_deque_capacity (const ds_deque_t *dq);
+   bool ds_deque_reserve (ds_deque_t *dq, size_t nelems);
+
+   // Fills in the elements, from head to tail, as at most two runs of
+   // consecutive pointers in the buffer, which the caller may read
+   // without copying them. Returns the number of runs: zero when the
+   // deque is empty, two when the elements wrap around the end of the
+   // buffer, and one otherwise. Unused spans are set to NULL and zero.
+   // The spans are valid until the deque is next changed.
+   size_t ds_deque_spans (const ds_deque_t *dq, ds_deque_span_t spans[2]);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
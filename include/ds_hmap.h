@@ -0,0 +1,550 @@
+
+#ifndef H_DS_HMAP
+#define H_DS_HMAP
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ds_bloom.h"
+
+#ifndef LOCAL_INLINE
+#define LOCAL_INLINE
+
+#ifdef __GNUC__
+#undef LOCAL_INLINE
+#define LOCAL_INLINE __inline__
+#endif
+#endif
+
+/* Hashmap. Note that this data structure does not make copies of the
+ * data it is given; instead it merely stores pointers to the data it is
+ * given.
+ *
+ * Keys are copied, so that callers are free to use variables that go out
+ * of scope as keys. Keys of up to 24 bytes are stored inside the entry;
+ * longer keys are copied into an arena owned by the hashmap, which is
+ * freed in a single step by ds_hmap_del().
+ *
+ * Pointers to keys returned by ds_hmap_set() and ds_hmap_keys() remain
+ * valid until the next call to ds_hmap_set() or ds_hmap_remove() (or
+ * until the hashmap is deleted). Calls to ds_hmap_get() do not
+ * invalidate them. Callers that keep key pointers for longer can use
+ * ds_hmap_generation() to tell when the keys have moved.
+ *
+ */
+
+typedef enum {
+   ds_hmap_ENONE     = 0,
+   ds_hmap_ENULLOBJ  = 1,
+   ds_hmap_EOOM      = 2,
+   ds_hmap_ENOTFOUND = 3,
+   ds_hmap_EBADPARAM = 4,
+   ds_hmap_EREADONLY = 5,
+   ds_hmap_EIO       = 6,
+} ds_hmap_error_t;
+
+typedef struct ds_hmap_t ds_hmap_t;
+
+// The rehash policy determines what happens when the load factor of the
+// hashmap exceeds the maximum load factor:
+//    INCREMENTAL:   A table with twice the number of buckets is created
+//                   and the existing entries are moved into it a few
+//                   buckets at a time during subsequent calls to
+//                   ds_hmap_set() and ds_hmap_remove(); calls to
+//                   ds_hmap_get() never move entries.
+//    IMMEDIATE:     A table with twice the number of buckets is created
+//                   and all the existing entries are moved into it before
+//                   the insertion returns.
+//    NONE:          The number of buckets never changes.
+typedef enum {
+   ds_hmap_REHASH_INCREMENTAL = 0,
+   ds_hmap_REHASH_IMMEDIATE   = 1,
+   ds_hmap_REHASH_NONE        = 2,
+} ds_hmap_rehash_t;
+
+// The storage engine of the hashmap:
+//    CHAINED:       Each bucket is a separate array of entries, all the keys
+//                   that hash to a bucket are stored in that bucket.
+//    FLAT:          A single open-addressing table of entries. Seven bits
+//                   of each hash are stored in a separate control byte for
+//                   each entry, and the control bytes are searched 16 at a
+//                   time (with SSE2 instructions when available). For this
+//                   engine each slot in the table counts as a bucket, the
+//                   max_load is the fraction of slots that may be used
+//                   and a rehash is always performed immediately.
+//    ORDERED:       The entries are stored in a single array in the order
+//                   in which they were added, with a separate index from
+//                   hashes to positions in the array. Iteration visits
+//                   the entries in insertion order. Each slot of the
+//                   index counts as a bucket and the max_load is not
+//                   used; the index is always kept at most half full.
+//    FROZEN:        A read-only table built by ds_hmap_freeze(); it cannot
+//                   be requested from ds_hmap_new_ex(). Each entry is
+//                   found with a minimal perfect hash, so that a lookup
+//                   examines exactly one slot. Each slot counts as a
+//                   bucket.
+typedef enum {
+   ds_hmap_ENGINE_CHAINED     = 0,
+   ds_hmap_ENGINE_FLAT        = 1,
+   ds_hmap_ENGINE_FROZEN      = 2,
+   ds_hmap_ENGINE_ORDERED     = 3,
+} ds_hmap_engine_t;
+
+// The kind of keys stored in the hashmap:
+//    BYTES:         Keys are any sequence of bytes.
+//    U64:           Every key is a uint64_t (keylen must be
+//                   sizeof (uint64_t)). Keys are hashed with a single
+//                   multiply-xorshift instead of hashing every byte, and
+//                   since no two keys have the same hash a key is compared
+//                   by its hash alone. Use ds_hmap_set_u64() and friends
+//                   to pass the keys by value. The hashfn and cmpfn may
+//                   not be set.
+typedef enum {
+   ds_hmap_KEYS_BYTES         = 0,
+   ds_hmap_KEYS_U64           = 1,
+} ds_hmap_keys_t;
+
+#define DS_HMAP_DEFAULT_CAPACITY    (16)
+#define DS_HMAP_DEFAULT_LOAD        (1.0f)
+
+// Settings for creating a new hashmap with ds_hmap_new_ex(). Fields that
+// are left as zero are given the default values.
+typedef struct ds_hmap_config_t ds_hmap_config_t;
+struct ds_hmap_config_t {
+   // The initial number of buckets (DS_HMAP_DEFAULT_CAPACITY).
+   size_t            capacity;
+   // The maximum ratio of entries to buckets before the hashmap grows
+   // (DS_HMAP_DEFAULT_LOAD).
+   float             max_load;
+   // What to do when the max_load is exceeded (ds_hmap_REHASH_INCREMENTAL).
+   ds_hmap_rehash_t  rehash;
+   // How the entries are stored (ds_hmap_ENGINE_CHAINED).
+   ds_hmap_engine_t  engine;
+   // The kind of keys stored (ds_hmap_KEYS_BYTES).
+   ds_hmap_keys_t    keys;
+   // Store the keys only, with no data (false). Each entry is then 16
+   // bytes smaller. The data passed to the set functions is ignored and
+   // may be NULL, and lookups and cursors return the stored copy of the
+   // key as the data, with a datalen of zero.
+   bool              keys_only;
+   // The seed passed to the hash function. When zero a seed that is
+   // chosen randomly once per process is used.
+   uint64_t          seed;
+   // Returns the hash of a key (ds_hmap_hashfn). Integer and structure
+   // keys can use a cheaper hash than hashing every byte.
+   uint64_t        (*hashfn) (const void *key, size_t keylen, uint64_t seed);
+   // Compares two keys, returning zero when the keys are equal (the bytes
+   // of the keys are compared). Keys that compare equal must have the
+   // same hash.
+   int             (*cmpfn) (const void *k1, size_t k1len,
+                             const void *k2, size_t k2len);
+};
+
+// A cursor for walking the entries of a hashmap without allocating any
+// memory; declare it on the stack and pass it to ds_hmap_iter_init().
+// After each successful call to ds_hmap_iter_next() the first four fields
+// hold the current entry. The remaining fields are private.
+typedef struct ds_hmap_iter_t ds_hmap_iter_t;
+struct ds_hmap_iter_t {
+   const void       *key;
+   size_t            keylen;
+   void             *data;
+   size_t            datalen;
+
+   ds_hmap_t        *hm;
+   size_t            table;
+   size_t            bucket;
+   size_t            elem;
+};
+
+// All the statistics of a hashmap, as filled in by ds_hmap_stats().
+typedef struct ds_hmap_stats_t ds_hmap_stats_t;
+struct ds_hmap_stats_t {
+   // The same values that are returned by the individual functions.
+   size_t            nentries;
+   size_t            nbuckets;
+   float             load;
+   size_t            mean_entries;
+   float             stddev_entries;
+   size_t            min_entries;
+   size_t            max_entries;
+   size_t            range_entries;
+   // True if entries are still being moved into a larger table.
+   bool              rehashing;
+   // The number of bytes allocated for keys that are too long to be
+   // stored inline, and how many of them are unused.
+   size_t            key_bytes;
+   size_t            wasted_key_bytes;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+   // Create a new hashmap. The nbuckets specify the initial number of
+   // buckets in the hashmap. The hashmap grows incrementally when the
+   // number of entries exceeds DS_HMAP_DEFAULT_LOAD entries per bucket.
+   // Returns NULL on error, or a hashmap object on success.
+   ds_hmap_t *ds_hmap_new (size_t nbuckets);
+
+   // Create a new hashmap using the settings in the config. If config is
+   // NULL then all the default values are used. Returns NULL on error, or
+   // a hashmap object on success.
+   ds_hmap_t *ds_hmap_new_ex (const ds_hmap_config_t *config);
+
+   // Creates a hashmap holding n keys at once. Key i is set to data[i],
+   // with a length of datalens[i] ('datalens' may be NULL), exactly as if
+   // the keys had been set one at a time in order; a key that appears
+   // more than once ends up with the last of its values. The table is
+   // allocated at its final size, so there is no rehashing.
+   //
+   // With the chained engine the keys are hashed, partitioned by bucket
+   // and inserted by nthreads threads, each thread filling its own range
+   // of buckets without any locking. The other engines hash the keys on
+   // nthreads threads and insert them on the calling thread. An nthreads
+   // of 0 or 1 does all the work on the calling thread. A hashfn or cmpfn
+   // in the config must be safe to call from several threads at once.
+   //
+   // Returns NULL on error, including when any key or data is NULL.
+   ds_hmap_t *ds_hmap_build (size_t n, const void **keys, const size_t *keylens,
+                             void **data, const size_t *datalens,
+                             size_t nthreads);
+   ds_hmap_t *ds_hmap_build_ex (size_t n, const void **keys, const size_t *keylens,
+                                void **data, const size_t *datalens,
+                                size_t nthreads, const ds_hmap_config_t *config);
+
+   // The default hash function; a fast 64-bit hash of all the bytes in
+   // the key. Different seeds produce unrelated hashes for the same key.
+   uint64_t ds_hmap_hashfn (const void *key, size_t keylen, uint64_t seed);
+
+   // Returns the seed used by hashmaps that are not given one. It is
+   // chosen randomly the first time it is needed and stays the same for
+   // the rest of the process.
+   uint64_t ds_hmap_process_seed (void);
+
+   // Delete a a hashmap. The data being stored is *not* deleted. All
+   // other resources associated with the hashmap is deleted.
+   void ds_hmap_del (ds_hmap_t *hm);
+
+   // Creates a read-only copy of the hashmap that uses far less memory
+   // and finds every key with a single probe. The keys and the data are
+   // copied into a single block of memory with no pointers in it, so
+   // datalen must be the length of the data for every entry (as it is
+   // for ds_hmap_set_str_str()). The data pointers returned by the frozen
+   // hashmap point into this block, and neither the original hashmap nor
+   // the original data are needed after this call.
+   //
+   // The frozen hashmap supports ds_hmap_get(), ds_hmap_get_many(), the
+   // iteration functions, ds_hmap_keys() and the statistics. Setting or
+   // removing keys fails with ds_hmap_EREADONLY. Key pointers remain
+   // valid until the frozen hashmap is deleted with ds_hmap_del().
+   //
+   // Returns NULL on error, with the error set in the original hashmap.
+   // ds_hmap_EBADPARAM means two different keys have identical hashes,
+   // which is only possible with a caller-supplied hashfn.
+   ds_hmap_t *ds_hmap_freeze (ds_hmap_t *hm);
+
+   // Writes the hashmap to the file at path, replacing the file if it
+   // exists. The file holds a frozen copy of the hashmap (see
+   // ds_hmap_freeze(), including the requirement on datalen) together
+   // with a version header and a checksum. The file contains no pointers
+   // and can be opened with ds_hmap_open_mmap() by any process on a
+   // machine with the same byte order. Returns true on success and false
+   // on error, with the error set in the hashmap (ds_hmap_EIO when the
+   // file could not be written).
+   bool ds_hmap_save (ds_hmap_t *hm, const char *path);
+
+   // Opens a file written by ds_hmap_save() as a frozen hashmap. The file
+   // is mapped into memory and lookups are served directly from the
+   // mapping; nothing is rebuilt. The data returned by lookups points
+   // into the read-only mapping and must not be written to. The whole
+   // file is read once to verify the checksum. Returns NULL if the file
+   // cannot be opened, was written by a different version of this
+   // library or is corrupt.
+   ds_hmap_t *ds_hmap_open_mmap (const char *path);
+
+   // As ds_hmap_open_mmap(), for files written from a hashmap created with
+   // a hashfn or cmpfn. Only those two fields of the config are used, and
+   // they must be the same functions that the saved hashmap used.
+   ds_hmap_t *ds_hmap_open_mmap_ex (const char *path,
+                                    const ds_hmap_config_t *config);
+
+   // Returns the last error that was recorded in this hashmap. The caller
+   // must not free the error message returned.
+   void ds_hmap_lasterr (ds_hmap_t *hm,
+                         ds_hmap_error_t *err, const char **errmsg);
+
+   // Set an item in the hashmap. If this key already exists then the data
+   // that is mapped to this key is replaced with the new data specified
+   // here.
+   //
+   // The data is not copied (the caller is still responsible for it) but
+   // the key is copied (the caller may free the key after this function
+   // returns).
+   //
+   // The length of the data is not used; it is simply stored and returned
+   // in a call to ds_hmap_get().
+   //
+   // On error NULL is returned. On success a pointer to the stored copy
+   // of the key is returned.
+   const void *ds_hmap_set (ds_hmap_t *hm, const void *key,  size_t keylen,
+                                           void *data, size_t datalen);
+
+   // Finds an item in the hashmap and returns the data associated with
+   // it. The 'data' is NOT allocated; it is the raw pointer that was
+   // passed by the caller during the _set() operation.
+   //
+   // If the key is found then the 'data' and 'datalen' parameters are
+   // populated with a pointer to the data and the length of the data, and
+   // true is returned.
+   // If the key is not found then the values of 'data' and 'datalen' are
+   // indeterminate and false is returned.
+   bool ds_hmap_get (ds_hmap_t *hm, const void *key,  size_t keylen,
+                                    void **data,      size_t *datalen);
+
+   // Returns the hash that the hashmap uses for the key. The hash can be
+   // passed to ds_hmap_get_hashed() and ds_hmap_set_hashed() for this
+   // hashmap and for any other hashmap that hashes keys the same way:
+   // one created with the same seed, hashfn and keys settings. All the
+   // hashmaps created without a seed share the process seed, so a key
+   // that is looked up in many such hashmaps only needs hashing once.
+   // A frozen hashmap keeps the seed of the hashmap it was made from.
+   uint64_t ds_hmap_hash (const ds_hmap_t *hm, const void *key, size_t keylen);
+
+   // The same as ds_hmap_get() and ds_hmap_set(), with the hash of the key
+   // supplied by the caller. The hash must be the one that ds_hmap_hash()
+   // returns for the key; with any other value the key is not found, or
+   // for ds_hmap_KEYS_U64 hashmaps a different key may be found.
+   bool ds_hmap_get_hashed (ds_hmap_t *hm, uint64_t hash,
+                            const void *key, size_t keylen,
+                            void **data, size_t *datalen);
+   const void *ds_hmap_set_hashed (ds_hmap_t *hm, uint64_t hash,
+                                   const void *key, size_t keylen,
+                                   void *data, size_t datalen);
+
+   // Finds nkeys keys at once. The keys are hashed and the memory that
+   // will be searched for them is prefetched a batch at a time, so that
+   // the cache misses of the keys in a batch overlap. This is faster than
+   // calling ds_hmap_get() for each key when the hashmap does not fit in
+   // the cache.
+   //
+   // For each key i, data[i] and datalens[i] are set to the data and the
+   // length of the data, or to NULL and zero if the key is not found.
+   // Either 'data' or 'datalens' may be NULL. Returns the number of keys
+   // that were found.
+   size_t ds_hmap_get_many (ds_hmap_t *hm, size_t nkeys,
+                            const void **keys, const size_t *keylens,
+                            void **data, size_t *datalens);
+
+   // Sets nkeys keys at once, prefetching a batch at a time as
+   // ds_hmap_get_many() does. Each key i is set to data[i], with a length
+   // of datalens[i] ('datalens' may be NULL). Returns the number of keys
+   // that were set; on error the keys before the failed key remain set
+   // and the error is available from ds_hmap_lasterr().
+   size_t ds_hmap_set_many (ds_hmap_t *hm, size_t nkeys,
+                            const void **keys, const size_t *keylens,
+                            void **data, const size_t *datalens);
+
+   // Iterate across the hashmap in an unspecified order and call fptr() for each
+   // key/value pair.
+   void ds_hmap_iterate (ds_hmap_t *hm, void (*fptr) (const void *key, size_t keylen,
+                                                      void *value, size_t value_len,
+                                                      void *extra_param),
+                                        void *extra_param);
+
+   // Starts a cursor at the beginning of the hashmap. Entries are visited
+   // in an unspecified order by calling ds_hmap_iter_next() until it
+   // returns false:
+   //
+   //    ds_hmap_iter_t it;
+   //    ds_hmap_iter_init (hm, &it);
+   //    while (ds_hmap_iter_next (&it)) {
+   //       use (it.key, it.keylen, it.data, it.datalen);
+   //    }
+   //
+   // The current entry may be removed with ds_hmap_iter_remove(). Calling
+   // ds_hmap_set() or ds_hmap_remove() while iterating may cause entries
+   // to be skipped or visited twice.
+   void ds_hmap_iter_init (ds_hmap_t *hm, ds_hmap_iter_t *it);
+
+   // Moves the cursor to the next entry. Returns false when there are no
+   // more entries.
+   bool ds_hmap_iter_next (ds_hmap_iter_t *it);
+
+   // Removes the current entry of the cursor from the hashmap; the next
+   // call to ds_hmap_iter_next() continues with the following entry. The
+   // key field of the cursor is set to NULL, as the key has been freed.
+   void ds_hmap_iter_remove (ds_hmap_iter_t *it);
+
+   // Removes an item from the hashmap. The data stored in the value field
+   // still remains the responsibility of the caller.
+   void ds_hmap_remove (ds_hmap_t *hm, const void *key, size_t keylen);
+
+   // Removes every entry but keeps all the memory of the hashmap: the
+   // buckets, the slots and the space for long keys. A hashmap that is
+   // cleared and refilled with a similar set of keys allocates nothing
+   // after the first few rounds. The data remains the responsibility of
+   // the caller. Returns false on error.
+   bool ds_hmap_clear (ds_hmap_t *hm);
+
+   // Grows the hashmap, if needed, so that it holds nentries entries
+   // without exceeding the load factor, moving all the entries at once.
+   // Returns false on error.
+   bool ds_hmap_reserve (ds_hmap_t *hm, size_t nentries);
+
+   // Shrinks the hashmap to the smallest size that holds its entries
+   // without exceeding the load factor, drops the space left behind by
+   // removed entries and copies the long keys together. Afterwards key
+   // pointers from before the call are no longer valid. Returns false on
+   // error; the hashmap is still usable, but may not have been shrunk.
+   bool ds_hmap_shrink_to_fit (ds_hmap_t *hm);
+
+   // Attaches a Bloom filter (see ds_bloom.h) with a false positive rate
+   // of fp_rate (0 for the default of 0.01) holding the hashes of all
+   // the keys. Looking up a key that is not in the hashmap then
+   // usually returns after checking the filter, without touching the
+   // table; only a fraction fp_rate of such lookups search the table.
+   // This costs about ten bits per key for the default rate and a
+   // little time on every insertion. The filter is sized and rebuilt
+   // automatically as keys are added. Keys that are removed are only
+   // dropped from the filter when it is rebuilt. Attaching a filter
+   // again rebuilds it with the new rate. Returns false on error; a
+   // frozen hashmap cannot have a filter.
+   bool ds_hmap_attach_bloom (ds_hmap_t *hm, double fp_rate);
+
+   // Removes the attached filter, if any.
+   void ds_hmap_detach_bloom (ds_hmap_t *hm);
+
+   // Returns the attached filter, for example to pass to
+   // ds_bloom_stats(), or NULL if there is none.
+   const ds_bloom_t *ds_hmap_bloom (ds_hmap_t *hm);
+
+   // Set, get and remove with a uint64_t key passed by value. These work
+   // with any hashmap, where they are the same as passing &key and
+   // sizeof key, but they are fastest with a hashmap created with
+   // ds_hmap_KEYS_U64. ds_hmap_set_u64() returns true on success.
+   bool ds_hmap_set_u64 (ds_hmap_t *hm, uint64_t key, void *data, size_t datalen);
+   bool ds_hmap_get_u64 (ds_hmap_t *hm, uint64_t key, void **data, size_t *datalen);
+   void ds_hmap_remove_u64 (ds_hmap_t *hm, uint64_t key);
+
+   // Allocates and returns arrays of all the keys and their respective
+   // lengths in the arrays provided by the caller. On success, the length
+   // of these arrays are returned (both arrays have to be the same
+   // length). On error zero is returned.
+   //
+   // If 'keys' is not NULL then it is populated with an array of pointers
+   // to all the keys stored in the hashmap. If 'keylens' is not NULL then
+   // is it populated with an array of all the lengths of keys in the
+   // hashmap.
+   //
+   // The caller is responsible for freeing the array stored at 'keys' and
+   // the array stored at 'keylens' after this function returns. Note that
+   // only the array must be freed, and not each element of the array.
+   size_t ds_hmap_keys (ds_hmap_t *hm, void ***keys, size_t **keylens);
+
+   // Returns a number that changes whenever the hashmap moves its
+   // entries, which it does when it grows, rebuilds or compacts its table.
+   // The key pointers returned by ds_hmap_set(), ds_hmap_keys() and the
+   // cursor remain valid for as long as this number does not change,
+   // except for the keys that are removed.
+   uint64_t ds_hmap_generation (const ds_hmap_t *hm);
+
+   /* These functions all return statistics about the hashmap. The counts
+    * are kept up to date as the hashmap changes, so none of these
+    * functions visit the entries. Only when a bucket holds more than 30
+    * entries do the min, max and range functions scan the buckets.
+    */
+
+   // Return the load factor of the hashmap. While a rehash is in progress
+   // this is the load factor of the table that is being grown into.
+   float ds_hmap_load (ds_hmap_t *hm);
+
+   // Return the bucket size of the hashmap. While a rehash is in progress
+   // this is the bucket size of the table that is being grown into.
+   size_t ds_hmap_num_buckets (ds_hmap_t *hm);
+
+   // Return the number of entries in the hashmap
+   size_t ds_hmap_num_entries (ds_hmap_t *hm);
+
+   // Return the mean number of entries in a bucket
+   size_t ds_hmap_mean_entries (ds_hmap_t *hm);
+
+   // Return the std deviation of entries in a bucket
+   float ds_hmap_stddev_entries (ds_hmap_t *hm);
+
+   // Return the min, max and range number of entries in a bucket. While a
+   // rehash is in progress the buckets that have already been moved are
+   // not counted.
+   size_t ds_hmap_min_entries (ds_hmap_t *hm);
+   size_t ds_hmap_max_entries (ds_hmap_t *hm);
+   size_t ds_hmap_range_entries (ds_hmap_t *hm);
+
+   // Fills in all the statistics at once, for callers that export
+   // them. Returns false if either parameter is NULL.
+   bool ds_hmap_stats (ds_hmap_t *hm, ds_hmap_stats_t *stats);
+
+   void ds_hmap_print_freq (ds_hmap_t *hm, const char *marker, FILE *outf);
+
+#ifdef __cplusplus
+};
+#endif
+
+#ifndef DS_HMAP_IMPLEMENTATION
+// Hashmaps of <str,str> and <str,void *> are more common than others,
+// thus for convenience a few inline functions are provided that deal
+// specifically with these two common cases.
+//
+// The #ifndef above is to prevent these functions getting defined in the
+// implementation file ds_hmap.c
+
+LOCAL_INLINE
+static const char *ds_hmap_set_str_str (ds_hmap_t *hm,
+                                        const char *key, const char *data)
+{
+   return ds_hmap_set (hm, key,  strlen (key) + 1,
+                           (void *)data, strlen (data) + 1);
+}
+
+LOCAL_INLINE
+static bool ds_hmap_get_str_str (ds_hmap_t *hm,
+                                 const char *key, char **data)
+{
+   size_t datalen;
+   void *tmp = data;
+   return ds_hmap_get (hm, key,  strlen (key) + 1,
+                           tmp,  &datalen);
+}
+
+LOCAL_INLINE
+static void ds_hmap_remove_str (ds_hmap_t *hm, const char *key)
+{
+   ds_hmap_remove (hm, key, strlen (key) + 1);
+}
+
+// TODO: Test this
+LOCAL_INLINE
+static const char *ds_hmap_set_str_ptr (ds_hmap_t *hm,
+                                        const char *key,
+                                        void *data)
+{
+   return ds_hmap_set (hm, key,  strlen (key) + 1,
+                           data, sizeof data);
+}
+
+// TODO: Test this
+LOCAL_INLINE
+static bool ds_hmap_get_str_ptr (ds_hmap_t *hm,
+                                 const char *key,
+                                 void **data)
+{
+   size_t datalen = sizeof data;
+   return ds_hmap_get (hm, key, strlen (key) + 1,
+                           data, &datalen);
+}
+
+
+#endif
+
+#endif
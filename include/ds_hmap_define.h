@@ -0,0 +1,340 @@
+#ifndef H_DS_HMAP_DEFINE
+#define H_DS_HMAP_DEFINE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ds_hmap.h"
+
+/* Type-specialised hashmaps generated at compile time.
+ *
+ *    DS_HMAP_DEFINE (name, K, V, hashfn, eqfn)
+ *
+ * defines the type name_t, a hashmap from keys of type K to values of
+ * type V, and the functions below. Both the keys and the values are
+ * stored in the table itself (a key that is a pointer, such as a string,
+ * is stored as the pointer and remains the responsibility of the caller).
+ * hashfn and eqfn may be functions or macros taking keys by value:
+ *
+ *    uint64_t hashfn (K key);
+ *    bool eqfn (K k1, K k2);
+ *
+ * and both are called directly so that the compiler can inline them.
+ *
+ * ds_hmap_hash_str() can be passed directly as the hashfn for string keys;
+ * it hashes with ds_hmap_process_seed(), like a ds_hmap_t that is not
+ * given a seed. ds_hmap_hash_u64() takes the seed as a second argument,
+ * so integer keys need a wrapper macro:
+ *
+ *    #define ID_HASH(k)   (ds_hmap_hash_u64 ((k), ds_hmap_process_seed ()))
+ *
+ * With a seed that is fixed, such as zero, anyone who chooses the keys can
+ * choose keys that all collide and make every operation linear (hash
+ * flooding), so a fixed seed is only safe for trusted keys.
+ *
+ * The table uses the same probing as ds_hmap_ENGINE_FLAT: a control byte
+ * per slot holding seven bits of the hash, searched a group of
+ * DS_HMAP_GROUP_WIDTH slots at a time.
+ *
+ *    name_t *name_new (size_t capacity);
+ *       Returns a new hashmap with room for at least capacity entries, or
+ *       NULL on error.
+ *    void name_del (name_t *m);
+ *    bool name_set (name_t *m, K key, V value);
+ *       Sets or replaces the value of the key; false when out of memory.
+ *    V *name_get (name_t *m, K key);
+ *       Returns a pointer to the value of the key, or NULL when the key is
+ *       not found. The pointer is valid until the next name_set() or
+ *       name_remove().
+ *    bool name_remove (name_t *m, K key);
+ *       Returns true if the key was found and removed.
+ *    size_t name_num_entries (name_t *m);
+ *    bool name_next (name_t *m, size_t *pos, K *key, V **value);
+ *       Iterates over the entries: set *pos to zero and call until it
+ *       returns false. Either of key and value may be NULL.
+ */
+
+/* ******************************************************************
+ * The probing core shared with ds_hmap_ENGINE_FLAT. Each slot has a
+ * control byte that is either DS_HMAP_CTRL_EMPTY, DS_HMAP_CTRL_DELETED
+ * or DS_HMAP_H2 of the hash of the key in the slot.
+ */
+#define DS_HMAP_GROUP_WIDTH      (16)
+#define DS_HMAP_CTRL_EMPTY       ((int8_t)-128)
+#define DS_HMAP_CTRL_DELETED     ((int8_t)-2)
+
+#define DS_HMAP_H1(hash)         ((size_t)((hash) >> 7))
+#define DS_HMAP_H2(hash)         ((int8_t)((hash) & 0x7f))
+
+// Returns a mask with bit N set when control byte N of the group equals c.
+LOCAL_INLINE
+static uint32_t ds_hmap_group_match (const int8_t *group, int8_t c)
+{
+#ifdef __SSE2__
+   __m128i ctrl = _mm_loadu_si128 ((const __m128i *)group);
+   return (uint32_t)_mm_movemask_epi8 (_mm_cmpeq_epi8 (ctrl, _mm_set1_epi8 (c)));
+#else
+   uint32_t ret = 0;
+   for (uint32_t i=0; i<DS_HMAP_GROUP_WIDTH; i++) {
+      if (group[i] == c)
+         ret |= (uint32_t)1 << i;
+   }
+   return ret;
+#endif
+}
+
+// Returns a mask with bit N set when slot N of the group is empty or
+// deleted (the only control bytes with the high bit set).
+LOCAL_INLINE
+static uint32_t ds_hmap_group_match_free (const int8_t *group)
+{
+#ifdef __SSE2__
+   return (uint32_t)_mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i *)group));
+#else
+   uint32_t ret = 0;
+   for (uint32_t i=0; i<DS_HMAP_GROUP_WIDTH; i++) {
+      if (group[i] < 0)
+         ret |= (uint32_t)1 << i;
+   }
+   return ret;
+#endif
+}
+
+LOCAL_INLINE
+static size_t ds_hmap_mask_first (uint32_t mask)
+{
+#ifdef __GNUC__
+   return (size_t)__builtin_ctz (mask);
+#else
+   size_t ret = 0;
+   while (!(mask & 1)) {
+      mask >>= 1;
+      ret++;
+   }
+   return ret;
+#endif
+}
+
+// The hash of ds_hmap_KEYS_U64 keys. Every step is invertible, so two
+// different keys never have the same hash.
+LOCAL_INLINE
+static uint64_t ds_hmap_hash_u64 (uint64_t key, uint64_t seed)
+{
+   key ^= seed;
+   key *= 0xe7037ed1a0b428dbull;
+   key ^= key >> 32;
+   key *= 0x8ebc6af09c88c6e3ull;
+   key ^= key >> 29;
+   return key;
+}
+
+LOCAL_INLINE
+static uint64_t ds_hmap_hash_str (const char *key)
+{
+   return ds_hmap_hashfn (key, strlen (key), ds_hmap_process_seed ());
+}
+
+/* ******************************************************************
+ * The generated hashmap. The slots array and the control bytes are
+ * allocated together. The table never holds more than 7/8 of its slots
+ * in use (full or deleted).
+ */
+#define DS_HMAP_DEFINE(name, K, V, hashfn, eqfn)                              \
+                                                                              \
+typedef struct name##_t name##_t;                                             \
+struct name##_t {                                                             \
+   size_t      nslots;                                                        \
+   size_t      nused;                                                         \
+   size_t      nentries;                                                      \
+   int8_t     *ctrl;                                                          \
+   struct name##_slot_t {                                                     \
+      K        key;                                                           \
+      V        value;                                                         \
+   } *slots;                                                                  \
+};                                                                            \
+                                                                              \
+LOCAL_INLINE                                                                  \
+static bool name##_init_ (name##_t *m, size_t nslots)                         \
+{                                                                             \
+   size_t n = DS_HMAP_GROUP_WIDTH;                                            \
+   while (n < nslots)                                                         \
+      n *= 2;                                                                 \
+                                                                              \
+   memset (m, 0, sizeof *m);                                                  \
+   if (!(m->slots = malloc (n * (sizeof *m->slots + 1))))                     \
+      return false;                                                           \
+                                                                              \
+   m->ctrl = (int8_t *)(m->slots + n);                                        \
+   memset (m->ctrl, DS_HMAP_CTRL_EMPTY, n);                                   \
+   m->nslots = n;                                                             \
+   return true;                                                               \
+}                                                                             \
+                                                                              \
+LOCAL_INLINE                                                                  \
+static size_t name##_claim_ (name##_t *m, uint64_t hash)                      \
+{                                                                             \
+   size_t gmask = m->nslots / DS_HMAP_GROUP_WIDTH - 1;                        \
+   size_t g = DS_HMAP_H1 (hash) & gmask;                                      \
+   uint32_t mask = 0;                                                         \
+                                                                              \
+   for (size_t i=0;                                                           \
+        !(mask = ds_hmap_group_match_free (&m->ctrl[g * DS_HMAP_GROUP_WIDTH])); \
+        i++) {                                                                \
+      g = (g + i + 1) & gmask;                                                \
+   }                                                                          \
+                                                                              \
+   size_t idx = g * DS_HMAP_GROUP_WIDTH + ds_hmap_mask_first (mask);          \
+   if (m->ctrl[idx] == DS_HMAP_CTRL_EMPTY)                                    \
+      m->nused++;                                                             \
+   m->ctrl[idx] = DS_HMAP_H2 (hash);                                          \
+                                                                              \
+   return idx;                                                                \
+}                                                                             \
+                                                                              \
+LOCAL_INLINE                                                                  \
+static size_t name##_find_ (const name##_t *m, K key, uint64_t hash)          \
+{                                                                             \
+   size_t gmask = m->nslots / DS_HMAP_GROUP_WIDTH - 1;                        \
+   size_t g = DS_HMAP_H1 (hash) & gmask;                                      \
+   int8_t h2 = DS_HMAP_H2 (hash);                                             \
+                                                                              \
+   for (size_t i=0; i<=gmask; i++) {                                          \
+      const int8_t *group = &m->ctrl[g * DS_HMAP_GROUP_WIDTH];                \
+      uint32_t mask = ds_hmap_group_match (group, h2);                        \
+      while (mask) {                                                          \
+         size_t idx = g * DS_HMAP_GROUP_WIDTH + ds_hmap_mask_first (mask);    \
+         if (eqfn (m->slots[idx].key, key))                                   \
+            return idx;                                                       \
+         mask &= mask - 1;                                                    \
+      }                                                                       \
+      if (ds_hmap_group_match (group, DS_HMAP_CTRL_EMPTY))                    \
+         break;                                                               \
+      g = (g + i + 1) & gmask;                                                \
+   }                                                                          \
+                                                                              \
+   return (size_t)-1;                                                         \
+}                                                                             \
+                                                                              \
+LOCAL_INLINE                                                                  \
+static bool name##_resize_ (name##_t *m, size_t nslots)                       \
+{                                                                             \
+   name##_t n;                                                                \
+                                                                              \
+   if (!(name##_init_ (&n, nslots)))                                          \
+      return false;                                                           \
+                                                                              \
+   for (size_t i=0; i<m->nslots; i++) {                                       \
+      if (m->ctrl[i] < 0)                                                     \
+         continue;                                                            \
+      n.slots[name##_claim_ (&n, hashfn (m->slots[i].key))] = m->slots[i];    \
+   }                                                                          \
+                                                                              \
+   n.nentries = m->nentries;                                                  \
+   free (m->slots);                                                           \
+   *m = n;                                                                    \
+   return true;                                                               \
+}                                                                             \
+                                                                              \
+LOCAL_INLINE                                                                  \
+static name##_t *name##_new (size_t capacity)                                 \
+{                                                                             \
+   name##_t *ret = malloc (sizeof *ret);                                      \
+                                                                              \
+   if (ret && !(name##_init_ (ret, capacity + capacity / 7))) {               \
+      free (ret);                                                             \
+      ret = NULL;                                                             \
+   }                                                                          \
+   return ret;                                                                \
+}                                                                             \
+                                                                              \
+LOCAL_INLINE                                                                  \
+static void name##_del (name##_t *m)                                          \
+{                                                                             \
+   if (!m)                                                                    \
+      return;                                                                 \
+   free (m->slots);                                                           \
+   free (m);                                                                  \
+}                                                                             \
+                                                                              \
+LOCAL_INLINE                                                                  \
+static V *name##_get (name##_t *m, K key)                                     \
+{                                                                             \
+   size_t idx = name##_find_ (m, key, hashfn (key));                          \
+   return idx == (size_t)-1 ? NULL : &m->slots[idx].value;                    \
+}                                                                             \
+                                                                              \
+LOCAL_INLINE                                                                  \
+static bool name##_set (name##_t *m, K key, V value)                          \
+{                                                                             \
+   uint64_t hash = hashfn (key);                                              \
+   size_t idx = name##_find_ (m, key, hash);                                  \
+                                                                              \
+   if (idx != (size_t)-1) {                                                   \
+      m->slots[idx].value = value;                                            \
+      return true;                                                            \
+   }                                                                          \
+                                                                              \
+   /* Grow (or drop the deleted slots) at 7/8 of the slots in use */          \
+   if (m->nused + 1 > m->nslots - m->nslots / 8) {                            \
+      size_t nslots = m->nentries + 1 > m->nslots / 2 ? m->nslots * 2         \
+                                                      : m->nslots;            \
+      if (!(name##_resize_ (m, nslots)))                                      \
+         return false;                                                        \
+   }                                                                          \
+                                                                              \
+   idx = name##_claim_ (m, hash);                                             \
+   m->slots[idx].key = key;                                                   \
+   m->slots[idx].value = value;                                               \
+   m->nentries++;                                                             \
+   return true;                                                               \
+}                                                                             \
+                                                                              \
+LOCAL_INLINE                                                                  \
+static bool name##_remove (name##_t *m, K key)                                \
+{                                                                             \
+   size_t idx = name##_find_ (m, key, hashfn (key));                          \
+                                                                              \
+   if (idx == (size_t)-1)                                                     \
+      return false;                                                           \
+                                                                              \
+   /* As for the flat engine: a group with an empty slot never had a */       \
+   /* probe sequence continue past it, so the slot can become empty. */       \
+   const int8_t *group = &m->ctrl[idx & ~(size_t)(DS_HMAP_GROUP_WIDTH - 1)];  \
+   if (ds_hmap_group_match (group, DS_HMAP_CTRL_EMPTY)) {                     \
+      m->ctrl[idx] = DS_HMAP_CTRL_EMPTY;                                      \
+      m->nused--;                                                             \
+   } else {                                                                   \
+      m->ctrl[idx] = DS_HMAP_CTRL_DELETED;                                    \
+   }                                                                          \
+   m->nentries--;                                                             \
+   return true;                                                               \
+}                                                                             \
+                                                                              \
+LOCAL_INLINE                                                                  \
+static size_t name##_num_entries (name##_t *m)                                \
+{                                                                             \
+   return m->nentries;                                                        \
+}                                                                             \
+                                                                              \
+LOCAL_INLINE                                                                  \
+static bool name##_next (name##_t *m, size_t *pos, K *key, V **value)         \
+{                                                                             \
+   while (*pos < m->nslots && m->ctrl[*pos] < 0)                              \
+      (*pos)++;                                                               \
+                                                                              \
+   if (*pos >= m->nslots)                                                     \
+      return false;                                                           \
+                                                                              \
+   if (key)     *key = m->slots[*pos].key;                                    \
+   if (value)   *value = &m->slots[*pos].value;                               \
+   (*pos)++;                                                                  \
+   return true;                                                               \
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef H_DS_HMULTIMAP
+#define H_DS_HMULTIMAP
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ds_hmap.h"
+
+/* A hashmap in which a key may have any number of values, built on
+ * ds_hmap_t. Each key is stored once, and all of its values are kept
+ * together in a single array in the order in which they were added, so
+ * that fetching every value of a key is one lookup followed by a walk
+ * over contiguous memory.
+ *
+ * As with ds_hmap_t the key is copied and the data is not. Unlike
+ * ds_hmap_t the data may be NULL.
+ */
+
+typedef struct ds_hmultimap_t ds_hmultimap_t;
+
+// A single value of a key
+typedef struct ds_hmultimap_value_t ds_hmultimap_value_t;
+struct ds_hmultimap_value_t {
+   void       *data;
+   size_t      datalen;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+   // Create a new multimap, with the settings in the config for the
+   // hashmap that holds the keys (see ds_hmap_new_ex()). If config is
+   // NULL then all the default values are used. Returns NULL on error.
+   ds_hmultimap_t *ds_hmultimap_new (void);
+   ds_hmultimap_t *ds_hmultimap_new_ex (const ds_hmap_config_t *config);
+
+   // Deletes the multimap. The data remains the responsibility of the
+   // caller.
+   void ds_hmultimap_del (ds_hmultimap_t *mm);
+
+   // Adds a value to the key, after any values the key already has.
+   // Returns false on error.
+   bool ds_hmultimap_add (ds_hmultimap_t *mm, const void *key, size_t keylen,
+                                              void *data, size_t datalen);
+
+   // Returns the number of values of the key, which is zero if the key is
+   // not in the multimap. If 'values' is not NULL it is set to the array
+   // of the values, in the order in which they were added, or to NULL
+   // when there are none. The array is only valid until the next call
+   // that adds or removes values of the same key.
+   size_t ds_hmultimap_get (ds_hmultimap_t *mm, const void *key, size_t keylen,
+                            const ds_hmultimap_value_t **values);
+
+   // Removes the first value of the key whose data is the given pointer;
+   // the remaining values keep their order. The key is removed with its
+   // last value. Returns true if a value was removed.
+   bool ds_hmultimap_remove_value (ds_hmultimap_t *mm,
+                                   const void *key, size_t keylen,
+                                   const void *data);
+
+   // Removes the key and all of its values.
+   void ds_hmultimap_remove (ds_hmultimap_t *mm, const void *key, size_t keylen);
+
+   // Returns the number of distinct keys, and the number of values of
+   // all the keys together.
+   size_t ds_hmultimap_num_keys (ds_hmultimap_t *mm);
+   size_t ds_hmultimap_num_values (ds_hmultimap_t *mm);
+
+   // Removes every key and value. The hashmap keeps its memory (see
+   // ds_hmap_clear()). Returns false on error.
+   bool ds_hmultimap_clear (ds_hmultimap_t *mm);
+
+   // Calls fptr() once for each key with all of the values of the key,
+   // in an unspecified order of keys.
+   void ds_hmultimap_iterate (ds_hmultimap_t *mm,
+                              void (*fptr) (const void *key, size_t keylen,
+                                            const ds_hmultimap_value_t *values,
+                                            size_t nvalues,
+                                            void *extra_param),
+                              void *extra_param);
+
+#ifdef __cplusplus
+};
+#endif
+
+LOCAL_INLINE
+static bool ds_hmultimap_add_str (ds_hmultimap_t *mm, const char *key, void *data)
+{
+   return ds_hmultimap_add (mm, key, strlen (key) + 1, data, sizeof data);
+}
+
+LOCAL_INLINE
+static size_t ds_hmultimap_get_str (ds_hmultimap_t *mm, const char *key,
+                                    const ds_hmultimap_value_t **values)
+{
+   return ds_hmultimap_get (mm, key, strlen (key) + 1, values);
+}
+
+#endif
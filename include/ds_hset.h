@@ -0,0 +1,88 @@
+#ifndef H_DS_HSET
+#define H_DS_HSET
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ds_hmap.h"
+
+/* A set of keys built on ds_hmap_t. Keys are copied and stored exactly as
+ * they are in a hashmap (using whichever engine is chosen in the config),
+ * but the hashmap is always created with keys_only set, so its entries
+ * have no room for data.
+ *
+ * The union and intersection of two sets are computed in batches: the
+ * keys of one set are gathered from an iterator a batch at a time and
+ * then set in, or looked up in, the other set with ds_hmap_set_many() or
+ * ds_hmap_get_many(), so that the cache misses of a batch overlap.
+ */
+
+typedef struct ds_hset_t ds_hset_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+   // Create a new set, with the settings in the config for the hashmap
+   // that holds the keys (see ds_hmap_new_ex()). If config is NULL then
+   // all the default values are used. Returns NULL on error.
+   ds_hset_t *ds_hset_new (void);
+   ds_hset_t *ds_hset_new_ex (const ds_hmap_config_t *config);
+
+   void ds_hset_del (ds_hset_t *hs);
+
+   // Adds the key to the set; adding a key that is already in the set
+   // does nothing. Returns false on error.
+   bool ds_hset_add (ds_hset_t *hs, const void *key, size_t keylen);
+
+   // Returns true if the key is in the set.
+   bool ds_hset_contains (ds_hset_t *hs, const void *key, size_t keylen);
+
+   // Removes the key from the set, if it is there.
+   void ds_hset_remove (ds_hset_t *hs, const void *key, size_t keylen);
+
+   // Returns the number of keys in the set.
+   size_t ds_hset_num_entries (ds_hset_t *hs);
+
+   // Removes every key, keeping the memory (see ds_hmap_clear()).
+   // Returns false on error.
+   bool ds_hset_clear (ds_hset_t *hs);
+
+   // Adds every key of src to dst. Returns false on error, in which case
+   // some of the keys may have been added.
+   bool ds_hset_union (ds_hset_t *dst, ds_hset_t *src);
+
+   // Removes every key of dst that is not in src. Returns false on error.
+   bool ds_hset_intersect (ds_hset_t *dst, ds_hset_t *src);
+
+   // Starts a cursor over the keys of the set, which is then moved with
+   // ds_hmap_iter_next(); the key and keylen fields of the cursor hold
+   // the current key. ds_hmap_iter_remove() removes the current key.
+   void ds_hset_iter_init (ds_hset_t *hs, ds_hmap_iter_t *it);
+
+#ifdef __cplusplus
+};
+#endif
+
+// Sets of strings are the most common, so a few convenience functions
+// are provided for them.
+LOCAL_INLINE
+static bool ds_hset_add_str (ds_hset_t *hs, const char *key)
+{
+   return ds_hset_add (hs, key, strlen (key) + 1);
+}
+
+LOCAL_INLINE
+static bool ds_hset_contains_str (ds_hset_t *hs, const char *key)
+{
+   return ds_hset_contains (hs, key, strlen (key) + 1);
+}
+
+LOCAL_INLINE
+static void ds_hset_remove_str (ds_hset_t *hs, const char *key)
+{
+   ds_hset_remove (hs, key, strlen (key) + 1);
+}
+
+#endif
@@ -0,0 +1,46 @@
+ 
+// This is an autogenerated file. Editing this will have no effect 
+ 
+const char *build_info_ds_name (void) { 
+   return "ds"; 
+} 
+ 
+const char *build_info_ds_version (void) { 
+   return "1.0.7"; 
+} 
+ 
+const char *build_info_ds_githash (void) { 
+   return "457970e1cfb3a1b3a2e896ed88dd202a32e57649"; 
+} 
+ 
+const char *build_info_ds_gitbranch (void) { 
+   return "master"; 
+} 
+ 
+const char *build_info_ds_target (void) { 
+   return "x86_64-linux-gnu"; 
+} 
+ 
+const char *build_info_ds_targetplatform (void) { 
+   return "POSIX"; 
+} 
+ 
+const char *build_info_ds_hostname (void) { 
+   return "Linux"; 
+} 
+ 
+const char *build_info_ds_ccversion (void) { 
+   return "gcc (Debian 12.2.0-14+deb12u1) 12.2.0"; 
+} 
+ 
+const char *build_info_ds_build (void) { 
+   return "debug"; 
+} 
+ 
+const char *build_info_ds_timestamp (void) { 
+   return "1792213042"; 
+} 
+ 
+const char *build_info_ds_homepage (void) { 
+   return "No homepage"; 
+} 
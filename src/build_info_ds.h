@@ -0,0 +1,26 @@
+ 
+// This is an autogenerated file. Editing this will have no effect 
+ 
+#ifndef H_BUILD_INFO_ds 
+#define H_BUILD_INFO_ds 
+#ifdef __cplusplus 
+extern "C" { 
+#endif 
+ 
+   const char *build_info_ds_name (void); 
+   const char *build_info_ds_version (void); 
+   const char *build_info_ds_githash (void); 
+   const char *build_info_ds_gitbranch (void); 
+   const char *build_info_ds_target (void); 
+   const char *build_info_ds_targetplatform (void); 
+   const char *build_info_ds_hostname (void); 
+   const char *build_info_ds_ccversion (void); 
+   const char *build_info_ds_build (void); 
+   const char *build_info_ds_timestamp (void); 
+   const char *build_info_ds_homepage (void); 
+ 
+#ifdef __cplusplus 
+}; 
+#endif 
+ 
+#endif
\ No newline at end of file
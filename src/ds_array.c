@@ -1,12 +1,21 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdint.h>
 
+#include <pthread.h>
+
 #include "ds_array.h"
 
+// The array always has room for capacity elements followed by a NULL
+// terminator, and every slot after the last element is NULL.
+#define MIN_CAPACITY       (4)
+
 struct ds_array_t {
    size_t nitems;
+   size_t capacity;
    void **array;
 };
 
@@ -31,19 +40,19 @@ void ds_array_del (ds_array_t *ll)
 
 ds_array_t *ds_array_copy (const ds_array_t *src, size_t from_index, size_t to_index)
 {
-   size_t nitems;
-   ds_array_t *ret = ds_array_new ();
+   ds_array_t *ret = NULL;
    bool error = true;
 
    if (!src)
       return NULL;
 
-   nitems = ds_array_length (src);
+   ds_array_view_t view = ds_array_view (src, from_index, to_index);
 
-   for (size_t i=from_index; i>=from_index && i<to_index && i<nitems; i++) {
-      if (!(ds_array_ins_tail (ret, src->array[i])))
-         goto errorexit;
-   }
+   if (!(ret = ds_array_new ()))
+      goto errorexit;
+
+   if (view.nitems && !(ds_array_append_n (ret, view.items, view.nitems)))
+      goto errorexit;
 
    error = false;
 
@@ -87,31 +96,64 @@ void ds_array_iterate (const ds_array_t *ll,
    }
 }
 
-static bool ds_array_grow (ds_array_t *ll, size_t nelems)
+// Sets the capacity, which must not be less than the number of elements
+static bool ds_array_resize (ds_array_t *ll, size_t capacity)
 {
-   if (!ll)
-      return false;
-
-   void **tmp = realloc (ll->array, (sizeof *ll->array) * (ll->nitems + 1 + nelems + 1));
+   void **tmp = realloc (ll->array, (sizeof *ll->array) * (capacity + 1));
    if (!tmp)
       return false;
 
    ll->array = tmp;
 
-   memset (&ll->array[ll->nitems], 0, (sizeof *ll->array) * (nelems + 1));
+   if (capacity > ll->capacity)
+      memset (&ll->array[ll->capacity + 1], 0,
+              (sizeof *ll->array) * (capacity - ll->capacity));
+
+   ll->capacity = capacity;
    return true;
 }
 
-void ds_array_shrink_to_fit (ds_array_t *ll)
+// Makes room for nelems more elements. The capacity is at least doubled
+// each time, so that appending n elements takes O(log n) reallocations.
+static bool ds_array_grow (ds_array_t *ll, size_t nelems)
 {
    if (!ll)
-      return;
+      return false;
 
-   void **tmp = realloc (ll->array, (sizeof *ll->array) * (ll->nitems + 1));
-   if (!tmp)
+   if (ll->capacity - ll->nitems >= nelems)
+      return true;
+
+   size_t capacity = ll->capacity * 2;
+   if (capacity < ll->nitems + nelems)
+      capacity = ll->nitems + nelems;
+   if (capacity < MIN_CAPACITY)
+      capacity = MIN_CAPACITY;
+
+   return ds_array_resize (ll, capacity);
+}
+
+bool ds_array_reserve (ds_array_t *ll, size_t nelems)
+{
+   if (!ll)
+      return false;
+
+   if (nelems <= ll->capacity)
+      return true;
+
+   return ds_array_resize (ll, nelems);
+}
+
+size_t ds_array_capacity (const ds_array_t *ll)
+{
+   return ll ? ll->capacity : 0;
+}
+
+void ds_array_shrink_to_fit (ds_array_t *ll)
+{
+   if (!ll || ll->capacity == ll->nitems)
       return;
 
-   ll->array = tmp;
+   ds_array_resize (ll, ll->nitems);
 }
 
 void *ds_array_ins_tail (ds_array_t *ll, void *el)
@@ -176,6 +218,103 @@ void *ds_array_rm (ds_array_t *ll, size_t index)
 
    memmove (&ll->array[index], &ll->array[index + 1],
             (sizeof (void *)) * (ll->nitems - index));
+   ll->nitems--;
+
+   return ret;
+}
+
+/* ******************************************************************
+ * Bulk operations. Each one moves the existing elements at most once and
+ * copies the new elements in a single memcpy.
+ */
+
+bool ds_array_splice (ds_array_t *ll, size_t at, void *const *src, size_t n)
+{
+   bool error = true;
+   void **copy = NULL;
+
+   if (!ll || at > ll->nitems || (n && !src))
+      return false;
+
+   if (!n)
+      return true;
+
+   for (size_t i=0; i<n; i++) {
+      if (!src[i])
+         return false;
+   }
+
+   // Elements of the array itself (as from a view of it) would move
+   // while the array is grown and opened up, so they are copied first.
+   uintptr_t start = (uintptr_t)ll->array,
+             end = (uintptr_t)&ll->array[ll->capacity + 1];
+   if ((uintptr_t)src < end && (uintptr_t)&src[n] > start) {
+      if (!(copy = malloc (n * sizeof *copy)))
+         goto errorexit;
+      memcpy (copy, src, n * sizeof *copy);
+      src = copy;
+   }
+
+   if (!(ds_array_grow (ll, n)))
+      goto errorexit;
+
+   memmove (&ll->array[at + n], &ll->array[at],
+            (sizeof *ll->array) * (ll->nitems - at));
+   memcpy (&ll->array[at], src, (sizeof *ll->array) * n);
+   ll->nitems += n;
+
+   error = false;
+
+errorexit:
+
+   free (copy);
+
+   return !error;
+}
+
+bool ds_array_append_n (ds_array_t *ll, void *const *src, size_t n)
+{
+   return ll ? ds_array_splice (ll, ll->nitems, src, n) : false;
+}
+
+bool ds_array_append (ds_array_t *dst, const ds_array_t *src)
+{
+   if (!dst || !src)
+      return false;
+
+   return ds_array_splice (dst, dst->nitems, src->array, src->nitems);
+}
+
+size_t ds_array_rm_range (ds_array_t *ll, size_t from, size_t n)
+{
+   if (!ll || from >= ll->nitems)
+      return 0;
+
+   if (n > ll->nitems - from)
+      n = ll->nitems - from;
+
+   // The terminator is moved along with the elements after the range,
+   // and the slots that are left behind are cleared.
+   memmove (&ll->array[from], &ll->array[from + n],
+            (sizeof *ll->array) * (ll->nitems - from - n + 1));
+   memset (&ll->array[ll->nitems - n + 1], 0, (sizeof *ll->array) * n);
+   ll->nitems -= n;
+
+   return n;
+}
+
+ds_array_view_t ds_array_view (const ds_array_t *ll, size_t from, size_t to)
+{
+   ds_array_view_t ret = { NULL, 0 };
+
+   if (!ll || from >= to || from >= ll->nitems)
+      return ret;
+
+   if (to > ll->nitems)
+      to = ll->nitems;
+
+   ret.items = &ll->array[from];
+   ret.nitems = to - from;
 
    return ret;
 }
@@ -202,3 +341,360 @@ void **ds_array_all (ds_array_t *ll, void ***dst, size_t *dstlen)
    *dst = tmp;
    return *dst;
 }
+
+/* ******************************************************************
+ * Sorting. The sort is an introsort: a quicksort with a median of three
+ * pivot moved to the front and a Hoare partition, which switches to a
+ * heapsort when the recursion gets too deep and leaves small ranges to a
+ * final insertion sort. The pointers are sorted in place and the
+ * comparison function is given the elements themselves.
+ */
+#define INSERTION_SORT_MAX    (16)
+
+#define SWAP(a,b)             do { void *tmp_ = (a); (a) = (b); (b) = tmp_; } while (0)
+
+static void insertion_sort (void **a, size_t n, ds_array_cmpfn_t *cmp)
+{
+   for (size_t i=1; i<n; i++) {
+      void *el = a[i];
+      size_t j = i;
+      while (j > 0 && cmp (el, a[j - 1]) < 0) {
+         a[j] = a[j - 1];
+         j--;
+      }
+      a[j] = el;
+   }
+}
+
+static void sift_down (void **a, size_t i, size_t n, ds_array_cmpfn_t *cmp)
+{
+   void *el = a[i];
+
+   while (2 * i + 1 < n) {
+      size_t child = 2 * i + 1;
+      if (child + 1 < n && cmp (a[child], a[child + 1]) < 0)
+         child++;
+      if (cmp (el, a[child]) >= 0)
+         break;
+      a[i] = a[child];
+      i = child;
+   }
+   a[i] = el;
+}
+
+static void heap_sort (void **a, size_t n, ds_array_cmpfn_t *cmp)
+{
+   for (size_t i=n / 2; i>0; i--) {
+      sift_down (a, i - 1, n, cmp);
+   }
+
+   for (size_t i=n - 1; i>0; i--) {
+      SWAP (a[0], a[i]);
+      sift_down (a, 0, i, cmp);
+   }
+}
+
+// Partitions a[0..n) around the median of the first, middle and last
+// elements, and returns j such that a[0..j] <= pivot <= a[j+1..n). Both
+// parts are non-empty, as the pivot is placed first.
+static size_t partition (void **a, size_t n, ds_array_cmpfn_t *cmp)
+{
+   size_t mid = n / 2;
+
+   if (cmp (a[mid], a[0]) < 0)
+      SWAP (a[mid], a[0]);
+   if (cmp (a[n - 1], a[mid]) < 0) {
+      SWAP (a[n - 1], a[mid]);
+      if (cmp (a[mid], a[0]) < 0)
+         SWAP (a[mid], a[0]);
+   }
+   SWAP (a[0], a[mid]);
+
+   void *pivot = a[0];
+   size_t i = 0, j = n - 1;
+
+   for (;;) {
+      while (cmp (a[i], pivot) < 0)
+         i++;
+      while (cmp (pivot, a[j]) < 0)
+         j--;
+      if (i >= j)
+         return j;
+      SWAP (a[i], a[j]);
+      i++;
+      j--;
+   }
+}
+
+static void intro_sort (void **a, size_t n, size_t depth, ds_array_cmpfn_t *cmp)
+{
+   // The smaller part is sorted recursively and the larger one by the
+   // loop, so the stack depth is at most log2 (n).
+   while (n > INSERTION_SORT_MAX) {
+      if (!depth) {
+         heap_sort (a, n, cmp);
+         return;
+      }
+      depth--;
+
+      size_t split = partition (a, n, cmp) + 1;
+      if (split < n - split) {
+         intro_sort (a, split, depth, cmp);
+         a += split;
+         n -= split;
+      } else {
+         intro_sort (a + split, n - split, depth, cmp);
+         n = split;
+      }
+   }
+
+   insertion_sort (a, n, cmp);
+}
+
+static void array_sort (void **a, size_t n, ds_array_cmpfn_t *cmp)
+{
+   size_t depth = 0;
+
+   for (size_t i=n; i>1; i/=2) {
+      depth += 2;
+   }
+
+   intro_sort (a, n, depth, cmp);
+}
+
+void ds_array_sort (ds_array_t *ll, ds_array_cmpfn_t *cmp)
+{
+   if (!ll || !cmp)
+      return;
+
+   array_sort (ll->array, ll->nitems, cmp);
+}
+
+size_t ds_array_lower_bound (const ds_array_t *ll, const void *key,
+                             ds_array_cmpfn_t *cmp)
+{
+   if (!ll || !cmp)
+      return 0;
+
+   size_t lo = 0, hi = ll->nitems;
+
+   while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (cmp (ll->array[mid], key) < 0) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+
+   return lo;
+}
+
+void *ds_array_bsearch (const ds_array_t *ll, const void *key,
+                        ds_array_cmpfn_t *cmp)
+{
+   size_t i = ds_array_lower_bound (ll, key, cmp);
+
+   if (!ll || !cmp || i >= ll->nitems || cmp (ll->array[i], key) != 0)
+      return NULL;
+
+   return ll->array[i];
+}
+
+/* ******************************************************************
+ * Parallel sorting. The array is cut into one run per thread and each
+ * thread sorts its run. The runs are then merged in pairs, round after
+ * round, into a second buffer and back. In every round each thread
+ * writes an equal share of the output, so all the threads stay busy
+ * even when only two runs are left: the share of a merge that a thread
+ * writes starts at the point found by a binary search over both runs.
+ */
+#define SORT_MAX_THREADS      (64)
+#define SORT_MIN_PER_THREAD   (16384)
+
+typedef struct sorter_t sorter_t;
+struct sorter_t {
+   void              **src;
+   void              **dst;
+   const size_t       *bounds;    // Start of each run, then the end
+   size_t              nruns;
+   size_t              lo;        // The part of the output to write
+   size_t              hi;
+   ds_array_cmpfn_t   *cmp;
+   void              (*fn) (sorter_t *);
+};
+
+// Returns how many of the first k elements of the merge of a and b come
+// from a. Elements of a go before equal elements of b.
+static size_t merge_split (void **a, size_t na, void **b, size_t nb, size_t k,
+                           ds_array_cmpfn_t *cmp)
+{
+   size_t lo = k > nb ? k - nb : 0;
+   size_t hi = k < na ? k : na;
+
+   while (lo < hi) {
+      size_t i = lo + (hi - lo) / 2;
+      if (cmp (a[i], b[k - i - 1]) <= 0) {
+         lo = i + 1;
+      } else {
+         hi = i;
+      }
+   }
+
+   return lo;
+}
+
+static void merge (void **a, size_t na, void **b, size_t nb, void **dst,
+                   ds_array_cmpfn_t *cmp)
+{
+   while (na && nb) {
+      if (cmp (*b, *a) < 0) {
+         *dst++ = *b++;
+         nb--;
+      } else {
+         *dst++ = *a++;
+         na--;
+      }
+   }
+
+   memcpy (dst, a, na * sizeof *a);
+   memcpy (dst + na, b, nb * sizeof *b);
+}
+
+static void sort_runs (sorter_t *s)
+{
+   array_sort (&s->src[s->lo], s->hi - s->lo, s->cmp);
+}
+
+static void merge_runs (sorter_t *s)
+{
+   for (size_t r=0; r<s->nruns; r+=2) {
+      size_t start = s->bounds[r];
+      size_t end = s->bounds[r + 2 < s->nruns ? r + 2 : s->nruns];
+      size_t from = start > s->lo ? start : s->lo;
+      size_t to = end < s->hi ? end : s->hi;
+
+      if (from >= to)
+         continue;
+
+      // The last run of an odd number of runs has nothing to merge with
+      if (r + 1 == s->nruns) {
+         memcpy (&s->dst[from], &s->src[from], (to - from) * sizeof *s->src);
+         continue;
+      }
+
+      size_t mid = s->bounds[r + 1];
+      void **a = &s->src[start], **b = &s->src[mid];
+      size_t na = mid - start, nb = end - mid;
+      size_t i0 = merge_split (a, na, b, nb, from - start, s->cmp);
+      size_t i1 = merge_split (a, na, b, nb, to - start, s->cmp);
+      size_t j0 = from - start - i0, j1 = to - start - i1;
+
+      merge (&a[i0], i1 - i0, &b[j0], j1 - j0, &s->dst[from], s->cmp);
+   }
+}
+
+static void *sort_thread (void *arg)
+{
+   sorter_t *s = arg;
+
+   s->fn (s);
+   return NULL;
+}
+
+// Runs fn on every sorter, each on its own thread except the first,
+// which runs on the calling thread. A sorter whose thread cannot be
+// started runs on the calling thread too.
+static void sort_run (sorter_t *sorters, size_t nsorters, void (*fn) (sorter_t *))
+{
+   pthread_t threads[SORT_MAX_THREADS];
+   bool started[SORT_MAX_THREADS] = { false };
+
+   for (size_t i=0; i<nsorters; i++) {
+      sorters[i].fn = fn;
+      if (i > 0)
+         started[i] = pthread_create (&threads[i], NULL, sort_thread, &sorters[i]) == 0;
+   }
+
+   for (size_t i=0; i<nsorters; i++) {
+      if (!started[i])
+         fn (&sorters[i]);
+   }
+
+   for (size_t i=0; i<nsorters; i++) {
+      if (started[i])
+         pthread_join (threads[i], NULL);
+   }
+}
+
+// The start of part i of n equal parts of nitems
+static size_t part_start (size_t nitems, size_t n, size_t i)
+{
+   return nitems / n * i + nitems % n * i / n;
+}
+
+bool ds_array_sort_parallel (ds_array_t *ll, ds_array_cmpfn_t *cmp, size_t nthreads)
+{
+   sorter_t sorters[SORT_MAX_THREADS];
+   size_t bounds[SORT_MAX_THREADS + 1];
+   void **tmp = NULL;
+
+   if (!ll || !cmp)
+      return false;
+
+   size_t nitems = ll->nitems;
+
+   if (nthreads > SORT_MAX_THREADS)
+      nthreads = SORT_MAX_THREADS;
+   if (nthreads > nitems / SORT_MIN_PER_THREAD)
+      nthreads = nitems / SORT_MIN_PER_THREAD;
+
+   // The second buffer replaces the array if the last round writes into
+   // it, so it is the same size and ends in NULLs.
+   if (nthreads < 2 || !(tmp = calloc (ll->capacity + 1, sizeof *tmp))) {
+      ds_array_sort (ll, cmp);
+      return true;
+   }
+
+   for (size_t i=0; i<=nthreads; i++) {
+      bounds[i] = part_start (nitems, nthreads, i);
+   }
+
+   void **src = ll->array, **dst = tmp;
+   size_t nruns = nthreads;
+
+   for (size_t i=0; i<nthreads; i++) {
+      sorters[i] = (sorter_t) { .src = src, .cmp = cmp,
+                                .lo = bounds[i], .hi = bounds[i + 1] };
+   }
+   sort_run (sorters, nthreads, sort_runs);
+
+   while (nruns > 1) {
+      for (size_t i=0; i<nthreads; i++) {
+         sorters[i] = (sorter_t) { .src = src, .dst = dst, .cmp = cmp,
+                                   .bounds = bounds, .nruns = nruns,
+                                   .lo = part_start (nitems, nthreads, i),
+                                   .hi = part_start (nitems, nthreads, i + 1) };
+      }
+      sort_run (sorters, nthreads, merge_runs);
+
+      for (size_t r=0; r<nruns; r+=2) {
+         bounds[r / 2] = bounds[r];
+      }
+      nruns = (nruns + 1) / 2;
+      bounds[nruns] = nitems;
+
+      void **swap = src;
+      src = dst;
+      dst = swap;
+   }
+
+   if (src == tmp) {
+      free (ll->array);
+      ll->array = tmp;
+   } else {
+      free (tmp);
+   }
+
+   return true;
+}
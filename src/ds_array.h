@@ -3,9 +3,19 @@
 #define H_DS_LL
 
 #include <stdlib.h>
+#include <stdbool.h>
 
 typedef struct ds_array_t ds_array_t;
 
+// A view of a range of the elements of an array, which does not own the
+// elements or make a copy of them. A view is passed by value and is only
+// valid until the array it was taken from is next changed.
+typedef struct ds_array_view_t ds_array_view_t;
+struct ds_array_view_t {
+   void *const   *items;
+   size_t         nitems;
+};
+
 // This array stores pointers to objects that must be allocated and freed by the caller.
 // Removing an entry from the array does not free the object stored by the caller. The caller
 // must free all objects that they have allocated.
@@ -31,10 +41,68 @@ extern "C" {
 
    void *ds_array_rm (ds_array_t *ll, size_t index);
 
+   // Inserts the n elements of src (none of which may be NULL) at index
+   // 'at', which may be the length of the array, moving the elements that
+   // follow up by n. The elements may come from the array itself. Returns
+   // false on error, in which case the array is unchanged.
+   bool ds_array_splice (ds_array_t *ll, size_t at, void *const *src, size_t n);
+
+   // The same as ds_array_splice() at the end of the array, with the
+   // elements taken from a C array or from all of another array.
+   bool ds_array_append_n (ds_array_t *ll, void *const *src, size_t n);
+   bool ds_array_append (ds_array_t *dst, const ds_array_t *src);
+
+   // Removes up to n elements starting at index 'from', and returns the
+   // number of elements that were removed.
+   size_t ds_array_rm_range (ds_array_t *ll, size_t from, size_t n);
+
+   // Returns a view of the elements from index 'from' up to, but not
+   // including, index 'to'. A range that extends past the end of the
+   // array is cut short; an empty range gives a view with no items.
+   ds_array_view_t ds_array_view (const ds_array_t *ll, size_t from, size_t to);
+
+   // The array grows geometrically as elements are inserted, so that
+   // appending is amortised O(1). The capacity is the number of elements
+   // the array holds before it has to grow again. ds_array_reserve()
+   // grows the array to hold at least nelems elements in total and
+   // returns false on error. ds_array_shrink_to_fit() releases the unused
+   // capacity.
+   size_t ds_array_capacity (const ds_array_t *ll);
+   bool ds_array_reserve (ds_array_t *ll, size_t nelems);
    void ds_array_shrink_to_fit (ds_array_t *ll);
 
    void **ds_array_all (ds_array_t *ll, void ***dst, size_t *dstlen);
 
+   // Compares two elements (the pointers stored in the array, not pointers
+   // to them), returning less than, equal to or greater than zero.
+   typedef int (ds_array_cmpfn_t) (const void *a, const void *b);
+
+   // Sorts the elements in place with an introsort (quicksort, falling
+   // back to heapsort, with an insertion sort for short ranges). The
+   // sort is not stable.
+   void ds_array_sort (ds_array_t *ll, ds_array_cmpfn_t *cmp);
+
+   // Sorts the elements with a merge sort on up to nthreads threads: each
+   // thread sorts a run with ds_array_sort() and the runs are merged by
+   // all the threads together. Arrays too short to be worth the threads
+   // are sorted with ds_array_sort(). The cmp function must be safe to
+   // call from several threads at once. The array is left sorted by cmp,
+   // as by ds_array_sort(), though the order of equal elements may
+   // differ; returns false if either parameter is NULL.
+   bool ds_array_sort_parallel (ds_array_t *ll, ds_array_cmpfn_t *cmp,
+                                size_t nthreads);
+
+   // In an array sorted by cmp, returns the index of the first element
+   // that is not less than the key (the length of the array if there is
+   // none). The cmp function is called with an element and the key.
+   size_t ds_array_lower_bound (const ds_array_t *ll, const void *key,
+                                ds_array_cmpfn_t *cmp);
+
+   // In an array sorted by cmp, returns an element equal to the key, or
+   // NULL if there is none.
+   void *ds_array_bsearch (const ds_array_t *ll, const void *key,
+                           ds_array_cmpfn_t *cmp);
+
 #ifdef __cplusplus
 };
 #endif
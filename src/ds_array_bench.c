@@ -0,0 +1,163 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "ds_array.h"
+
+/* Benchmarks for sorting a ds_array_t, compared with exporting the
+ * elements with ds_array_all() and sorting them with qsort(). The number
+ * of elements can be given as the first argument, for example:
+ *    ds_array_bench.elf 4000000
+ */
+
+#define DEFAULT_NITEMS     (1000000)
+
+static double now (void)
+{
+   struct timespec tp;
+   clock_gettime (CLOCK_MONOTONIC, &tp);
+   return (double)tp.tv_sec + (double)tp.tv_nsec / 1000000000.0;
+}
+
+static uint64_t rng_next (uint64_t *state)
+{
+   uint64_t x = *state;
+   x ^= x << 13;
+   x ^= x >> 7;
+   x ^= x << 17;
+   return *state = x;
+}
+
+static int cmp_values (const void *a, const void *b)
+{
+   uint64_t va = *(const uint64_t *)a, vb = *(const uint64_t *)b;
+   return va < vb ? -1 : va > vb;
+}
+
+// qsort() is given pointers to the elements
+static int cmp_qsort (const void *a, const void *b)
+{
+   return cmp_values (*(void *const *)a, *(void *const *)b);
+}
+
+static void print_result (const char *input, const char *test,
+                          double elapsed, size_t nitems)
+{
+   printf ("%-10s %-18s %10.1f ms %8.1f ns/item\n", input, test,
+           elapsed * 1000.0, elapsed * 1000000000.0 / (double)nitems);
+}
+
+// Makes the values for the input and empties the array
+static bool fill_array (ds_array_t *dsa, uint64_t *values, size_t nitems,
+                        const char *input)
+{
+   uint64_t state = 0x9e3779b97f4a7c15ull;
+
+   ds_array_rm_range (dsa, 0, ds_array_length (dsa));
+
+   for (size_t i=0; i<nitems; i++) {
+      if (strcmp (input, "random") == 0) {
+         values[i] = rng_next (&state);
+      } else if (strcmp (input, "sorted") == 0) {
+         values[i] = i;
+      } else {
+         values[i] = rng_next (&state) % 100;
+      }
+   }
+
+   return ds_array_reserve (dsa, nitems);
+}
+
+// Fills the array with pointers to the values, in order
+static bool load_array (ds_array_t *dsa, uint64_t *values, size_t nitems)
+{
+   for (size_t i=0; i<nitems; i++) {
+      if (!(ds_array_ins_tail (dsa, &values[i])))
+         return false;
+   }
+   return true;
+}
+
+static bool bench_input (const char *input, size_t nitems)
+{
+   bool error = true;
+   ds_array_t *dsa = NULL;
+   uint64_t *values = NULL;
+   void **all = NULL;
+   size_t nall = 0;
+   double start;
+
+   static const size_t nthreads[] = { 2, 4, 8 };
+
+   if (!(dsa = ds_array_new ()) || !(values = malloc (nitems * sizeof *values))) {
+      fprintf (stderr, "[%s] Out of memory\n", input);
+      goto errorexit;
+   }
+
+   if (!(fill_array (dsa, values, nitems, input)) || !(load_array (dsa, values, nitems)))
+      goto errorexit;
+
+   start = now ();
+   if (!(ds_array_all (dsa, &all, &nall)))
+      goto errorexit;
+   qsort (all, nall, sizeof *all, cmp_qsort);
+   print_result (input, "all + qsort", now () - start, nitems);
+
+   start = now ();
+   ds_array_sort (dsa, cmp_values);
+   print_result (input, "sort", now () - start, nitems);
+
+   for (size_t i=0; i<nitems; i++) {
+      if (ds_array_get (dsa, i) != all[i] && cmp_values (ds_array_get (dsa, i), all[i])) {
+         fprintf (stderr, "[%s] Sorted differently from qsort at %zu\n", input, i);
+         goto errorexit;
+      }
+   }
+
+   for (size_t i=0; i<sizeof nthreads / sizeof nthreads[0]; i++) {
+      char test[32];
+
+      if (!(fill_array (dsa, values, nitems, input)) || !(load_array (dsa, values, nitems)))
+         goto errorexit;
+
+      start = now ();
+      ds_array_sort_parallel (dsa, cmp_values, nthreads[i]);
+      snprintf (test, sizeof test, "sort %zu thr", nthreads[i]);
+      print_result (input, test, now () - start, nitems);
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_array_del (dsa);
+   free (values);
+   free (all);
+
+   return !error;
+}
+
+int main (int argc, char **argv)
+{
+   size_t nitems = DEFAULT_NITEMS;
+
+   if (argc > 1 && (sscanf (argv[1], "%zu", &nitems) != 1 || nitems == 0)) {
+      fprintf (stderr, "Invalid number of elements [%s]\n", argv[1]);
+      return EXIT_FAILURE;
+   }
+
+   printf ("Benchmarking with %zu elements\n", nitems);
+
+   if (!(bench_input ("random", nitems))
+         || !(bench_input ("sorted", nitems))
+         || !(bench_input ("few keys", nitems))) {
+      return EXIT_FAILURE;
+   }
+
+   return EXIT_SUCCESS;
+}
@@ -1,6 +1,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "ds_array.h"
 
@@ -17,6 +20,323 @@ static void print_string (void *arg, void *param)
    fprintf (of, "->[%s]\n", s);
 }
 
+static void count_elements (void *arg, void *param)
+{
+   (void)arg;
+   (*(size_t *)param)++;
+}
+
+static bool capacity_test (void)
+{
+   bool error = true;
+   ds_array_t *dsa = ds_array_new ();
+   static char element[] = "element";
+   size_t ngrown = 0, count = 0;
+   size_t capacity;
+
+   if (!dsa) {
+      LOG_MSG ("Failed to create new array object\n");
+      goto errorexit;
+   }
+
+   // The capacity is doubled, so it changes once for every doubling of
+   // the length.
+   capacity = ds_array_capacity (dsa);
+   for (size_t i=0; i<10000; i++) {
+      if (!(ds_array_ins_tail (dsa, element))) {
+         LOG_MSG ("Failed to insert element [%zu]\n", i);
+         goto errorexit;
+      }
+      if (ds_array_capacity (dsa) != capacity) {
+         capacity = ds_array_capacity (dsa);
+         ngrown++;
+      }
+   }
+   if (ngrown > 15 || capacity < 10000) {
+      LOG_MSG ("Capacity changed %zu times to %zu\n", ngrown, capacity);
+      goto errorexit;
+   }
+
+   ds_array_shrink_to_fit (dsa);
+   ds_array_iterate (dsa, count_elements, &count);
+   if (ds_array_capacity (dsa) != 10000 || count != 10000
+         || ds_array_length (dsa) != 10000) {
+      LOG_MSG ("Wrong capacity %zu after shrinking\n", ds_array_capacity (dsa));
+      goto errorexit;
+   }
+
+   // Nothing is reallocated up to the reserved capacity
+   if (!(ds_array_reserve (dsa, 20000)) || !(ds_array_reserve (dsa, 100))
+         || ds_array_capacity (dsa) != 20000) {
+      LOG_MSG ("Failed to reserve\n");
+      goto errorexit;
+   }
+   for (size_t i=0; i<10000; i++) {
+      ds_array_ins_head (dsa, element);
+   }
+   count = 0;
+   ds_array_iterate (dsa, count_elements, &count);
+   if (ds_array_capacity (dsa) != 20000 || count != 20000) {
+      LOG_MSG ("Capacity changed to %zu\n", ds_array_capacity (dsa));
+      goto errorexit;
+   }
+
+   while (ds_array_rm_tail (dsa))
+      ;
+   ds_array_shrink_to_fit (dsa);
+   if (ds_array_length (dsa) || ds_array_capacity (dsa)
+         || ds_array_get (dsa, 0) || !(ds_array_ins_tail (dsa, element))) {
+      LOG_MSG ("Failed to empty the array\n");
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_array_del (dsa);
+
+   return !error;
+}
+
+// Checks that the array holds exactly the given elements
+static bool check_array (const ds_array_t *dsa, const char *msg,
+                         char *const *expected, size_t n)
+{
+   size_t count = 0;
+
+   ds_array_iterate (dsa, count_elements, &count);
+   if (ds_array_length (dsa) != n || count != n) {
+      LOG_MSG ("[%s] Expected %zu elements, found %zu (%zu iterated)\n", msg, n,
+               ds_array_length (dsa), count);
+      return false;
+   }
+
+   for (size_t i=0; i<n; i++) {
+      if (ds_array_get (dsa, i) != expected[i]) {
+         LOG_MSG ("[%s] Wrong element at %zu\n", msg, i);
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static bool bulk_test (void)
+{
+   bool error = true;
+   ds_array_t *dsa = ds_array_new ();
+   ds_array_t *copy = NULL;
+   static char el[10][2] = { "0", "1", "2", "3", "4", "5", "6", "7", "8", "9" };
+   char *src[] = { el[0], el[1], el[2], el[3], el[4] };
+   char *nulls[] = { el[5], NULL };
+
+   if (!dsa) {
+      LOG_MSG ("Failed to create new array object\n");
+      goto errorexit;
+   }
+
+   if (!(ds_array_append_n (dsa, (void *const *)src, 5))
+         || !(check_array (dsa, "append_n", src, 5)))
+      goto errorexit;
+
+   // Splicing in the middle, at the start and at the end
+   char *spliced[] = { el[0], el[1], el[0], el[1], el[2], el[3], el[4], el[2],
+                       el[3], el[4] };
+   if (!(ds_array_splice (dsa, 2, (void *const *)src, 5))
+         || !(check_array (dsa, "splice", spliced, 10)))
+      goto errorexit;
+
+   char *removed[] = { el[0], el[1], el[3], el[4] };
+   if (ds_array_rm_range (dsa, 2, 6) != 6 || !(check_array (dsa, "rm_range", removed, 4))
+         || ds_array_rm_range (dsa, 3, 100) != 1 || ds_array_rm_range (dsa, 3, 1) != 0
+         || !(check_array (dsa, "rm_range at end", removed, 3)))
+      goto errorexit;
+
+   char *ends[] = { el[5], el[6], el[0], el[1], el[3], el[7] };
+   if (!(ds_array_splice (dsa, 0, (void *const *)&ends[0], 2))
+         || !(ds_array_splice (dsa, 5, (void *const *)&ends[5], 1))
+         || !(check_array (dsa, "splice at ends", ends, 6)))
+      goto errorexit;
+
+   // NULL elements and indexes past the end are rejected without
+   // changing the array
+   if (ds_array_append_n (dsa, (void *const *)nulls, 2)
+         || ds_array_splice (dsa, 7, (void *const *)src, 1)
+         || !(check_array (dsa, "rejected", ends, 6)))
+      goto errorexit;
+
+   // Views, and splicing an array into itself
+   ds_array_view_t view = ds_array_view (dsa, 2, 100);
+   if (view.nitems != 4 || view.items[0] != el[0]
+         || ds_array_view (dsa, 6, 7).nitems || ds_array_view (dsa, 3, 3).items)
+      goto errorexit;
+
+   char *doubled[] = { el[5], el[6], el[0], el[1], el[3], el[7], el[0], el[1],
+                       el[3], el[7] };
+   for (size_t i=0; i<100; i++) {
+      if (!(ds_array_append_n (dsa, view.items, 0)))
+         goto errorexit;
+   }
+   if (!(ds_array_append_n (dsa, view.items, view.nitems))
+         || !(check_array (dsa, "append self", doubled, 10)))
+      goto errorexit;
+
+   char *self[] = { el[5], el[5], el[6], el[0], el[6], el[0], el[1], el[3], el[7],
+                    el[0], el[1], el[3], el[7] };
+   view = ds_array_view (dsa, 0, 3);
+   if (!(ds_array_splice (dsa, 1, view.items, view.nitems))
+         || !(check_array (dsa, "splice self", self, 13)))
+      goto errorexit;
+
+   // Copies of ranges and appending whole arrays
+   if (!(copy = ds_array_copy (dsa, 3, 6)) || !(check_array (copy, "copy", &self[3], 3))
+         || !(ds_array_append (copy, dsa)) || ds_array_length (copy) != 16
+         || ds_array_get (copy, 3) != self[0])
+      goto errorexit;
+   ds_array_del (copy);
+   if (!(copy = ds_array_copy (dsa, 20, 30)) || ds_array_length (copy))
+      goto errorexit;
+
+   // Single removals shorten the array
+   if (ds_array_rm (dsa, 0) != el[5] || ds_array_rm (dsa, 11) != el[7]
+         || ds_array_rm (dsa, 11) || !(check_array (dsa, "rm", &self[1], 11)))
+      goto errorexit;
+
+   error = false;
+
+errorexit:
+
+   ds_array_del (dsa);
+   ds_array_del (copy);
+
+   return !error;
+}
+
+#define SORT_NITEMS      (100000)
+
+static size_t sort_values[SORT_NITEMS];
+
+static int cmp_values (const void *a, const void *b)
+{
+   size_t va = *(const size_t *)a, vb = *(const size_t *)b;
+   return va < vb ? -1 : va > vb;
+}
+
+// Fills the array with pointers to the first n values, which are made in
+// the given pattern.
+static bool make_values (ds_array_t *dsa, size_t n, int pattern)
+{
+   uint64_t state = 0x2545f4914f6cdd1dull + (uint64_t)n;
+
+   ds_array_rm_range (dsa, 0, ds_array_length (dsa));
+
+   for (size_t i=0; i<n; i++) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      switch (pattern) {
+         case 0:  sort_values[i] = (size_t)state;                 break;
+         case 1:  sort_values[i] = i;                             break;
+         case 2:  sort_values[i] = n - i;                         break;
+         case 3:  sort_values[i] = 42;                            break;
+         case 4:  sort_values[i] = (size_t)(state % 10);          break;
+         default: sort_values[i] = i < n / 2 ? i : n - i;         break;
+      }
+      if (!(ds_array_ins_tail (dsa, &sort_values[i])))
+         return false;
+   }
+
+   return true;
+}
+
+// Checks that the array is sorted and holds each of the n values once
+static bool check_sorted (const ds_array_t *dsa, size_t n, const char *msg)
+{
+   static bool seen[SORT_NITEMS];
+
+   memset (seen, 0, sizeof seen);
+
+   if (ds_array_length (dsa) != n || ds_array_get (dsa, n)) {
+      LOG_MSG ("[%s] Length changed to %zu\n", msg, ds_array_length (dsa));
+      return false;
+   }
+
+   for (size_t i=0; i<n; i++) {
+      const size_t *el = ds_array_get (dsa, i);
+      size_t idx = (size_t)(el - sort_values);
+      if (idx >= n || seen[idx]
+            || (i && cmp_values (ds_array_get (dsa, i - 1), el) > 0)) {
+         LOG_MSG ("[%s] Not sorted at %zu of %zu\n", msg, i, n);
+         return false;
+      }
+      seen[idx] = true;
+   }
+
+   return true;
+}
+
+static bool sort_test (void)
+{
+   bool error = true;
+   ds_array_t *dsa = ds_array_new ();
+   static const size_t sizes[] = { 0, 1, 2, 15, 17, 1000, SORT_NITEMS };
+   static const size_t nthreads[] = { 1, 3, 4, 8 };
+   char msg[64];
+
+   if (!dsa) {
+      LOG_MSG ("Failed to create new array object\n");
+      goto errorexit;
+   }
+
+   for (int pattern=0; pattern<6; pattern++) {
+      for (size_t i=0; i<sizeof sizes / sizeof sizes[0]; i++) {
+         snprintf (msg, sizeof msg, "sort, pattern %i", pattern);
+         if (!(make_values (dsa, sizes[i], pattern)))
+            goto errorexit;
+         ds_array_sort (dsa, cmp_values);
+         if (!(check_sorted (dsa, sizes[i], msg)))
+            goto errorexit;
+      }
+
+      for (size_t i=0; i<sizeof nthreads / sizeof nthreads[0]; i++) {
+         snprintf (msg, sizeof msg, "parallel sort, pattern %i, %zu threads",
+                   pattern, nthreads[i]);
+         if (!(make_values (dsa, SORT_NITEMS, pattern))
+               || !(ds_array_sort_parallel (dsa, cmp_values, nthreads[i]))
+               || !(check_sorted (dsa, SORT_NITEMS, msg)))
+            goto errorexit;
+      }
+   }
+
+   // Searching the multiples of 3
+   for (size_t i=0; i<1000; i++) {
+      sort_values[i] = 3 * i;
+   }
+   ds_array_rm_range (dsa, 0, ds_array_length (dsa));
+   for (size_t i=0; i<1000; i++) {
+      ds_array_ins_tail (dsa, &sort_values[i]);
+   }
+   for (size_t key=0; key<3010; key++) {
+      size_t *found = ds_array_bsearch (dsa, &key, cmp_values);
+      size_t idx = ds_array_lower_bound (dsa, &key, cmp_values);
+      size_t expected = key < 3000 ? (key + 2) / 3 : 1000;
+      if (idx != expected || (key % 3 == 0 && key < 3000) != (found != NULL)
+            || (found && *found != key)) {
+         LOG_MSG ("Search for %zu returned %zu\n", key, idx);
+         goto errorexit;
+      }
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_array_del (dsa);
+
+   return !error;
+}
+
 int main (void)
 {
    int ret = EXIT_FAILURE;
@@ -91,9 +411,8 @@ int main (void)
    ds_array_iterate (dsa, print_string, stdout);
    LOG_MSG ("===================================\n");
 
-   dsa_len = ds_array_length (dsa);
-
-   for (size_t i=0; i<dsa_len; i+=3) {
+   // Each removal shortens the array
+   for (size_t i=0; i<ds_array_length (dsa); i+=3) {
       if (!(ds_array_rm (dsa, i))) {
          LOG_MSG ("Failed to remove element [%zu]:[%s]\n",
                   i, "TODO");
@@ -111,6 +430,21 @@ int main (void)
       LOG_MSG ("[%s]\n", tmp);
    }
 
+   if (!(sort_test ())) {
+      LOG_MSG ("Failed sort test\n");
+      goto errorexit;
+   }
+
+   if (!(bulk_test ())) {
+      LOG_MSG ("Failed bulk operations test\n");
+      goto errorexit;
+   }
+
+   if (!(capacity_test ())) {
+      LOG_MSG ("Failed capacity test\n");
+      goto errorexit;
+   }
+
    ret = EXIT_SUCCESS;
 
 errorexit:
@@ -0,0 +1,229 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ds_bloom.h"
+#include "ds_hmap.h"
+
+/* ******************************************************************
+ * Each block is eight 32-bit words and an item sets one bit in each
+ * word. The bit in word i is chosen by the top five bits of the low half
+ * of the hash multiplied by salt i; these are the salts used by the
+ * split block Bloom filters of Parquet and Impala.
+ */
+#define BLOCK_WORDS        (8)
+#define BLOCK_BYTES        (BLOCK_WORDS * sizeof (uint32_t))
+#define CACHE_LINE         (64)
+#define DEFAULT_FP_RATE    (0.01)
+
+// Beyond this many items per block the false positive rate is over 0.99
+#define MAX_LOAD           (256.0)
+
+// The seed used to hash keys given to ds_bloom_add() and ds_bloom_check()
+#define BLOOM_SEED         (0x51ed270b27364f71ull)
+
+static const uint32_t salts[BLOCK_WORDS] = {
+   0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+   0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u,
+};
+
+struct ds_bloom_t {
+   uint32_t  (*blocks)[BLOCK_WORDS];
+   size_t      nblocks;
+   size_t      nitems;
+   size_t      capacity;
+   double      fp_rate;
+
+   // The allocation that blocks is aligned within
+   void       *mem;
+};
+
+// The expected false positive rate when items are spread over the blocks
+// at an average of load items per block. The number of items in a block
+// follows a Poisson distribution, and a block holding n items reports a
+// false positive when all eight of the bits chosen for the item are set,
+// each of which is set with a probability of 1 - (31/32)^n.
+static double bloom_fp (double load)
+{
+   // Every bit is as good as set; this also keeps exp() from underflowing
+   if (load > MAX_LOAD)
+      return 1.0;
+
+   double p = exp (-load);
+   double ret = 0.0;
+   size_t nmax = (size_t)(load + 12.0 * sqrt (load)) + 32;
+
+   for (size_t n=0; n<nmax; n++) {
+      ret += p * pow (1.0 - pow (31.0 / 32.0, (double)n), BLOCK_WORDS);
+      p = p * load / (double)(n + 1);
+   }
+
+   return ret;
+}
+
+// The highest load per block that gives a false positive rate of at
+// most fp_rate.
+static double bloom_load (double fp_rate)
+{
+   double lo = 0.0, hi = MAX_LOAD;
+
+   for (size_t i=0; i<64; i++) {
+      double mid = (lo + hi) / 2.0;
+      if (bloom_fp (mid) <= fp_rate) {
+         lo = mid;
+      } else {
+         hi = mid;
+      }
+   }
+
+   return lo;
+}
+
+static uint32_t *bloom_block (const ds_bloom_t *bf, uint64_t hash)
+{
+   size_t idx = (size_t)(((hash >> 32) * (uint64_t)bf->nblocks) >> 32);
+   return bf->blocks[idx];
+}
+
+static void bloom_mask (uint64_t hash, uint32_t *mask)
+{
+   uint32_t h = (uint32_t)hash;
+
+   for (size_t i=0; i<BLOCK_WORDS; i++) {
+      mask[i] = (uint32_t)1 << ((h * salts[i]) >> 27);
+   }
+}
+
+ds_bloom_t *ds_bloom_new (size_t capacity, double fp_rate)
+{
+   bool error = true;
+   ds_bloom_t *ret = NULL;
+
+   if (fp_rate == 0.0)
+      fp_rate = DEFAULT_FP_RATE;
+
+   if (!(fp_rate > 0.0 && fp_rate < 1.0))
+      return NULL;
+
+   if (!capacity)
+      capacity = 1;
+
+   double load = bloom_load (fp_rate);
+   double nblocks = ceil ((double)capacity / load);
+
+   // The block index is computed from 32 bits of the hash
+   if (!(load > 0.0) || nblocks > (double)UINT32_MAX)
+      return NULL;
+
+   if (!(ret = calloc (1, sizeof *ret)))
+      goto errorexit;
+
+   ret->nblocks = nblocks < 1.0 ? 1 : (size_t)nblocks;
+   ret->capacity = capacity;
+   ret->fp_rate = fp_rate;
+
+   if (!(ret->mem = malloc (ret->nblocks * BLOCK_BYTES + CACHE_LINE)))
+      goto errorexit;
+
+   // The blocks start on a cache line and are half a cache line each, so
+   // no block straddles two lines.
+   uintptr_t addr = (uintptr_t)ret->mem;
+   addr = (addr + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1);
+   ret->blocks = (uint32_t (*)[BLOCK_WORDS])addr;
+
+   ds_bloom_clear (ret);
+
+   error = false;
+
+errorexit:
+
+   if (error) {
+      ds_bloom_del (ret);
+      ret = NULL;
+   }
+
+   return ret;
+}
+
+void ds_bloom_del (ds_bloom_t *bf)
+{
+   if (!bf)
+      return;
+
+   free (bf->mem);
+   free (bf);
+}
+
+void ds_bloom_clear (ds_bloom_t *bf)
+{
+   if (!bf)
+      return;
+
+   memset (bf->blocks, 0, bf->nblocks * BLOCK_BYTES);
+   bf->nitems = 0;
+}
+
+void ds_bloom_add_hash (ds_bloom_t *bf, uint64_t hash)
+{
+   uint32_t mask[BLOCK_WORDS];
+
+   if (!bf)
+      return;
+
+   uint32_t *block = bloom_block (bf, hash);
+   bloom_mask (hash, mask);
+
+   for (size_t i=0; i<BLOCK_WORDS; i++) {
+      block[i] |= mask[i];
+   }
+   bf->nitems++;
+}
+
+bool ds_bloom_check_hash (const ds_bloom_t *bf, uint64_t hash)
+{
+   uint32_t mask[BLOCK_WORDS];
+   uint32_t missing = 0;
+
+   if (!bf)
+      return false;
+
+   const uint32_t *block = bloom_block (bf, hash);
+   bloom_mask (hash, mask);
+
+   // All the words are tested without branching
+   for (size_t i=0; i<BLOCK_WORDS; i++) {
+      missing |= mask[i] & ~block[i];
+   }
+
+   return missing == 0;
+}
+
+void ds_bloom_add (ds_bloom_t *bf, const void *key, size_t keylen)
+{
+   if (!bf || !key)
+      return;
+
+   ds_bloom_add_hash (bf, ds_hmap_hashfn (key, keylen, BLOOM_SEED));
+}
+
+bool ds_bloom_check (const ds_bloom_t *bf, const void *key, size_t keylen)
+{
+   if (!bf || !key)
+      return false;
+
+   return ds_bloom_check_hash (bf, ds_hmap_hashfn (key, keylen, BLOOM_SEED));
+}
+
+void ds_bloom_stats (const ds_bloom_t *bf, ds_bloom_stats_t *stats)
+{
+   if (!bf || !stats)
+      return;
+
+   stats->nitems = bf->nitems;
+   stats->capacity = bf->capacity;
+   stats->nblocks = bf->nblocks;
+   stats->nbytes = sizeof *bf + bf->nblocks * BLOCK_BYTES + CACHE_LINE;
+   stats->fp_rate = bf->fp_rate;
+   stats->est_fp_rate = bloom_fp ((double)bf->nitems / (double)bf->nblocks);
+}
@@ -0,0 +1,125 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ds_bloom.h"
+
+static bool rate_test (double fp_rate)
+{
+   bool error = true;
+   static const size_t nitems = 100000;
+   static const size_t nchecks = 1000000;
+   ds_bloom_t *bf = NULL;
+   ds_bloom_stats_t stats;
+   size_t nfp = 0;
+
+   if (!(bf = ds_bloom_new (nitems, fp_rate))) {
+      fprintf (stderr, "Failed to create filter for rate %g\n", fp_rate);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nitems; i++) {
+      ds_bloom_add (bf, &i, sizeof i);
+   }
+
+   // No false negatives
+   for (size_t i=0; i<nitems; i++) {
+      if (!(ds_bloom_check (bf, &i, sizeof i))) {
+         fprintf (stderr, "Item %zu was not found\n", i);
+         goto errorexit;
+      }
+   }
+
+   for (size_t i=nitems; i<nitems + nchecks; i++) {
+      nfp += ds_bloom_check (bf, &i, sizeof i);
+   }
+
+   ds_bloom_stats (bf, &stats);
+
+   double measured = (double)nfp / (double)nchecks;
+   printf ("Rate %g: %zu blocks, %zu bytes, %.1f bits/item, expected %g, measured %g\n",
+           fp_rate, stats.nblocks, stats.nbytes,
+           (double)stats.nbytes * 8.0 / (double)nitems, stats.est_fp_rate, measured);
+
+   // Allow for the randomness of the measurement
+   if (stats.nitems != nitems || stats.capacity != nitems
+         || stats.est_fp_rate > fp_rate || measured > fp_rate * 1.3) {
+      fprintf (stderr, "False positive rate %g is too high\n", measured);
+      goto errorexit;
+   }
+
+   ds_bloom_clear (bf);
+   ds_bloom_stats (bf, &stats);
+   nfp = 0;
+   for (size_t i=0; i<nitems; i++) {
+      nfp += ds_bloom_check (bf, &i, sizeof i);
+   }
+   if (nfp || stats.nitems || stats.est_fp_rate != 0.0) {
+      fprintf (stderr, "Failed to clear the filter\n");
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_bloom_del (bf);
+
+   return !error;
+}
+
+static bool hash_test (void)
+{
+   bool error = true;
+   ds_bloom_t *bf = NULL;
+
+   if (!(bf = ds_bloom_new (0, 0.0))) {
+      fprintf (stderr, "Failed to create filter with the defaults\n");
+      goto errorexit;
+   }
+
+   ds_bloom_add_hash (bf, 0x0123456789abcdefull);
+   if (!(ds_bloom_check_hash (bf, 0x0123456789abcdefull))
+         || ds_bloom_check_hash (bf, 0xfedcba9876543210ull)) {
+      fprintf (stderr, "Wrong result for hashes\n");
+      goto errorexit;
+   }
+
+   if (ds_bloom_new (10, 1.0) || ds_bloom_new (10, -0.5)) {
+      fprintf (stderr, "Created a filter with an invalid rate\n");
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_bloom_del (bf);
+
+   return !error;
+}
+
+int main (void)
+{
+   int ret = EXIT_FAILURE;
+
+   printf ("Testing bloom filter, %s\n", ds_version);
+
+   if (!(rate_test (0.1)) || !(rate_test (0.01)) || !(rate_test (0.001))) {
+      fprintf (stderr, "Failed false positive rate test\n");
+      goto errorexit;
+   }
+
+   if (!(hash_test ())) {
+      fprintf (stderr, "Failed hash test\n");
+      goto errorexit;
+   }
+
+   ret = EXIT_SUCCESS;
+
+errorexit:
+
+   return ret;
+}
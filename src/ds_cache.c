@@ -0,0 +1,274 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds_cache.h"
+#include "ds_hmap.h"
+
+/* ******************************************************************
+ * The hashmap maps each key to its node. Each node points at the copy of
+ * its key stored by the hashmap (needed to remove the entry from the
+ * hashmap when it is evicted); when the hashmap moves its entries every
+ * node is pointed at the new copy (see cache_rekey()). The nodes form a
+ * circular list that the CLOCK hand moves around; new nodes are linked
+ * in just behind the hand, so that they are the last to be looked at by
+ * the hand.
+ */
+typedef struct cnode_t cnode_t;
+struct cnode_t {
+   cnode_t    *prev;
+   cnode_t    *next;
+   const void *key;
+   size_t      keylen;
+   void       *data;
+   size_t      datalen;
+   bool        ref;
+};
+
+struct ds_cache_t {
+   ds_cache_config_t    config;
+   ds_hmap_t           *hm;
+   uint64_t             generation;
+
+   cnode_t             *hand;
+   size_t               nentries;
+
+   size_t               nbytes;
+   ds_cache_stats_t     stats;
+};
+
+#define CHARGE(n)       ((n)->keylen + (n)->datalen)
+
+// Points every node at the stored copy of its key again if the hashmap
+// has moved its entries since the last time.
+static void cache_rekey (ds_cache_t *cache)
+{
+   ds_hmap_iter_t it;
+
+   if (ds_hmap_generation (cache->hm) == cache->generation)
+      return;
+
+   ds_hmap_iter_init (cache->hm, &it);
+   while (ds_hmap_iter_next (&it)) {
+      ((cnode_t *)it.data)->key = it.key;
+   }
+   cache->generation = ds_hmap_generation (cache->hm);
+}
+
+// Removes the node from the list and frees it, first calling the evictfn
+// if notify is set. The key must still be in the hashmap.
+static void cache_unlink (ds_cache_t *cache, cnode_t *n, bool notify)
+{
+   if (notify && cache->config.evictfn)
+      cache->config.evictfn (n->key, n->keylen, n->data, n->datalen,
+                             cache->config.param);
+
+   if (n->next == n) {
+      cache->hand = NULL;
+   } else {
+      if (cache->hand == n)
+         cache->hand = n->next;
+      n->prev->next = n->next;
+      n->next->prev = n->prev;
+   }
+   cache->nentries--;
+   cache->nbytes -= CHARGE (n);
+
+   free (n);
+}
+
+// Removes the node from the hashmap as well as from the list
+static void cache_drop (ds_cache_t *cache, cnode_t *n)
+{
+   const void *key = n->key;
+   size_t keylen = n->keylen;
+
+   // The evictfn is called while the key is still stored
+   cache_unlink (cache, n, true);
+   ds_hmap_remove (cache->hm, key, keylen);
+   cache_rekey (cache);
+}
+
+// Advances the hand to the first node, other than keep, that has not
+// been used since the hand last passed it, and evicts that node.
+static void cache_evict (ds_cache_t *cache, cnode_t *keep)
+{
+   while (cache->hand->ref || cache->hand == keep) {
+      if (cache->hand != keep)
+         cache->hand->ref = false;
+      cache->hand = cache->hand->next;
+   }
+
+   cache_drop (cache, cache->hand);
+   cache->stats.evictions++;
+}
+
+static cnode_t *cache_find (ds_cache_t *cache, const void *key, size_t keylen)
+{
+   void *ret = NULL;
+
+   return ds_hmap_get (cache->hm, key, keylen, &ret, NULL) ? ret : NULL;
+}
+
+ds_cache_t *ds_cache_new (const ds_cache_config_t *config)
+{
+   bool error = true;
+   ds_cache_t *ret = NULL;
+   ds_hmap_config_t hconfig = { .engine = ds_hmap_ENGINE_FLAT };
+
+   if (!config || (!config->max_entries && !config->max_bytes))
+      return NULL;
+
+   if (!(ret = calloc (1, sizeof *ret)))
+      goto errorexit;
+
+   ret->config = *config;
+
+   if (!(ret->hm = ds_hmap_new_ex (&hconfig)))
+      goto errorexit;
+
+   error = false;
+
+errorexit:
+
+   if (error) {
+      ds_cache_del (ret);
+      ret = NULL;
+   }
+
+   return ret;
+}
+
+void ds_cache_del (ds_cache_t *cache)
+{
+   if (!cache)
+      return;
+
+   for (size_t i=0; i<cache->nentries; i++) {
+      cnode_t *n = cache->hand;
+      cache->hand = n->next;
+      if (cache->config.evictfn)
+         cache->config.evictfn (n->key, n->keylen, n->data, n->datalen,
+                                cache->config.param);
+      free (n);
+   }
+
+   ds_hmap_del (cache->hm);
+   free (cache);
+}
+
+bool ds_cache_put (ds_cache_t *cache, const void *key, size_t keylen,
+                                      void *data, size_t datalen)
+{
+   cnode_t *n = NULL, *old = NULL;
+
+   if (!cache || !key || !data)
+      return false;
+
+   size_t charge = keylen + datalen;
+   size_t max_entries = cache->config.max_entries;
+   size_t max_bytes = cache->config.max_bytes;
+
+   if (max_bytes && charge > max_bytes)
+      return false;
+
+   // Nothing is removed until the new node is in the hashmap, so that a
+   // put that fails leaves the cache as it was.
+   old = cache_find (cache, key, keylen);
+
+   if (!(n = malloc (sizeof *n)))
+      return false;
+
+   n->keylen = keylen;
+   n->data = data;
+   n->datalen = datalen;
+   n->ref = old != NULL;
+
+   if (!(n->key = ds_hmap_set (cache->hm, key, keylen, n, sizeof *n))) {
+      free (n);
+      return false;
+   }
+   cache_rekey (cache);
+
+   // The hashmap now maps the key to the new node, so a replaced node
+   // only has to leave the list.
+   if (old) {
+      old->key = n->key;
+      cache_unlink (cache, old, old->data != data);
+   }
+
+   if (!cache->hand) {
+      n->prev = n->next = n;
+      cache->hand = n;
+   } else {
+      n->next = cache->hand;
+      n->prev = cache->hand->prev;
+      n->prev->next = n;
+      cache->hand->prev = n;
+   }
+   cache->nentries++;
+   cache->nbytes += charge;
+   cache->stats.insertions++;
+
+   while (cache->nentries > 1
+            && ((max_entries && cache->nentries > max_entries)
+                || (max_bytes && cache->nbytes > max_bytes))) {
+      cache_evict (cache, n);
+   }
+
+   return true;
+}
+
+bool ds_cache_get (ds_cache_t *cache, const void *key, size_t keylen,
+                                      void **data, size_t *datalen)
+{
+   cnode_t *n;
+
+   if (!cache || !key)
+      return false;
+
+   if (!(n = cache_find (cache, key, keylen))) {
+      cache->stats.misses++;
+      return false;
+   }
+
+   cache->stats.hits++;
+   n->ref = true;
+
+   if (data)
+      *data = n->data;
+   if (datalen)
+      *datalen = n->datalen;
+
+   return true;
+}
+
+bool ds_cache_remove (ds_cache_t *cache, const void *key, size_t keylen)
+{
+   cnode_t *n;
+
+   if (!cache || !key || !(n = cache_find (cache, key, keylen)))
+      return false;
+
+   cache_drop (cache, n);
+   return true;
+}
+
+void ds_cache_stats (ds_cache_t *cache, ds_cache_stats_t *stats)
+{
+   if (!cache || !stats)
+      return;
+
+   *stats = cache->stats;
+   stats->nentries = cache->nentries;
+   stats->nbytes = cache->nbytes;
+}
+
+void ds_cache_reset_stats (ds_cache_t *cache)
+{
+   if (!cache)
+      return;
+
+   memset (&cache->stats, 0, sizeof cache->stats);
+}
+
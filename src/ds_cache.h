@@ -0,0 +1,102 @@
+#ifndef H_DS_CACHE
+#define H_DS_CACHE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A bounded cache built on ds_hmap_t. The cache holds at most
+ * max_entries entries and at most max_bytes bytes of keys and data, and
+ * evicts entries when a new entry would exceed either limit.
+ *
+ * Victims are chosen with the CLOCK policy: every entry has a reference
+ * bit that is set when the entry is found by ds_cache_get(), and a hand
+ * sweeps over the entries, clearing set bits and evicting the first entry
+ * whose bit is already clear. Entries that are used again survive the
+ * sweep; entries that are never used again are evicted after one pass.
+ * Getting, putting and evicting are all O(1) (amortised over the sweep).
+ *
+ * As with ds_hmap_t the key is copied and the data is not. Whenever an
+ * entry leaves the cache (evicted, replaced, removed or when the cache is
+ * deleted) the evictfn, if set, is called with the key and the data so
+ * that the caller can free the data.
+ */
+
+typedef struct ds_cache_t ds_cache_t;
+
+// Called with each entry that leaves the cache. The key is only valid
+// until the function returns.
+typedef void (ds_cache_evictfn_t) (const void *key, size_t keylen,
+                                   void *data, size_t datalen,
+                                   void *param);
+
+typedef struct ds_cache_config_t ds_cache_config_t;
+struct ds_cache_config_t {
+   // The maximum number of entries in the cache, or zero for no limit.
+   size_t               max_entries;
+
+   // The maximum number of bytes of keys and data in the cache (the sum
+   // of keylen and datalen of every entry), or zero for no limit.
+   size_t               max_bytes;
+
+   // Called for every entry that leaves the cache (NULL for none), with
+   // param as the last argument.
+   ds_cache_evictfn_t  *evictfn;
+   void                *param;
+};
+
+// Counters kept by the cache since it was created or since the last call
+// to ds_cache_reset_stats(). The hit ratio is hits / (hits + misses).
+typedef struct ds_cache_stats_t ds_cache_stats_t;
+struct ds_cache_stats_t {
+   uint64_t    hits;
+   uint64_t    misses;
+   uint64_t    insertions;
+   uint64_t    evictions;
+
+   // The current contents of the cache
+   size_t      nentries;
+   size_t      nbytes;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+   // Create a new cache. At least one of max_entries and max_bytes must
+   // be set. Returns NULL on error.
+   ds_cache_t *ds_cache_new (const ds_cache_config_t *config);
+
+   // Deletes the cache, calling the evictfn for every entry still in it.
+   void ds_cache_del (ds_cache_t *cache);
+
+   // Adds the key to the cache, evicting as many entries as needed to
+   // stay within the limits. If the key is already in the cache its data
+   // is replaced (and the evictfn is called for the old data if it is a
+   // different pointer). Returns false on error, including when the
+   // entry alone is larger than max_bytes; the data is then not in the
+   // cache and remains the responsibility of the caller.
+   bool ds_cache_put (ds_cache_t *cache, const void *key, size_t keylen,
+                                         void *data, size_t datalen);
+
+   // Finds the key and stores the data and the length of the data in
+   // 'data' and 'datalen' (either may be NULL), marking the entry as
+   // recently used. Returns true if the key was found.
+   bool ds_cache_get (ds_cache_t *cache, const void *key, size_t keylen,
+                                         void **data, size_t *datalen);
+
+   // Removes the key, calling the evictfn for it. Returns true if the key
+   // was found. Removals are not counted as evictions.
+   bool ds_cache_remove (ds_cache_t *cache, const void *key, size_t keylen);
+
+   // Fills in the counters and the current size of the cache.
+   void ds_cache_stats (ds_cache_t *cache, ds_cache_stats_t *stats);
+
+   // Sets the hit, miss, insertion and eviction counters to zero.
+   void ds_cache_reset_stats (ds_cache_t *cache);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,243 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ds_str.h"
+#include "ds_cache.h"
+
+static size_t g_nevicted = 0;
+static size_t g_nbadkeys = 0;
+
+// The data for each key is "value <key>"
+static void free_data (const void *key, size_t keylen,
+                       void *data, size_t datalen, void *param)
+{
+   (void)datalen;
+   (void)param;
+   if (keylen != strlen (data) - 5 || strcmp ((char *)data + 6, key) != 0)
+      g_nbadkeys++;
+   free (data);
+   g_nevicted++;
+}
+
+static bool put_num (ds_cache_t *cache, size_t n)
+{
+   char key[32];
+   char *data = NULL;
+
+   snprintf (key, sizeof key, "%zu", n);
+   if (!(ds_str_printf (&data, "value %zu", n)))
+      return false;
+
+   if (!(ds_cache_put (cache, key, strlen (key) + 1, data, strlen (data) + 1))) {
+      free (data);
+      return false;
+   }
+   return true;
+}
+
+static bool get_num (ds_cache_t *cache, size_t n)
+{
+   char key[32];
+   char expected[32];
+   char *data = NULL;
+
+   snprintf (key, sizeof key, "%zu", n);
+   snprintf (expected, sizeof expected, "value %zu", n);
+
+   return ds_cache_get (cache, key, strlen (key) + 1, (void **)&data, NULL)
+       && strcmp (data, expected) == 0;
+}
+
+static bool entries_test (void)
+{
+   bool error = true;
+   ds_cache_config_t config = { .max_entries = 100, .evictfn = free_data };
+   ds_cache_t *cache = NULL;
+   ds_cache_stats_t stats;
+
+   g_nevicted = 0;
+   g_nbadkeys = 0;
+
+   if (!(cache = ds_cache_new (&config))) {
+      fprintf (stderr, "Failed to create cache\n");
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<1000; i++) {
+      if (!(put_num (cache, i))) {
+         fprintf (stderr, "Failed to put %zu\n", i);
+         goto errorexit;
+      }
+   }
+
+   // Only the last 100 entries were never behind the hand
+   for (size_t i=0; i<1000; i++) {
+      if (get_num (cache, i) != (i >= 900)) {
+         fprintf (stderr, "Wrong result for %zu\n", i);
+         goto errorexit;
+      }
+   }
+
+   ds_cache_stats (cache, &stats);
+   printf ("Entry limit: %zu entries, %zu bytes, %zu hits, %zu misses, %zu evictions\n",
+           stats.nentries, stats.nbytes, (size_t)stats.hits, (size_t)stats.misses,
+           (size_t)stats.evictions);
+
+   if (stats.nentries != 100 || stats.evictions != 900 || g_nevicted != 900
+         || stats.hits != 100 || stats.misses != 900 || stats.insertions != 1000) {
+      fprintf (stderr, "Wrong counters\n");
+      goto errorexit;
+   }
+
+   // Replacing and removing entries frees the old data
+   if (!(put_num (cache, 950)) || g_nevicted != 901
+         || !(ds_cache_remove (cache, "951", 4)) || g_nevicted != 902
+         || ds_cache_remove (cache, "951", 4)
+         || ds_cache_get (cache, "951", 4, NULL, NULL)) {
+      fprintf (stderr, "Failed to replace and remove entries\n");
+      goto errorexit;
+   }
+
+   ds_cache_reset_stats (cache);
+   ds_cache_stats (cache, &stats);
+   if (stats.hits || stats.misses || stats.evictions || stats.nentries != 99) {
+      fprintf (stderr, "Failed to reset counters\n");
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_cache_del (cache);
+
+   if (!error && (g_nevicted != 1001 || g_nbadkeys)) {
+      fprintf (stderr, "Freed %zu of 1001 values, %zu with the wrong key\n",
+               g_nevicted, g_nbadkeys);
+      error = true;
+   }
+
+   return !error;
+}
+
+static bool clock_test (void)
+{
+   bool error = true;
+   ds_cache_config_t config = { .max_entries = 10, .evictfn = free_data };
+   ds_cache_t *cache = NULL;
+
+   if (!(cache = ds_cache_new (&config))) {
+      fprintf (stderr, "Failed to create cache\n");
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<10; i++) {
+      if (!(put_num (cache, i)))
+         goto errorexit;
+   }
+
+   for (size_t i=0; i<10; i += 2) {
+      get_num (cache, i);
+   }
+
+   // The five entries that were used survive the next five insertions
+   for (size_t i=10; i<15; i++) {
+      if (!(put_num (cache, i)))
+         goto errorexit;
+   }
+
+   for (size_t i=0; i<15; i++) {
+      bool expected = i >= 10 || i % 2 == 0;
+      if (get_num (cache, i) != expected) {
+         fprintf (stderr, "CLOCK: wrong result for %zu\n", i);
+         goto errorexit;
+      }
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_cache_del (cache);
+
+   return !error;
+}
+
+static bool bytes_test (void)
+{
+   bool error = true;
+   ds_cache_config_t config = { .max_bytes = 1000 };
+   ds_cache_t *cache = NULL;
+   ds_cache_stats_t stats;
+   static char big[2000];
+   static char small[90];
+
+   if (!(cache = ds_cache_new (&config))) {
+      fprintf (stderr, "Failed to create cache\n");
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<100; i++) {
+      char key[10];
+      snprintf (key, sizeof key, "%09zu", i);
+      if (!(ds_cache_put (cache, key, sizeof key, small, sizeof small))) {
+         fprintf (stderr, "Failed to put %zu\n", i);
+         goto errorexit;
+      }
+      ds_cache_stats (cache, &stats);
+      if (stats.nbytes > config.max_bytes) {
+         fprintf (stderr, "Cache holds %zu bytes\n", stats.nbytes);
+         goto errorexit;
+      }
+   }
+
+   if (stats.nentries != 10 || stats.nbytes != 1000
+         || ds_cache_put (cache, "big", 4, big, sizeof big)) {
+      fprintf (stderr, "Byte limit not applied\n");
+      goto errorexit;
+   }
+
+   if (ds_cache_new (&(ds_cache_config_t) { .max_entries = 0 })) {
+      fprintf (stderr, "Created a cache with no limits\n");
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_cache_del (cache);
+
+   return !error;
+}
+
+int main (void)
+{
+   int ret = EXIT_FAILURE;
+
+   printf ("Testing cache, %s\n", ds_version);
+
+   if (!(entries_test ())) {
+      fprintf (stderr, "Failed entry limit test\n");
+      goto errorexit;
+   }
+
+   if (!(clock_test ())) {
+      fprintf (stderr, "Failed CLOCK test\n");
+      goto errorexit;
+   }
+
+   if (!(bytes_test ())) {
+      fprintf (stderr, "Failed byte limit test\n");
+      goto errorexit;
+   }
+
+   ret = EXIT_SUCCESS;
+
+errorexit:
+
+   return ret;
+}
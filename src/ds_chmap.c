@@ -0,0 +1,547 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "ds_hmap.h"
+
+#define DS_CHMAP_IMPLEMENTATION
+#include "ds_chmap.h"
+#undef DS_CHMAP_IMPLEMENTATION
+
+/* ******************************************************************
+ * Everything that is freed only once no reader can be using it (nodes
+ * and tables) starts with a retired_t, which links it into the list of
+ * retired objects of the hashmap and records the epoch in which it was
+ * retired. Objects that are retired together (a table and its nodes)
+ * are linked into the batch of the first one and take a single place in
+ * the list.
+ */
+typedef struct retired_t retired_t;
+struct retired_t {
+   retired_t  *next;
+   retired_t  *batch;
+   uint64_t    epoch;
+};
+
+// A single key/value pair. Nodes are never modified once they are
+// reachable by readers, except for the next pointer; replacing the data
+// of a key replaces the whole node.
+typedef struct cnode_t cnode_t;
+struct cnode_t {
+   retired_t   retired;
+   cnode_t    *next;
+   uint64_t    hash;
+   void       *data;
+   size_t      datalen;
+   size_t      keylen;
+   uint8_t     key[];
+};
+
+typedef struct ctable_t ctable_t;
+struct ctable_t {
+   retired_t   retired;
+   size_t      nbuckets;
+   cnode_t    *buckets[];
+};
+
+#define SHARD_MIN_BUCKETS     (16)
+
+// Each shard is padded so that writers to neighbouring shards do not
+// contend for the same cache line. The objects unlinked from a shard
+// are kept on its own retired list, under the shard lock, until they
+// can be freed.
+typedef struct shard_t shard_t;
+struct shard_t {
+   pthread_mutex_t   lock;
+   ctable_t         *table;
+   size_t            nentries;
+   retired_t        *retired;
+   size_t            nretired;
+   size_t            reclaim_at;
+   uint8_t           pad[64];
+};
+
+/* ******************************************************************
+ * Epoch-based reclamation. A reader publishes the global epoch it saw
+ * (with the ACTIVE bit set) in its thread record for the duration of a
+ * lookup. The global epoch only advances when every active reader has
+ * seen the current epoch, so an object retired in epoch E can no longer
+ * be reached by any reader once the global epoch is E + 2. Writers only
+ * share the global epoch and the list of thread records; the retired
+ * objects belong to the shards.
+ */
+#define ACTIVE             ((uint64_t)1)
+#define RECLAIM_THRESHOLD  (64)
+
+typedef struct threc_t threc_t;
+struct threc_t {
+   threc_t    *next;
+   uint64_t    state;
+   int         in_use;
+   uint8_t     pad[48];
+};
+
+struct ds_chmap_t {
+   size_t            nshards;
+   unsigned          shard_shift;
+   uint64_t          seed;
+   shard_t          *shards;
+
+   pthread_key_t     tkey;
+   threc_t          *threcs;
+   uint64_t          epoch;
+};
+
+static void threc_release (void *ptr)
+{
+   threc_t *rec = ptr;
+   __atomic_store_n (&rec->state, 0, __ATOMIC_RELEASE);
+   __atomic_store_n (&rec->in_use, 0, __ATOMIC_RELEASE);
+}
+
+// Returns the record of the calling thread, registering the thread with
+// the hashmap the first time. Records of threads that have exited are
+// reused.
+static threc_t *threc_get (ds_chmap_t *cm)
+{
+   threc_t *rec = pthread_getspecific (cm->tkey);
+   if (rec)
+      return rec;
+
+   for (rec = __atomic_load_n (&cm->threcs, __ATOMIC_ACQUIRE); rec; rec = rec->next) {
+      int expected = 0;
+      if (__atomic_compare_exchange_n (&rec->in_use, &expected, 1, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+         break;
+   }
+
+   if (!rec) {
+      if (!(rec = calloc (1, sizeof *rec)))
+         return NULL;
+      rec->in_use = 1;
+      rec->next = __atomic_load_n (&cm->threcs, __ATOMIC_RELAXED);
+      while (!__atomic_compare_exchange_n (&cm->threcs, &rec->next, rec, true,
+                                           __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+         ;
+   }
+
+   if (pthread_setspecific (cm->tkey, rec) != 0) {
+      threc_release (rec);
+      return NULL;
+   }
+
+   return rec;
+}
+
+static void epoch_enter (threc_t *rec, ds_chmap_t *cm)
+{
+   uint64_t epoch = __atomic_load_n (&cm->epoch, __ATOMIC_SEQ_CST);
+   __atomic_store_n (&rec->state, (epoch << 1) | ACTIVE, __ATOMIC_SEQ_CST);
+   // The state must be visible to writers before any node is read
+   __atomic_thread_fence (__ATOMIC_SEQ_CST);
+}
+
+static void epoch_exit (threc_t *rec)
+{
+   __atomic_store_n (&rec->state, 0, __ATOMIC_RELEASE);
+}
+
+// Advances the global epoch if every active reader has seen the current
+// epoch. Returns the (possibly new) global epoch.
+static uint64_t epoch_try_advance (ds_chmap_t *cm)
+{
+   // Objects are unlinked before this is called; the unlinking must be
+   // visible to readers before their state is read.
+   __atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+   uint64_t epoch = __atomic_load_n (&cm->epoch, __ATOMIC_SEQ_CST);
+
+   for (threc_t *rec = __atomic_load_n (&cm->threcs, __ATOMIC_ACQUIRE);
+         rec; rec = rec->next) {
+      uint64_t state = __atomic_load_n (&rec->state, __ATOMIC_SEQ_CST);
+      if ((state & ACTIVE) && (state >> 1) != epoch)
+         return epoch;
+   }
+
+   if (__atomic_compare_exchange_n (&cm->epoch, &epoch, epoch + 1, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+      epoch++;
+
+   return epoch;
+}
+
+// Frees a retired object and its batch
+static void retired_free (retired_t *r)
+{
+   while (r->batch) {
+      retired_t *next = r->batch->next;
+      free (r->batch);
+      r->batch = next;
+   }
+   free (r);
+}
+
+// Frees every object retired from the shard that no reader can still
+// reach. Must be called with the shard lock held.
+static void reclaim (ds_chmap_t *cm, shard_t *s)
+{
+   uint64_t epoch = epoch_try_advance (cm);
+   retired_t **prev = &s->retired;
+
+   while (*prev) {
+      retired_t *r = *prev;
+      if (r->epoch + 2 <= epoch) {
+         *prev = r->next;
+         s->nretired--;
+         retired_free (r);
+      } else {
+         prev = &r->next;
+      }
+   }
+
+   // While a reader holds the epoch back the list keeps growing; waiting
+   // for it to double keeps the cost of the scans linear.
+   s->reclaim_at = s->nretired * 2;
+   if (s->reclaim_at < RECLAIM_THRESHOLD)
+      s->reclaim_at = RECLAIM_THRESHOLD;
+}
+
+// Queues an object (and its batch) that has been unlinked from the shard
+// to be freed once no reader can still reach it. Must be called with the
+// shard lock held.
+static void retire (ds_chmap_t *cm, shard_t *s, retired_t *r)
+{
+   r->epoch = __atomic_load_n (&cm->epoch, __ATOMIC_SEQ_CST);
+   r->next = s->retired;
+   s->retired = r;
+   if (++s->nretired >= s->reclaim_at)
+      reclaim (cm, s);
+}
+
+/* ******************************************************************
+ * Tables. Readers load the table pointer of a shard once and then only
+ * follow pointers that were published with release stores, so a reader
+ * always sees fully initialised nodes.
+ */
+static ctable_t *ctable_new (size_t nbuckets)
+{
+   ctable_t *ret = calloc (1, sizeof *ret + nbuckets * sizeof ret->buckets[0]);
+   if (ret)
+      ret->nbuckets = nbuckets;
+   return ret;
+}
+
+static cnode_t *cnode_new (uint64_t hash, const void *key, size_t keylen,
+                           void *data, size_t datalen)
+{
+   cnode_t *ret = malloc (sizeof *ret + keylen);
+   if (!ret)
+      return NULL;
+
+   memset (ret, 0, sizeof *ret);
+   ret->hash = hash;
+   ret->data = data;
+   ret->datalen = datalen;
+   ret->keylen = keylen;
+   memcpy (ret->key, key, keylen);
+
+   return ret;
+}
+
+static bool cnode_match (const cnode_t *n, uint64_t hash,
+                         const void *key, size_t keylen)
+{
+   return n->hash == hash && n->keylen == keylen
+      && memcmp (n->key, key, keylen) == 0;
+}
+
+// The shard is chosen from the high bits of the hash and the bucket from
+// the low bits, so that the two are independent.
+static shard_t *find_shard (ds_chmap_t *cm, uint64_t hash)
+{
+   return &cm->shards[cm->nshards > 1 ? hash >> cm->shard_shift : 0];
+}
+
+#define BUCKET(t,hash)     (&(t)->buckets[(hash) & ((t)->nbuckets - 1)])
+
+// Replaces the table of the shard with one that has twice the number of
+// buckets. The nodes that readers may be walking cannot be relinked, so
+// every node is copied into the new table and the old table and nodes
+// are retired as a single batch. Must be called with the shard lock
+// held.
+static bool shard_grow (ds_chmap_t *cm, shard_t *s)
+{
+   ctable_t *old = s->table;
+   ctable_t *t = ctable_new (old->nbuckets * 2);
+   if (!t)
+      return false;
+
+   for (size_t i=0; i<old->nbuckets; i++) {
+      for (cnode_t *n = old->buckets[i]; n; n = n->next) {
+         cnode_t *copy = cnode_new (n->hash, n->key, n->keylen, n->data, n->datalen);
+         if (!copy)
+            goto errorexit;
+         cnode_t **b = BUCKET (t, n->hash);
+         copy->next = *b;
+         *b = copy;
+      }
+   }
+
+   __atomic_store_n (&s->table, t, __ATOMIC_RELEASE);
+
+   for (size_t i=0; i<old->nbuckets; i++) {
+      for (cnode_t *n = old->buckets[i]; n; n = n->next) {
+         n->retired.next = old->retired.batch;
+         old->retired.batch = &n->retired;
+      }
+   }
+   retire (cm, s, &old->retired);
+
+   return true;
+
+errorexit:
+
+   for (size_t i=0; i<t->nbuckets; i++) {
+      cnode_t *n = t->buckets[i];
+      while (n) {
+         cnode_t *next = n->next;
+         free (n);
+         n = next;
+      }
+   }
+   free (t);
+
+   return false;
+}
+
+/* ******************************************************************
+ * The public functions.
+ */
+ds_chmap_t *ds_chmap_new (size_t nshards)
+{
+   bool error = true;
+   ds_chmap_t *ret = NULL;
+   size_t ninit = 0;
+   bool have_key = false;
+
+   if (!nshards)
+      nshards = DS_CHMAP_DEFAULT_SHARDS;
+
+   if (!(ret = calloc (1, sizeof *ret)))
+      goto errorexit;
+
+   ret->nshards = 1;
+   ret->shard_shift = 64;
+   while (ret->nshards < nshards) {
+      ret->nshards *= 2;
+      ret->shard_shift--;
+   }
+
+   // The seed only needs to differ between processes and hashmaps
+   uint64_t entropy[3] = { (uint64_t)time (NULL), (uint64_t)clock (),
+                           (uint64_t)(uintptr_t)ret };
+   ret->seed = ds_hmap_hashfn (entropy, sizeof entropy, 1) | 1;
+
+   if (pthread_key_create (&ret->tkey, threc_release) != 0)
+      goto errorexit;
+   have_key = true;
+
+   if (!(ret->shards = calloc (ret->nshards, sizeof *ret->shards)))
+      goto errorexit;
+
+   for (ninit=0; ninit<ret->nshards; ninit++) {
+      shard_t *s = &ret->shards[ninit];
+      if (!(s->table = ctable_new (SHARD_MIN_BUCKETS)))
+         goto errorexit;
+      s->reclaim_at = RECLAIM_THRESHOLD;
+      if (pthread_mutex_init (&s->lock, NULL) != 0) {
+         free (s->table);
+         goto errorexit;
+      }
+   }
+
+   error = false;
+
+errorexit:
+
+   if (error && ret) {
+      for (size_t i=0; i<ninit; i++) {
+         pthread_mutex_destroy (&ret->shards[i].lock);
+         free (ret->shards[i].table);
+      }
+      free (ret->shards);
+      if (have_key)
+         pthread_key_delete (ret->tkey);
+      free (ret);
+      ret = NULL;
+   }
+
+   return ret;
+}
+
+void ds_chmap_del (ds_chmap_t *cm)
+{
+   if (!cm)
+      return;
+
+   for (size_t i=0; i<cm->nshards; i++) {
+      shard_t *s = &cm->shards[i];
+      while (s->retired) {
+         retired_t *next = s->retired->next;
+         retired_free (s->retired);
+         s->retired = next;
+      }
+
+      ctable_t *t = s->table;
+      for (size_t j=0; j<t->nbuckets; j++) {
+         cnode_t *n = t->buckets[j];
+         while (n) {
+            cnode_t *next = n->next;
+            free (n);
+            n = next;
+         }
+      }
+      free (t);
+      pthread_mutex_destroy (&s->lock);
+   }
+   free (cm->shards);
+
+   while (cm->threcs) {
+      threc_t *next = cm->threcs->next;
+      free (cm->threcs);
+      cm->threcs = next;
+   }
+
+   pthread_key_delete (cm->tkey);
+   free (cm);
+}
+
+bool ds_chmap_set (ds_chmap_t *cm, const void *key, size_t keylen,
+                                   void *data, size_t datalen)
+{
+   bool error = true;
+
+   if (!cm || !key || !data)
+      return false;
+
+   uint64_t hash = ds_hmap_hashfn (key, keylen, cm->seed);
+   shard_t *s = find_shard (cm, hash);
+   cnode_t *node = NULL;
+
+   if (!(node = cnode_new (hash, key, keylen, data, datalen)))
+      return false;
+
+   pthread_mutex_lock (&s->lock);
+
+   cnode_t **prev = BUCKET (s->table, hash);
+   while (*prev && !cnode_match (*prev, hash, key, keylen))
+      prev = &(*prev)->next;
+
+   if (*prev) {
+      // Replace the existing node; readers see either the old or the
+      // new node, never a partially updated one.
+      cnode_t *old = *prev;
+      node->next = old->next;
+      __atomic_store_n (prev, node, __ATOMIC_RELEASE);
+      retire (cm, s, &old->retired);
+      error = false;
+      goto errorexit;
+   }
+
+   if (s->nentries >= s->table->nbuckets) {
+      if (!(shard_grow (cm, s)))
+         goto errorexit;
+   }
+
+   cnode_t **head = BUCKET (s->table, hash);
+   node->next = *head;
+   __atomic_store_n (head, node, __ATOMIC_RELEASE);
+   __atomic_store_n (&s->nentries, s->nentries + 1, __ATOMIC_RELAXED);
+
+   error = false;
+
+errorexit:
+
+   pthread_mutex_unlock (&s->lock);
+
+   if (error)
+      free (node);
+
+   return !error;
+}
+
+bool ds_chmap_get (ds_chmap_t *cm, const void *key, size_t keylen,
+                                   void **data, size_t *datalen)
+{
+   bool ret = false;
+   threc_t *rec = NULL;
+
+   if (!cm || !key || !(rec = threc_get (cm)))
+      return false;
+
+   uint64_t hash = ds_hmap_hashfn (key, keylen, cm->seed);
+   shard_t *s = find_shard (cm, hash);
+
+   epoch_enter (rec, cm);
+
+   ctable_t *t = __atomic_load_n (&s->table, __ATOMIC_ACQUIRE);
+   cnode_t *n = __atomic_load_n (BUCKET (t, hash), __ATOMIC_ACQUIRE);
+
+   while (n && !cnode_match (n, hash, key, keylen))
+      n = __atomic_load_n (&n->next, __ATOMIC_ACQUIRE);
+
+   if (n) {
+      if (data)      *data = n->data;
+      if (datalen)   *datalen = n->datalen;
+      ret = true;
+   }
+
+   epoch_exit (rec);
+
+   return ret;
+}
+
+bool ds_chmap_remove (ds_chmap_t *cm, const void *key, size_t keylen)
+{
+   if (!cm || !key)
+      return false;
+
+   uint64_t hash = ds_hmap_hashfn (key, keylen, cm->seed);
+   shard_t *s = find_shard (cm, hash);
+   cnode_t *old = NULL;
+
+   pthread_mutex_lock (&s->lock);
+
+   cnode_t **prev = BUCKET (s->table, hash);
+   while (*prev && !cnode_match (*prev, hash, key, keylen))
+      prev = &(*prev)->next;
+
+   if ((old = *prev)) {
+      __atomic_store_n (prev, old->next, __ATOMIC_RELEASE);
+      __atomic_store_n (&s->nentries, s->nentries - 1, __ATOMIC_RELAXED);
+      retire (cm, s, &old->retired);
+   }
+
+   pthread_mutex_unlock (&s->lock);
+
+   return old != NULL;
+}
+
+size_t ds_chmap_num_entries (ds_chmap_t *cm)
+{
+   size_t ret = 0;
+
+   if (!cm)
+      return 0;
+
+   for (size_t i=0; i<cm->nshards; i++) {
+      ret += __atomic_load_n (&cm->shards[i].nentries, __ATOMIC_RELAXED);
+   }
+
+   return ret;
+}
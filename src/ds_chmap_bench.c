@@ -0,0 +1,184 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include "ds_hmap.h"
+#include "ds_chmap.h"
+
+/* Measures how ds_chmap_t scales from one thread up to the number of
+ * processors (or the number of threads given as the first argument),
+ * against a ds_hmap_t protected by a single mutex. Each thread performs
+ * a mix of 90% lookups and 10% updates on random keys.
+ */
+
+#define NKEYS        (100000)
+#define NOPS         (1000000)
+
+static char *keys[NKEYS];
+static size_t keylens[NKEYS];
+
+struct bench_t {
+   ds_chmap_t       *cm;
+   ds_hmap_t        *hm;
+   pthread_mutex_t  *lock;
+   uint64_t          seed;
+   size_t            nfound;
+};
+
+static double now (void)
+{
+   struct timespec tp;
+   clock_gettime (CLOCK_MONOTONIC, &tp);
+   return (double)tp.tv_sec + (double)tp.tv_nsec / 1000000000.0;
+}
+
+static uint64_t rng_next (uint64_t *state)
+{
+   uint64_t x = *state;
+   x ^= x << 13;
+   x ^= x >> 7;
+   x ^= x << 17;
+   return *state = x;
+}
+
+static void *run_chmap (void *param)
+{
+   struct bench_t *b = param;
+
+   for (size_t i=0; i<NOPS; i++) {
+      size_t k = (size_t)(rng_next (&b->seed) % NKEYS);
+      if (i % 10 == 0) {
+         ds_chmap_set (b->cm, keys[k], keylens[k], keys[k], keylens[k]);
+      } else {
+         b->nfound += ds_chmap_get (b->cm, keys[k], keylens[k], NULL, NULL);
+      }
+   }
+
+   return NULL;
+}
+
+static void *run_hmap (void *param)
+{
+   struct bench_t *b = param;
+
+   for (size_t i=0; i<NOPS; i++) {
+      size_t k = (size_t)(rng_next (&b->seed) % NKEYS);
+      pthread_mutex_lock (b->lock);
+      if (i % 10 == 0) {
+         ds_hmap_set (b->hm, keys[k], keylens[k], keys[k], keylens[k]);
+      } else {
+         b->nfound += ds_hmap_get (b->hm, keys[k], keylens[k], NULL, NULL);
+      }
+      pthread_mutex_unlock (b->lock);
+   }
+
+   return NULL;
+}
+
+// Runs nthreads threads of fn and returns the number of operations per
+// second, or a negative value on error.
+static double run (void *(*fn) (void *), size_t nthreads,
+                   ds_chmap_t *cm, ds_hmap_t *hm, pthread_mutex_t *lock)
+{
+   pthread_t *threads = calloc (nthreads, sizeof *threads);
+   struct bench_t *benches = calloc (nthreads, sizeof *benches);
+   size_t nstarted = 0;
+   double start = now ();
+
+   for (nstarted=0; threads && benches && nstarted<nthreads; nstarted++) {
+      benches[nstarted].cm = cm;
+      benches[nstarted].hm = hm;
+      benches[nstarted].lock = lock;
+      benches[nstarted].seed = nstarted * 0x9e3779b97f4a7c15 + 1;
+      if (pthread_create (&threads[nstarted], NULL, fn, &benches[nstarted]) != 0)
+         break;
+   }
+
+   for (size_t i=0; i<nstarted; i++) {
+      pthread_join (threads[i], NULL);
+   }
+
+   double elapsed = now () - start;
+
+   free (threads);
+   free (benches);
+
+   return nstarted == nthreads ? (double)(NOPS * nthreads) / elapsed : -1.0;
+}
+
+int main (int argc, char **argv)
+{
+   int ret = EXIT_FAILURE;
+   size_t maxthreads = 0;
+   ds_chmap_t *cm = NULL;
+   ds_hmap_t *hm = NULL;
+   pthread_mutex_t lock;
+
+   if (argc > 1 && (sscanf (argv[1], "%zu", &maxthreads) != 1 || maxthreads == 0)) {
+      fprintf (stderr, "Invalid number of threads [%s]\n", argv[1]);
+      return EXIT_FAILURE;
+   }
+
+   if (!maxthreads) {
+      long nprocs = sysconf (_SC_NPROCESSORS_ONLN);
+      maxthreads = nprocs > 0 ? (size_t)nprocs : 4;
+   }
+
+   pthread_mutex_init (&lock, NULL);
+
+   if (!(cm = ds_chmap_new (0)) || !(hm = ds_hmap_new (NKEYS))) {
+      fprintf (stderr, "Failed to create hashmaps\n");
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<NKEYS; i++) {
+      char tmp[64];
+      snprintf (tmp, sizeof tmp, "bench/%zu/key", i);
+      keylens[i] = strlen (tmp) + 1;
+      if (!(keys[i] = malloc (keylens[i]))) {
+         fprintf (stderr, "Out of memory\n");
+         goto errorexit;
+      }
+      memcpy (keys[i], tmp, keylens[i]);
+      if (!(ds_chmap_set (cm, keys[i], keylens[i], keys[i], keylens[i]))
+            || !(ds_hmap_set (hm, keys[i], keylens[i], keys[i], keylens[i]))) {
+         fprintf (stderr, "Failed to set [%s]\n", keys[i]);
+         goto errorexit;
+      }
+   }
+
+   printf ("%8s %18s %18s\n", "threads", "ds_chmap ops/s", "ds_hmap+mutex ops/s");
+
+   for (size_t n=1; n<=maxthreads; n = n < maxthreads && n * 2 > maxthreads ? maxthreads : n * 2) {
+      double chmap = run (run_chmap, n, cm, NULL, NULL);
+      double hmap = run (run_hmap, n, NULL, hm, &lock);
+      if (chmap < 0.0 || hmap < 0.0) {
+         fprintf (stderr, "Failed to start %zu threads\n", n);
+         goto errorexit;
+      }
+      printf ("%8zu %18.0f %18.0f\n", n, chmap, hmap);
+      if (n == maxthreads)
+         break;
+   }
+
+   ret = EXIT_SUCCESS;
+
+errorexit:
+
+   ds_chmap_del (cm);
+   ds_hmap_del (hm);
+   pthread_mutex_destroy (&lock);
+   for (size_t i=0; i<NKEYS; i++) {
+      free (keys[i]);
+   }
+
+   return ret;
+}
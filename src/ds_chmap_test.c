@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "ds_chmap.h"
+
+#define NTHREADS     (8)
+#define NKEYS        (8192)
+#define NROUNDS      (20)
+
+// Two values for each key, so that readers can check that the data they
+// find belongs to the key they looked up.
+static size_t values[2][NKEYS];
+
+struct worker_t {
+   ds_chmap_t *cm;
+   size_t      id;
+   size_t      nerrors;
+   size_t      nfound;
+};
+
+static void make_key (char *dst, size_t len, size_t k)
+{
+   // Every other key is too long to fit in a short buffer
+   snprintf (dst, len, k % 2 ? "%zu" : "a rather longer key number %zu", k);
+}
+
+static bool check_get (ds_chmap_t *cm, size_t k, size_t *nfound)
+{
+   char key[64];
+   void *data = NULL;
+   size_t datalen = 0;
+
+   make_key (key, sizeof key, k);
+   if (!(ds_chmap_get (cm, key, strlen (key) + 1, &data, &datalen)))
+      return true;
+
+   (*nfound)++;
+   return (data == &values[0][k] || data == &values[1][k])
+       && datalen == k;
+}
+
+// Each worker sets and removes the keys it owns (those where k modulo
+// NTHREADS is its id), while reading every other key in the hashmap.
+static void *worker (void *param)
+{
+   struct worker_t *w = param;
+   char key[64];
+   uint64_t state = w->id * 0x9e3779b97f4a7c15 + 1;
+
+   for (size_t round=0; round<NROUNDS; round++) {
+      for (size_t k=w->id; k<NKEYS; k += NTHREADS) {
+         make_key (key, sizeof key, k);
+
+         if (!(ds_chmap_set (w->cm, key, strlen (key) + 1,
+                             &values[round % 2][k], k))) {
+            w->nerrors++;
+         }
+
+         if (round % 2 == 0 && !(ds_chmap_remove (w->cm, key, strlen (key) + 1)))
+            w->nerrors++;
+
+         for (size_t i=0; i<4; i++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            if (!(check_get (w->cm, (size_t)(state % NKEYS), &w->nfound)))
+               w->nerrors++;
+         }
+      }
+   }
+
+   // Leave every other key owned by this worker in the hashmap
+   for (size_t k=w->id; k<NKEYS; k += NTHREADS) {
+      make_key (key, sizeof key, k);
+      if ((k / NTHREADS) % 2 && !(ds_chmap_remove (w->cm, key, strlen (key) + 1)))
+         w->nerrors++;
+   }
+
+   return NULL;
+}
+
+static bool basic_test (void)
+{
+   bool error = true;
+   ds_chmap_t *cm = NULL;
+   char *data = NULL;
+
+   if (!(cm = ds_chmap_new (0))) {
+      fprintf (stderr, "Failed to create hashmap\n");
+      goto errorexit;
+   }
+
+   if (!(ds_chmap_set_str_str (cm, "one", "first"))
+         || !(ds_chmap_set_str_str (cm, "two", "second"))
+         || !(ds_chmap_set_str_str (cm, "one", "third"))) {
+      fprintf (stderr, "Failed to set keys\n");
+      goto errorexit;
+   }
+
+   if (ds_chmap_num_entries (cm) != 2
+         || !(ds_chmap_get_str_str (cm, "one", &data)) || strcmp (data, "third")
+         || !(ds_chmap_get_str_str (cm, "two", &data)) || strcmp (data, "second")
+         || ds_chmap_get_str_str (cm, "three", &data)
+         || ds_chmap_get_str_str (cm, "on", &data)) {
+      fprintf (stderr, "Wrong results from basic hashmap\n");
+      goto errorexit;
+   }
+
+   if (!(ds_chmap_remove_str (cm, "one"))
+         || ds_chmap_remove_str (cm, "one")
+         || ds_chmap_get_str_str (cm, "one", &data)
+         || ds_chmap_num_entries (cm) != 1) {
+      fprintf (stderr, "Failed to remove key\n");
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_chmap_del (cm);
+
+   return !error;
+}
+
+static bool stress_test (void)
+{
+   bool error = true;
+   ds_chmap_t *cm = NULL;
+   pthread_t threads[NTHREADS];
+   struct worker_t workers[NTHREADS];
+   size_t nstarted = 0;
+   size_t nerrors = 0;
+   size_t nfound = 0;
+   size_t nexpected = 0;
+
+   // Few shards, so that shards grow while being read
+   if (!(cm = ds_chmap_new (4))) {
+      fprintf (stderr, "Failed to create hashmap\n");
+      goto errorexit;
+   }
+
+   for (nstarted=0; nstarted<NTHREADS; nstarted++) {
+      memset (&workers[nstarted], 0, sizeof workers[nstarted]);
+      workers[nstarted].cm = cm;
+      workers[nstarted].id = nstarted;
+      if (pthread_create (&threads[nstarted], NULL, worker, &workers[nstarted]) != 0) {
+         fprintf (stderr, "Failed to start thread %zu\n", nstarted);
+         goto errorexit;
+      }
+   }
+
+   error = false;
+
+errorexit:
+
+   for (size_t i=0; i<nstarted; i++) {
+      pthread_join (threads[i], NULL);
+      nerrors += workers[i].nerrors;
+      nfound += workers[i].nfound;
+   }
+
+   if (!error) {
+      printf ("Stress test: %zu threads, %zu lookups found\n", (size_t)NTHREADS, nfound);
+
+      for (size_t k=0; k<NKEYS; k++) {
+         size_t found = 0;
+         bool expected = (k / NTHREADS) % 2 == 0;
+         if (!(check_get (cm, k, &found)) || found != expected)
+            nerrors++;
+         nexpected += expected;
+      }
+
+      if (nerrors || ds_chmap_num_entries (cm) != nexpected) {
+         fprintf (stderr, "Stress test: %zu errors, %zu entries (expected %zu)\n",
+                  nerrors, ds_chmap_num_entries (cm), nexpected);
+         error = true;
+      }
+   }
+
+   ds_chmap_del (cm);
+
+   return !error;
+}
+
+int main (void)
+{
+   int ret = EXIT_FAILURE;
+
+   if (!(basic_test ())) {
+      fprintf (stderr, "Failed basic test\n");
+      goto errorexit;
+   }
+
+   if (!(stress_test ())) {
+      fprintf (stderr, "Failed stress test\n");
+      goto errorexit;
+   }
+
+   ret = EXIT_SUCCESS;
+
+errorexit:
+
+   return ret;
+}
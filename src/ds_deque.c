@@ -0,0 +1,206 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds_deque.h"
+
+/* ******************************************************************
+ * The elements are stored in items[head], items[head + 1], ... wrapping
+ * around at the end of the buffer. The capacity is always a power of
+ * two, so that an index is wrapped with a mask.
+ */
+#define MIN_CAPACITY       (8)
+
+struct ds_deque_t {
+   void      **items;
+   size_t      capacity;
+   size_t      head;
+   size_t      nitems;
+};
+
+#define SLOT(dq,i)         ((dq)->items[((dq)->head + (i)) & ((dq)->capacity - 1)])
+
+ds_deque_t *ds_deque_new (void)
+{
+   bool error = true;
+   ds_deque_t *ret = NULL;
+
+   if (!(ret = calloc (1, sizeof *ret)))
+      goto errorexit;
+
+   if (!(ret->items = malloc (MIN_CAPACITY * sizeof *ret->items)))
+      goto errorexit;
+
+   ret->capacity = MIN_CAPACITY;
+
+   error = false;
+
+errorexit:
+
+   if (error) {
+      ds_deque_del (ret);
+      ret = NULL;
+   }
+
+   return ret;
+}
+
+void ds_deque_del (ds_deque_t *dq)
+{
+   if (!dq)
+      return;
+
+   free (dq->items);
+   free (dq);
+}
+
+size_t ds_deque_length (const ds_deque_t *dq)
+{
+   return dq ? dq->nitems : 0;
+}
+
+void *ds_deque_get (const ds_deque_t *dq, size_t i)
+{
+   if (!dq || i >= dq->nitems)
+      return NULL;
+
+   return SLOT (dq, i);
+}
+
+void ds_deque_iterate (const ds_deque_t *dq,
+                       void (*fptr) (void *, void *), void *param)
+{
+   if (!dq || !fptr)
+      return;
+
+   for (size_t i=0; i<dq->nitems; i++) {
+      fptr (SLOT (dq, i), param);
+   }
+}
+
+// Grows the buffer to the given capacity, a power of two. The elements
+// that wrapped around to the start of the old buffer are moved to just
+// after its end, where they follow on from the rest.
+static bool deque_resize (ds_deque_t *dq, size_t capacity)
+{
+   void **tmp = realloc (dq->items, capacity * sizeof *tmp);
+   if (!tmp)
+      return false;
+
+   dq->items = tmp;
+
+   if (dq->head + dq->nitems > dq->capacity) {
+      size_t nwrapped = dq->head + dq->nitems - dq->capacity;
+      memcpy (&dq->items[dq->capacity], &dq->items[0], nwrapped * sizeof *tmp);
+   }
+
+   dq->capacity = capacity;
+   return true;
+}
+
+bool ds_deque_reserve (ds_deque_t *dq, size_t nelems)
+{
+   size_t capacity;
+
+   if (!dq)
+      return false;
+
+   if (nelems <= dq->capacity)
+      return true;
+
+   for (capacity = dq->capacity; capacity < nelems; capacity *= 2) {
+      if (capacity > ((size_t)-1) / 2 / sizeof *dq->items)
+         return false;
+   }
+
+   return deque_resize (dq, capacity);
+}
+
+size_t ds_deque_capacity (const ds_deque_t *dq)
+{
+   return dq ? dq->capacity : 0;
+}
+
+void *ds_deque_ins_tail (ds_deque_t *dq, void *el)
+{
+   if (!dq || !el)
+      return NULL;
+
+   if (dq->nitems == dq->capacity && !(ds_deque_reserve (dq, dq->nitems + 1)))
+      return NULL;
+
+   SLOT (dq, dq->nitems) = el;
+   dq->nitems++;
+
+   return el;
+}
+
+void *ds_deque_ins_head (ds_deque_t *dq, void *el)
+{
+   if (!dq || !el)
+      return NULL;
+
+   if (dq->nitems == dq->capacity && !(ds_deque_reserve (dq, dq->nitems + 1)))
+      return NULL;
+
+   dq->head = (dq->head - 1) & (dq->capacity - 1);
+   dq->items[dq->head] = el;
+   dq->nitems++;
+
+   return el;
+}
+
+void *ds_deque_rm_tail (ds_deque_t *dq)
+{
+   if (!dq || !dq->nitems)
+      return NULL;
+
+   dq->nitems--;
+   return SLOT (dq, dq->nitems);
+}
+
+void *ds_deque_rm_head (ds_deque_t *dq)
+{
+   if (!dq || !dq->nitems)
+      return NULL;
+
+   void *ret = dq->items[dq->head];
+
+   dq->head = (dq->head + 1) & (dq->capacity - 1);
+   dq->nitems--;
+
+   return ret;
+}
+
+void ds_deque_clear (ds_deque_t *dq)
+{
+   if (!dq)
+      return;
+
+   dq->head = 0;
+   dq->nitems = 0;
+}
+
+size_t ds_deque_spans (const ds_deque_t *dq, ds_deque_span_t spans[2])
+{
+   if (!spans)
+      return 0;
+
+   memset (spans, 0, 2 * sizeof *spans);
+
+   if (!dq || !dq->nitems)
+      return 0;
+
+   spans[0].items = &dq->items[dq->head];
+
+   if (dq->head + dq->nitems <= dq->capacity) {
+      spans[0].nitems = dq->nitems;
+      return 1;
+   }
+
+   spans[0].nitems = dq->capacity - dq->head;
+   spans[1].items = dq->items;
+   spans[1].nitems = dq->nitems - spans[0].nitems;
+
+   return 2;
+}
@@ -0,0 +1,228 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ds_deque.h"
+
+#define NOPS         (200000)
+
+static char elements[NOPS];
+
+// The model is a plain array with room to grow in both directions
+static char *model[2 * NOPS + 1];
+static size_t model_head = NOPS, model_tail = NOPS;
+
+static uint64_t rng_next (uint64_t *state)
+{
+   *state ^= *state << 13;
+   *state ^= *state >> 7;
+   *state ^= *state << 17;
+   return *state;
+}
+
+static bool check_contents (const ds_deque_t *dq, const char *msg)
+{
+   ds_deque_span_t spans[2];
+   size_t nitems = model_tail - model_head;
+   size_t nspans = ds_deque_spans (dq, spans);
+
+   if (ds_deque_length (dq) != nitems) {
+      fprintf (stderr, "[%s] Length %zu, expected %zu\n", msg,
+               ds_deque_length (dq), nitems);
+      return false;
+   }
+
+   if (nspans != (size_t)(spans[0].nitems > 0) + (spans[1].nitems > 0)
+         || spans[0].nitems + spans[1].nitems != nitems
+         || (nitems && !nspans)) {
+      fprintf (stderr, "[%s] Wrong spans\n", msg);
+      return false;
+   }
+
+   for (size_t i=0; i<nitems; i++) {
+      void *expected = model[model_head + i];
+      void *span = i < spans[0].nitems ? spans[0].items[i]
+                                       : spans[1].items[i - spans[0].nitems];
+      if (ds_deque_get (dq, i) != expected || span != expected) {
+         fprintf (stderr, "[%s] Wrong element at %zu\n", msg, i);
+         return false;
+      }
+   }
+
+   if (ds_deque_get (dq, nitems)) {
+      fprintf (stderr, "[%s] Found an element past the end\n", msg);
+      return false;
+   }
+
+   return true;
+}
+
+static void count_elements (void *el, void *param)
+{
+   (void)el;
+   (*(size_t *)param)++;
+}
+
+// Random insertions and removals at both ends, with more insertions than
+// removals so that the deque grows while its elements wrap around.
+static bool random_test (void)
+{
+   bool error = true;
+   ds_deque_t *dq = NULL;
+   uint64_t state = 0x9e3779b97f4a7c15ull;
+   size_t count = 0;
+
+   if (!(dq = ds_deque_new ())) {
+      fprintf (stderr, "Failed to create deque\n");
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<NOPS; i++) {
+      uint64_t r = rng_next (&state);
+      void *el = &elements[i];
+      void *removed = NULL, *expected = NULL;
+
+      switch (r % 5) {
+         case 0:
+         case 1:
+            if (ds_deque_ins_tail (dq, el) != el)
+               goto errorexit;
+            model[model_tail++] = el;
+            break;
+
+         case 2:
+            if (ds_deque_ins_head (dq, el) != el)
+               goto errorexit;
+            model[--model_head] = el;
+            break;
+
+         case 3:
+            removed = ds_deque_rm_tail (dq);
+            if (model_tail > model_head)
+               expected = model[--model_tail];
+            break;
+
+         case 4:
+            removed = ds_deque_rm_head (dq);
+            if (model_tail > model_head)
+               expected = model[model_head++];
+            break;
+      }
+
+      if (removed != expected) {
+         fprintf (stderr, "Removed the wrong element at step %zu\n", i);
+         goto errorexit;
+      }
+
+      if (i % 9973 == 0 && !(check_contents (dq, "Random")))
+         goto errorexit;
+   }
+
+   if (!(check_contents (dq, "Random")))
+      goto errorexit;
+
+   ds_deque_iterate (dq, count_elements, &count);
+   if (count != model_tail - model_head) {
+      fprintf (stderr, "Iterated over %zu elements\n", count);
+      goto errorexit;
+   }
+
+   ds_deque_clear (dq);
+   model_head = model_tail = NOPS;
+   if (!(check_contents (dq, "Cleared")) || ds_deque_rm_head (dq) || ds_deque_rm_tail (dq))
+      goto errorexit;
+
+   error = false;
+
+errorexit:
+
+   ds_deque_del (dq);
+
+   return !error;
+}
+
+static bool capacity_test (void)
+{
+   bool error = true;
+   ds_deque_t *dq = NULL;
+   ds_deque_span_t spans[2];
+
+   model_head = model_tail = NOPS;
+
+   if (!(dq = ds_deque_new ())) {
+      fprintf (stderr, "Failed to create deque\n");
+      goto errorexit;
+   }
+
+   // The capacity is always a power of two
+   if (!(ds_deque_reserve (dq, 1000)) || ds_deque_capacity (dq) != 1024
+         || !(ds_deque_reserve (dq, 10)) || ds_deque_capacity (dq) != 1024) {
+      fprintf (stderr, "Wrong capacity %zu\n", ds_deque_capacity (dq));
+      goto errorexit;
+   }
+
+   // A queue that never holds more than the capacity never grows, and
+   // its elements wrap around the end of the buffer.
+   for (size_t i=0; i<NOPS; i++) {
+      ds_deque_ins_tail (dq, &elements[i]);
+      model[model_tail++] = &elements[i];
+      if (ds_deque_length (dq) > 1000) {
+         ds_deque_rm_head (dq);
+         model_head++;
+      }
+   }
+   if (ds_deque_capacity (dq) != 1024 || ds_deque_spans (dq, spans) != 2
+         || !(check_contents (dq, "Queue"))) {
+      fprintf (stderr, "Queue grew to %zu\n", ds_deque_capacity (dq));
+      goto errorexit;
+   }
+
+   // Growing while wrapped around keeps the order
+   for (size_t i=0; i<5000; i++) {
+      ds_deque_ins_head (dq, &elements[i]);
+      model[--model_head] = &elements[i];
+   }
+   if (ds_deque_capacity (dq) != 8192 || !(check_contents (dq, "Grown")))
+      goto errorexit;
+
+   if (ds_deque_ins_tail (dq, NULL) || ds_deque_ins_head (dq, NULL)
+         || ds_deque_length (NULL) || ds_deque_spans (NULL, spans)
+         || spans[0].items || spans[1].nitems) {
+      fprintf (stderr, "Failed NULL parameter test\n");
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_deque_del (dq);
+
+   return !error;
+}
+
+int main (void)
+{
+   int ret = EXIT_FAILURE;
+
+   printf ("Testing deque, %s\n", ds_version);
+
+   if (!(random_test ())) {
+      fprintf (stderr, "Failed random operations test\n");
+      goto errorexit;
+   }
+
+   if (!(capacity_test ())) {
+      fprintf (stderr, "Failed capacity test\n");
+      goto errorexit;
+   }
+
+   ret = EXIT_SUCCESS;
+
+errorexit:
+
+   return ret;
+}
@@ -1,34 +1,386 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <math.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #define DS_HMAP_IMPLEMENTATION
 #include "ds_hmap.h"
 #undef DS_HMAP_IMPLEMENTATION
 
+#include "ds_hmap_define.h"
+#include "ds_bloom.h"
+
+
+/* ******************************************************************
+ * The hashing functions. The default hash reads the key eight bytes at a
+ * time and mixes the words with a 64x64->128 bit multiply, folding the
+ * high half of the product back into the low half.
+ */
+#define HP0    (0xa0761d6478bd642full)
+#define HP1    (0xe7037ed1a0b428dbull)
+#define HP2    (0x8ebc6af09c88c6e3ull)
+#define HP3    (0x589965cc75374cc3ull)
+
+static uint64_t read64 (const uint8_t *p)
+{
+   uint64_t ret;
+   memcpy (&ret, p, sizeof ret);
+   return ret;
+}
+
+static uint64_t read32 (const uint8_t *p)
+{
+   uint32_t ret;
+   memcpy (&ret, p, sizeof ret);
+   return ret;
+}
+
+static void mum128 (uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+   __uint128_t r = (__uint128_t)*a * *b;
+   *a = (uint64_t)r;
+   *b = (uint64_t)(r >> 64);
+#else
+   uint64_t ha = *a >> 32, hb = *b >> 32;
+   uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+   uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+   uint64_t t = rl + (rm0 << 32);
+   uint64_t c = t < rl;
+   uint64_t lo = t + (rm1 << 32);
+   c += lo < t;
+   *a = lo;
+   *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static uint64_t mix (uint64_t a, uint64_t b)
+{
+   mum128 (&a, &b);
+   return a ^ b;
+}
+
+uint64_t ds_hmap_hashfn (const void *key, size_t keylen, uint64_t seed)
+{
+   const uint8_t *p = key;
+   uint64_t a = 0, b = 0;
+   size_t i = keylen;
+
+   seed ^= mix (seed ^ HP0, HP1);
+
+   if (keylen <= 16) {
+      if (keylen >= 4) {
+         size_t q = (keylen >> 3) << 2;
+         a = (read32 (p) << 32) | read32 (p + q);
+         b = (read32 (p + keylen - 4) << 32) | read32 (p + keylen - 4 - q);
+      } else if (keylen > 0) {
+         a = ((uint64_t)p[0] << 16) | ((uint64_t)p[keylen >> 1] << 8) | p[keylen - 1];
+      }
+   } else {
+      // Three independent lanes for long keys so that the multiplies
+      // can overlap.
+      if (i > 48) {
+         uint64_t s1 = seed, s2 = seed;
+         do {
+            seed = mix (read64 (p) ^ HP1, read64 (p + 8) ^ seed);
+            s1 = mix (read64 (p + 16) ^ HP2, read64 (p + 24) ^ s1);
+            s2 = mix (read64 (p + 32) ^ HP3, read64 (p + 40) ^ s2);
+            p += 48;
+            i -= 48;
+         } while (i > 48);
+         seed ^= s1 ^ s2;
+      }
+      while (i > 16) {
+         seed = mix (read64 (p) ^ HP1, read64 (p + 8) ^ seed);
+         p += 16;
+         i -= 16;
+      }
+      // The last 16 bytes of the key, overlapping bytes already mixed
+      // in when the remainder is shorter than 16.
+      a = read64 (p + i - 16);
+      b = read64 (p + i - 8);
+   }
+
+   a ^= HP1;
+   b ^= seed;
+   mum128 (&a, &b);
+   return mix (a ^ HP0 ^ keylen, b ^ HP1);
+}
+
+// The seed used for every hashmap that is not given one. It is chosen
+// once per process so that the bucket of a key cannot be predicted by
+// anyone supplying keys.
+static uint64_t g_process_seed = 0;
+
+static uint64_t process_seed (void)
+{
+#ifdef __GNUC__
+   uint64_t ret = __atomic_load_n (&g_process_seed, __ATOMIC_ACQUIRE);
+#else
+   uint64_t ret = g_process_seed;
+#endif
+   if (ret)
+      return ret;
+
+   ret = (uint64_t)time (NULL) ^ (uint64_t)clock ()
+       ^ (uint64_t)(uintptr_t)&ret ^ (uint64_t)(uintptr_t)&g_process_seed;
+
+   FILE *inf = fopen ("/dev/urandom", "rb");
+   if (inf) {
+      uint64_t rnd = 0;
+      if ((fread (&rnd, sizeof rnd, 1, inf)) == 1)
+         ret ^= rnd;
+      fclose (inf);
+   }
+   ret = mix (ret ^ HP2, HP3) | 1;
+
+   // If another thread got here first, use its seed instead.
+#ifdef __GNUC__
+   uint64_t expected = 0;
+   if (!(__atomic_compare_exchange_n (&g_process_seed, &expected, ret, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)))
+      ret = expected;
+#else
+   g_process_seed = ret;
+#endif
+
+   return ret;
+}
+
+uint64_t ds_hmap_process_seed (void)
+{
+   return process_seed ();
+}
+
+// The hash and compare functions of a hashmap. A NULL hashfn means the
+// default hash is used; a NULL cmpfn means the key bytes are compared.
+// When u64 is set every key is a uint64_t hashed with ds_hmap_hash_u64().
+typedef struct keyfn_t keyfn_t;
+struct keyfn_t {
+   uint64_t    seed;
+   uint64_t  (*hashfn) (const void *key, size_t keylen, uint64_t seed);
+   int       (*cmpfn) (const void *k1, size_t k1len, const void *k2, size_t k2len);
+   bool        u64;
+};
+
+static uint64_t key_hash (const keyfn_t *kf, const void *k, size_t klen)
+{
+   if (kf->u64 && klen == sizeof (uint64_t))
+      return ds_hmap_hash_u64 (read64 (k), kf->seed);
+
+   return kf->hashfn ? kf->hashfn (k, klen, kf->seed)
+                     : ds_hmap_hashfn (k, klen, kf->seed);
+}
 
 /* ******************************************************************
- * The data structure that stores each key/value pair.
+ * The data structure that stores each key/value pair. The entries of a
+ * keys-only hashmap end before the data field, so every array of entries
+ * is addressed with ENTRY_AT() and the entry size of the hashmap (esize)
+ * instead of by indexing an entry_t pointer. The data and datalen of
+ * such an entry do not exist and are only touched through
+ * entry_set_data() and entry_data().
  */
-#define FLAG_RFU0       (1 << 0)
-#define FLAG_DELETE     (1 << 1)
-#define FLAG_RFU2       (1 << 2)
-#define FLAG_RFU3       (1 << 3)
-#define FLAG_RFU4       (1 << 4)
-#define FLAG_RFU5       (1 << 5)
-#define FLAG_RFU6       (1 << 6)
-#define FLAG_RFU7       (1 << 7)
+#define INLINE_KEYLEN      (24)
 
 typedef struct entry_t entry_t;
 struct entry_t {
-   uint8_t  flags;
+   uint64_t hash;
    size_t   keylen;
-   void    *key;
-   size_t   datalen;
+   // Short keys are stored in the entry itself, longer keys are stored
+   // in the key arena of the hashmap (see entry_key()).
+   union {
+      uint8_t  buf[INLINE_KEYLEN];
+      void    *ptr;
+   } key;
    void    *data;
+   size_t   datalen;
+};
+
+#define ENTRY_KEYS_SIZE          (offsetof (entry_t, data))
+#define ENTRY_AT(base,i,esize)   ((entry_t *)((base) + (i) * (esize)))
+
+static const void *entry_key (const entry_t *e)
+{
+   return e->keylen <= INLINE_KEYLEN ? e->key.buf : e->key.ptr;
+}
+
+static void entry_set_data (entry_t *e, size_t esize, void *d, size_t dlen)
+{
+   if (esize == ENTRY_KEYS_SIZE)
+      return;
+
+   e->data = d;
+   e->datalen = dlen;
+}
+
+// A keys-only entry returns its stored key as the data, so that a key
+// that is found can still be told apart from one that is not.
+static void entry_data (const entry_t *e, size_t esize, void **d, size_t *dlen)
+{
+   if (esize == ENTRY_KEYS_SIZE) {
+      *d = (void *)entry_key (e);
+      *dlen = 0;
+      return;
+   }
+
+   *d = e->data;
+   *dlen = e->datalen;
+}
+
+// The full hash and the key length are stored in the entry itself, so
+// almost every entry that does not match is rejected without reading the
+// key from memory. The hash is also reused when rehashing.
+static bool key_equal (const keyfn_t *kf, const entry_t *e, uint64_t hash,
+                       const void *k, size_t klen)
+{
+   if (e->hash != hash)
+      return false;
+
+   if (kf->u64)
+      return e->keylen == klen;
+
+   if (kf->cmpfn)
+      return kf->cmpfn (entry_key (e), e->keylen, k, klen) == 0;
+
+   return e->keylen == klen && (memcmp (entry_key (e), k, klen))==0;
+}
+
+
+/* ******************************************************************
+ * The key arena. Keys that are too long to be stored in an entry are
+ * copied into chunks, and all the chunks are freed together when the
+ * hashmap is deleted. Chunks double in size up to ARENA_MAX_CHUNK. The
+ * space used by a removed key is only reused when that key was the most
+ * recent allocation, otherwise it is counted in nwasted. When the
+ * hashmap is cleared the chunks are kept on a spare list and reused
+ * before any new chunk is allocated.
+ */
+#define ARENA_MIN_CHUNK    (256)
+#define ARENA_MAX_CHUNK    (64 * 1024)
+
+typedef struct chunk_t chunk_t;
+struct chunk_t {
+   chunk_t    *next;
+   size_t      size;
+   size_t      used;
+   uint8_t     data[];
 };
 
+typedef struct arena_t arena_t;
+struct arena_t {
+   chunk_t    *head;
+   chunk_t    *spare;
+   size_t      nbytes;
+   size_t      nwasted;
+};
+
+static void *arena_alloc (arena_t *a, size_t len)
+{
+   chunk_t *c = a->head;
+   void *ret = NULL;
+
+   if (!c || c->size - c->used < len) {
+      if (a->spare && a->spare->size >= len) {
+         c = a->spare;
+         a->spare = c->next;
+      } else {
+         size_t size = c ? c->size * 2 : ARENA_MIN_CHUNK;
+         if (size > ARENA_MAX_CHUNK)
+            size = ARENA_MAX_CHUNK;
+         if (size < len)
+            size = len;
+
+         if (!(c = malloc (sizeof *c + size)))
+            return NULL;
+
+         c->size = size;
+         a->nbytes += size;
+      }
+
+      c->used = 0;
+      c->next = a->head;
+      a->head = c;
+
+      // The remainder of the previous chunk is never used again
+      if (c->next)
+         a->nwasted += c->next->size - c->next->used;
+   }
+
+   ret = &c->data[c->used];
+   c->used += len;
+   return ret;
+}
+
+static void arena_release (arena_t *a, const void *p, size_t len)
+{
+   chunk_t *c = a->head;
+
+   if (c && c->used >= len && p == &c->data[c->used - len]) {
+      c->used -= len;
+      return;
+   }
+   a->nwasted += len;
+}
+
+static void arena_clear (arena_t *a)
+{
+   chunk_t *lists[] = { a->head, a->spare };
+
+   for (size_t i=0; i<sizeof lists / sizeof lists[0]; i++) {
+      while (lists[i]) {
+         chunk_t *tmp = lists[i]->next;
+         free (lists[i]);
+         lists[i] = tmp;
+      }
+   }
+   memset (a, 0, sizeof *a);
+}
+
+// Moves every chunk to the spare list; all the keys are gone
+static void arena_reset (arena_t *a)
+{
+   while (a->head) {
+      chunk_t *tmp = a->head->next;
+      a->head->next = a->spare;
+      a->spare = a->head;
+      a->head = tmp;
+   }
+   a->nwasted = 0;
+}
+
+static bool entry_set_key (arena_t *a, entry_t *e, const void *k, size_t klen)
+{
+   if (klen <= INLINE_KEYLEN) {
+      memcpy (e->key.buf, k, klen);
+   } else {
+      if (!(e->key.ptr = arena_alloc (a, klen)))
+         return false;
+      memcpy (e->key.ptr, k, klen);
+   }
+   e->keylen = klen;
+   return true;
+}
+
+static void entry_clear (arena_t *a, entry_t *e, size_t esize)
+{
+   if (e->keylen > INLINE_KEYLEN)
+      arena_release (a, e->key.ptr, e->keylen);
+   memset (e, 0, esize);
+}
+
 
 /* ******************************************************************
  * The data structure that stores a collection of entry_t elements.
@@ -37,342 +389,2791 @@ typedef struct bucket_t bucket_t;
 struct bucket_t {
    size_t   nelems;
    size_t   alen;
-   entry_t *elems;
+   uint8_t *elems;
+};
+
+static void bucket_clear (bucket_t *b)
+{
+   if (!b)
+      return;
+
+   free (b->elems);
+   memset (b, 0, sizeof *b);
+}
+
+static entry_t *bucket_find_entry (const keyfn_t *kf, bucket_t *b, size_t esize,
+                                   uint64_t hash, const void *k, size_t klen)
+{
+   if (!k) {
+      for (size_t i=0; i<b->alen; i++) {
+         if (!ENTRY_AT (b->elems, i, esize)->keylen)
+            return ENTRY_AT (b->elems, i, esize);
+      }
+      return NULL;
+   }
+
+   for (size_t i=0; i<b->alen; i++) {
+      entry_t *e = ENTRY_AT (b->elems, i, esize);
+      if (!e->keylen)
+         continue;
+      if (key_equal (kf, e, hash, k, klen))
+         return e;
+   }
+
+   return NULL;
+}
+
+static entry_t *bucket_new_entry (arena_t *a, bucket_t *b, size_t esize,
+                                  uint64_t hash, const void *k, size_t klen,
+                                  void *d, size_t dlen)
+{
+   entry_t *ret = NULL;
+
+   uint8_t *tmp = realloc (b->elems, (b->alen + 1) * esize);
+   if (!tmp)
+      return NULL;
+
+   b->elems = tmp;
+
+   ret = ENTRY_AT (b->elems, b->alen, esize);
+   memset (ret, 0, esize);
+
+   if (!(entry_set_key (a, ret, k, klen)))
+      return NULL;
+
+   ret->hash = hash;
+   entry_set_data (ret, esize, d, dlen);
+
+   b->alen++;
+   b->nelems++;
+
+   return ret;
+}
+
+static entry_t *bucket_set (const keyfn_t *kf, arena_t *a, bucket_t *b, size_t esize,
+                            uint64_t hash, const void *k, size_t klen,
+                            void *d, size_t dlen, bool *added)
+{
+   entry_t *e = NULL;
+
+   *added = false;
+
+   // Look for an existing entry
+   e = bucket_find_entry (kf, b, esize, hash, k, klen);
+   if (!e) {
+      // Doesn't exist, try to find an empty entry
+      e = bucket_find_entry (kf, b, esize, 0, NULL, 0);
+      if (e) {
+         if (!(entry_set_key (a, e, k, klen)))
+            return NULL;
+         e->hash = hash;
+         b->nelems++;
+         *added = true;
+      }
+   }
+
+   if (!e) {
+      // No existing entry and no empty entries, create a new one
+      if ((e = bucket_new_entry (a, b, esize, hash, k, klen, d, dlen)))
+         *added = true;
+      return e;
+   }
+
+   entry_set_data (e, esize, d, dlen);
+
+   return e;
+}
+
+// Moves an entry (including the key) into the bucket. Used when
+// rehashing; keys in the arena stay where they are and inline keys are
+// copied along with the entry.
+static bool bucket_move_entry (bucket_t *b, size_t esize, entry_t *src)
+{
+   entry_t *e = bucket_find_entry (NULL, b, esize, 0, NULL, 0);
+   if (!e) {
+      uint8_t *tmp = realloc (b->elems, (b->alen + 1) * esize);
+      if (!tmp)
+         return false;
+
+      b->elems = tmp;
+      e = ENTRY_AT (b->elems, b->alen++, esize);
+   }
+
+   memcpy (e, src, esize);
+   b->nelems++;
+   memset (src, 0, esize);
+
+   return true;
+}
+
+/* ******************************************************************
+ * The data structure that stores a collection of bucket_t elements.
+ */
+typedef struct table_t table_t;
+struct table_t {
+   size_t      nbuckets;
+   bucket_t   *buckets;
+};
+
+static bool table_init (table_t *t, size_t nbuckets)
+{
+   if (!(t->buckets = calloc (nbuckets, sizeof *t->buckets)))
+      return false;
+
+   t->nbuckets = nbuckets;
+   return true;
+}
+
+static void table_clear (table_t *t)
+{
+   if (!t->buckets)
+      return;
+
+   for (size_t i=0; i<t->nbuckets; i++) {
+      bucket_clear (&t->buckets[i]);
+   }
+   free (t->buckets);
+   memset (t, 0, sizeof *t);
+}
+
+/* ******************************************************************
+ * The flat (open-addressing) table used by ds_hmap_ENGINE_FLAT. Each
+ * slot has a control byte that is either DS_HMAP_CTRL_EMPTY,
+ * DS_HMAP_CTRL_DELETED or the low seven bits of the hash of the key
+ * stored in that slot. Slots are probed a group at a time: all the
+ * control bytes in a group are compared against the seven hash bits in a
+ * single step and only the slots that match have their keys compared.
+ * The group primitives are in ds_hmap_define.h, where they are shared
+ * with the generated hashmaps.
+ */
+#define FLAT_DEFAULT_LOAD     (0.875f)
+#define FLAT_MAX_LOAD         (0.9375f)
+
+typedef struct flat_t flat_t;
+struct flat_t {
+   size_t      nslots;     // A power of two, at least one group
+   size_t      nused;      // Slots that are full or deleted
+   size_t      esize;
+   int8_t     *ctrl;
+   uint8_t    *slots;
 };
 
-static void bucket_clear (bucket_t *b)
+static bool flat_init (flat_t *f, size_t nslots, size_t esize)
+{
+   size_t n = DS_HMAP_GROUP_WIDTH;
+   while (n < nslots)
+      n *= 2;
+
+   memset (f, 0, sizeof *f);
+   f->esize = esize;
+   if (!(f->ctrl = malloc (n)) || !(f->slots = malloc (n * esize))) {
+      free (f->ctrl);
+      f->ctrl = NULL;
+      return false;
+   }
+
+   memset (f->ctrl, DS_HMAP_CTRL_EMPTY, n);
+   f->nslots = n;
+   return true;
+}
+
+static void flat_clear (flat_t *f)
+{
+   if (!f->ctrl)
+      return;
+
+   free (f->ctrl);
+   free (f->slots);
+   memset (f, 0, sizeof *f);
+}
+
+// Returns the index of the slot holding the key, or (size_t)-1 if the
+// key is not in the table. The probe sequence visits groups in
+// triangular order, which covers every group when the number of groups
+// is a power of two. A group with an empty slot ends the search.
+static size_t flat_find (const keyfn_t *kf, const flat_t *f, uint64_t hash,
+                         const void *k, size_t klen)
+{
+   size_t gmask = f->nslots / DS_HMAP_GROUP_WIDTH - 1;
+   size_t g = DS_HMAP_H1 (hash) & gmask;
+   int8_t h2 = DS_HMAP_H2 (hash);
+
+   for (size_t i=0; i<=gmask; i++) {
+      const int8_t *group = &f->ctrl[g * DS_HMAP_GROUP_WIDTH];
+      uint32_t m = ds_hmap_group_match (group, h2);
+      while (m) {
+         size_t idx = g * DS_HMAP_GROUP_WIDTH + ds_hmap_mask_first (m);
+         if (key_equal (kf, ENTRY_AT (f->slots, idx, f->esize), hash, k, klen))
+            return idx;
+         m &= m - 1;
+      }
+      if (ds_hmap_group_match (group, DS_HMAP_CTRL_EMPTY))
+         break;
+      g = (g + i + 1) & gmask;
+   }
+
+   return (size_t)-1;
+}
+
+// Claims the first empty or deleted slot in the probe sequence for the
+// hash and returns its index. The table must have at least one free slot.
+static size_t flat_claim (flat_t *f, uint64_t hash)
+{
+   size_t gmask = f->nslots / DS_HMAP_GROUP_WIDTH - 1;
+   size_t g = DS_HMAP_H1 (hash) & gmask;
+   uint32_t m = 0;
+
+   for (size_t i=0; !(m = ds_hmap_group_match_free (&f->ctrl[g * DS_HMAP_GROUP_WIDTH])); i++) {
+      g = (g + i + 1) & gmask;
+   }
+
+   size_t idx = g * DS_HMAP_GROUP_WIDTH + ds_hmap_mask_first (m);
+   if (f->ctrl[idx] == DS_HMAP_CTRL_EMPTY)
+      f->nused++;
+   f->ctrl[idx] = DS_HMAP_H2 (hash);
+
+   return idx;
+}
+
+// Moves every entry into a new table of nslots slots, dropping all the
+// deleted slots in the process.
+static bool flat_resize (flat_t *f, size_t nslots)
+{
+   flat_t n;
+
+   if (!(flat_init (&n, nslots, f->esize)))
+      return false;
+
+   for (size_t i=0; i<f->nslots; i++) {
+      if (f->ctrl[i] < 0)
+         continue;
+      entry_t *e = ENTRY_AT (f->slots, i, f->esize);
+      memcpy (ENTRY_AT (n.slots, flat_claim (&n, e->hash), f->esize), e, f->esize);
+   }
+
+   free (f->ctrl);
+   free (f->slots);
+   *f = n;
+
+   return true;
+}
+
+// Called before an insertion; makes sure that there is room for one more
+// entry without exceeding the load factor. When most of the used slots
+// are deleted the table is rebuilt at the same size.
+static bool flat_reserve (flat_t *f, size_t nentries, float max_load)
+{
+   float limit = max_load * (float)f->nslots;
+
+   if ((float)(f->nused + 1) <= limit)
+      return true;
+
+   if ((float)(nentries + 1) <= limit / 2.0f)
+      return flat_resize (f, f->nslots);
+
+   return flat_resize (f, f->nslots * 2);
+}
+
+static entry_t *flat_new_entry (arena_t *a, flat_t *f, uint64_t hash,
+                                const void *k, size_t klen,
+                                void *d, size_t dlen)
+{
+   entry_t tmp = { .hash = hash, .data = d, .datalen = dlen };
+
+   if (!(entry_set_key (a, &tmp, k, klen)))
+      return NULL;
+
+   entry_t *e = ENTRY_AT (f->slots, flat_claim (f, hash), f->esize);
+   memcpy (e, &tmp, f->esize);
+
+   return e;
+}
+
+static void flat_remove (arena_t *a, flat_t *f, size_t idx)
+{
+   // If this group has an empty slot then no probe sequence ever
+   // continued past it, and the slot can be marked empty instead of
+   // deleted.
+   const int8_t *group = &f->ctrl[idx & ~(size_t)(DS_HMAP_GROUP_WIDTH - 1)];
+   if (ds_hmap_group_match (group, DS_HMAP_CTRL_EMPTY)) {
+      f->ctrl[idx] = DS_HMAP_CTRL_EMPTY;
+      f->nused--;
+   } else {
+      f->ctrl[idx] = DS_HMAP_CTRL_DELETED;
+   }
+
+   entry_clear (a, ENTRY_AT (f->slots, idx, f->esize), f->esize);
+}
+
+/* ******************************************************************
+ * The insertion-ordered table used by ds_hmap_ENGINE_ORDERED. The entries
+ * are stored densely in the order in which they were added, and a
+ * separate open-addressing index maps each hash to the position of its
+ * entry (plus one, so that zero is an empty index slot). The index is
+ * probed linearly and is kept at least twice as large as the entries
+ * array.
+ *
+ * A removed entry is cleared in place, leaving a tombstone (an entry
+ * with no data, or with no key in a keys-only hashmap) that its index
+ * slot still points to. Tombstones are
+ * dropped when the entries array is full and at least half of it is
+ * tombstones, or when ds_hmap_remove() leaves more than half of it as
+ * tombstones; either way the entries are compacted and the index is
+ * rebuilt, which costs O(1) per removal over time.
+ */
+#define ORDERED_MIN_ENTRIES      (8)
+
+typedef struct ordered_t ordered_t;
+struct ordered_t {
+   uint8_t    *entries;
+   size_t      esize;
+   size_t      nused;      // Entries used, including tombstones
+   size_t      nalloc;
+   size_t      ndeleted;
+   size_t     *index;
+   size_t      nindex;     // A power of two, at least twice nalloc
+};
+
+#define TOMBSTONE(o,e)     ((o)->esize == ENTRY_KEYS_SIZE ? (e)->keylen == 0   \
+                                                          : (e)->data == NULL)
+
+static void ordered_index_add (ordered_t *o, uint64_t hash, size_t pos)
+{
+   size_t mask = o->nindex - 1;
+   size_t i = (size_t)hash & mask;
+
+   while (o->index[i])
+      i = (i + 1) & mask;
+
+   o->index[i] = pos + 1;
+}
+
+// Compacts the entries and rebuilds the index for nalloc entries
+static bool ordered_rebuild (ordered_t *o, size_t nalloc)
+{
+   size_t nindex = 2 * ORDERED_MIN_ENTRIES;
+   while (nindex < 2 * nalloc)
+      nindex *= 2;
+
+   size_t *index = calloc (nindex, sizeof *index);
+   if (!index)
+      return false;
+
+   size_t n = 0;
+   for (size_t i=0; i<o->nused; i++) {
+      entry_t *e = ENTRY_AT (o->entries, i, o->esize);
+      if (!TOMBSTONE (o, e))
+         memmove (ENTRY_AT (o->entries, n++, o->esize), e, o->esize);
+   }
+
+   if (nalloc != o->nalloc) {
+      uint8_t *tmp = realloc (o->entries, nalloc * o->esize);
+      if (!tmp) {
+         free (index);
+         // Nothing was compacted, so the entries and the old index are
+         // unchanged, but there is still no room for another entry.
+         if (n == o->nalloc)
+            return false;
+         // The compaction has been done, so the old index is useless
+         nalloc = o->nalloc;
+         if (!(index = calloc (o->nindex, sizeof *index)))
+            return false;
+         nindex = o->nindex;
+      } else {
+         o->entries = tmp;
+      }
+   }
+
+   free (o->index);
+   o->index = index;
+   o->nindex = nindex;
+   o->nalloc = nalloc;
+   o->nused = n;
+   o->ndeleted = 0;
+
+   for (size_t i=0; i<n; i++) {
+      ordered_index_add (o, ENTRY_AT (o->entries, i, o->esize)->hash, i);
+   }
+
+   return true;
+}
+
+static bool ordered_init (ordered_t *o, size_t capacity, size_t esize)
+{
+   memset (o, 0, sizeof *o);
+   o->esize = esize;
+   return ordered_rebuild (o, capacity > ORDERED_MIN_ENTRIES ? capacity
+                                                             : ORDERED_MIN_ENTRIES);
+}
+
+static void ordered_clear (ordered_t *o)
+{
+   free (o->entries);
+   free (o->index);
+   memset (o, 0, sizeof *o);
+}
+
+static entry_t *ordered_find (const keyfn_t *kf, const ordered_t *o, uint64_t hash,
+                              const void *k, size_t klen)
+{
+   size_t mask = o->nindex - 1;
+
+   for (size_t i = (size_t)hash & mask; o->index[i]; i = (i + 1) & mask) {
+      entry_t *e = ENTRY_AT (o->entries, o->index[i] - 1, o->esize);
+      if (!TOMBSTONE (o, e) && key_equal (kf, e, hash, k, klen))
+         return e;
+   }
+
+   return NULL;
+}
+
+static entry_t *ordered_new_entry (arena_t *a, ordered_t *o, uint64_t hash,
+                                   const void *k, size_t klen,
+                                   void *d, size_t dlen)
+{
+   if (o->nused == o->nalloc) {
+      size_t nalloc = o->ndeleted >= o->nalloc / 2 ? o->nalloc : o->nalloc * 2;
+      if (!(ordered_rebuild (o, nalloc)))
+         return NULL;
+   }
+
+   if (o->nused >= o->nalloc)
+      return NULL;
+
+   entry_t *e = ENTRY_AT (o->entries, o->nused, o->esize);
+   memset (e, 0, o->esize);
+   if (!(entry_set_key (a, e, k, klen)))
+      return NULL;
+
+   e->hash = hash;
+   entry_set_data (e, o->esize, d, dlen);
+   ordered_index_add (o, hash, o->nused++);
+
+   return e;
+}
+
+static void ordered_remove (arena_t *a, ordered_t *o, entry_t *e)
+{
+   entry_clear (a, e, o->esize);
+   o->ndeleted++;
+}
+
+/* ******************************************************************
+ * The frozen table used by ds_hmap_ENGINE_FROZEN. The whole table is a
+ * single block of memory that contains no pointers, only offsets from
+ * the start of the block:
+ *
+ *    fhdr_t            The header.
+ *    uint32_t[]        A pilot for each bucket of the perfect hash.
+ *    fslot_t[]         A slot for each entry, holding the hash of the
+ *                      key and the offset of the record of the entry.
+ *    records           For each entry the key length and data length
+ *                      (as uint64_t), then the key and then the data,
+ *                      each padded to eight bytes.
+ *
+ * The same block is what ds_hmap_save() writes to a file and what
+ * ds_hmap_open_mmap() maps back into memory, so all the numbers are
+ * fixed-width, in the byte order of the machine that wrote them. The
+ * checksum covers the whole block, with the checksum field itself taken
+ * as zero.
+ *
+ * Keys are first assigned to buckets (about FROZEN_BUCKET_LOAD keys per
+ * bucket). When the table is built a pilot is found for each bucket, in
+ * order of decreasing bucket size, that places all the keys of the
+ * bucket into free slots. A lookup reads the pilot of the bucket of the
+ * key and then examines exactly one slot.
+ */
+#define FROZEN_MAGIC          ("DSHMAPFZ")
+#define FROZEN_VERSION        (1)
+#define FROZEN_BUCKET_LOAD    (4)
+#define FROZEN_MAX_SALTS      (16)
+
+// Set in the header flags when the keys were hashed with a caller-supplied
+// hash function, which must then also be supplied when opening the file.
+#define FROZEN_FLAG_HASHFN    (1u << 0)
+
+// Set in the header flags when the keys are ds_hmap_KEYS_U64 keys.
+#define FROZEN_FLAG_U64       (1u << 1)
+
+typedef struct fhdr_t fhdr_t;
+struct fhdr_t {
+   uint8_t     magic[8];
+   uint32_t    version;
+   uint32_t    flags;
+   uint64_t    size;
+   uint64_t    nentries;
+   uint64_t    nslots;
+   uint64_t    nbuckets;
+   uint64_t    seed;
+   uint64_t    salt;
+   uint64_t    pilots;
+   uint64_t    slots;
+   uint64_t    records;
+   uint64_t    checksum;
+};
+
+typedef struct fslot_t fslot_t;
+struct fslot_t {
+   uint64_t    hash;
+   uint64_t    offset;
+};
+
+typedef struct frozen_t frozen_t;
+struct frozen_t {
+   uint8_t          *blob;
+   const fhdr_t     *hdr;
+   const uint32_t   *pilots;
+   const fslot_t    *slots;
+
+   // The length of the mapping when the blob is a mapped file, zero when
+   // the blob was allocated.
+   size_t            mapped;
+};
+
+#define PAD8(n)      (((n) + 7) & ~(size_t)7)
+
+static uint64_t frozen_mix (uint64_t x)
+{
+   x ^= x >> 33;
+   x *= 0xff51afd7ed558ccdull;
+   x ^= x >> 33;
+   x *= 0xc4ceb9fe1a85ec53ull;
+   x ^= x >> 33;
+   return x;
+}
+
+static size_t frozen_bucket (uint64_t salt, uint64_t nbuckets, uint64_t hash)
+{
+   return (size_t)(frozen_mix (hash ^ salt) % nbuckets);
+}
+
+static size_t frozen_pos (uint64_t salt, uint64_t nslots, uint64_t hash, uint32_t pilot)
+{
+   return (size_t)(frozen_mix (hash + (salt ^ ((uint64_t)pilot * HP1))) % nslots);
+}
+
+// Returns the record of slot idx, setting the key, data and their lengths
+static void frozen_record (const frozen_t *fz, size_t idx,
+                           const void **key, size_t *keylen,
+                           void **data, size_t *datalen)
+{
+   uint8_t *rec = fz->blob + fz->slots[idx].offset;
+   uint64_t klen, dlen;
+
+   memcpy (&klen, rec, sizeof klen);
+   memcpy (&dlen, rec + 8, sizeof dlen);
+
+   *key = rec + 16;
+   *keylen = (size_t)klen;
+   *data = rec + 16 + PAD8 ((size_t)klen);
+   *datalen = (size_t)dlen;
+}
+
+// Returns the index of the slot holding the key or (size_t)-1
+static size_t frozen_find (const keyfn_t *kf, const frozen_t *fz, uint64_t hash,
+                           const void *k, size_t klen)
+{
+   const fhdr_t *hdr = fz->hdr;
+
+   if (!hdr->nentries)
+      return (size_t)-1;
+
+   uint32_t pilot = fz->pilots[frozen_bucket (hdr->salt, hdr->nbuckets, hash)];
+   size_t idx = frozen_pos (hdr->salt, hdr->nslots, hash, pilot);
+
+   if (fz->slots[idx].hash != hash)
+      return (size_t)-1;
+
+   const void *key;
+   void *data;
+   size_t keylen, datalen;
+
+   frozen_record (fz, idx, &key, &keylen, &data, &datalen);
+
+   if (kf->cmpfn)
+      return kf->cmpfn (key, keylen, k, klen) == 0 ? idx : (size_t)-1;
+
+   return keylen == klen && memcmp (key, k, klen) == 0 ? idx : (size_t)-1;
+}
+
+static void frozen_clear (frozen_t *fz)
+{
+#ifndef _WIN32
+   if (fz->mapped)
+      munmap (fz->blob, fz->mapped);
+   else
+#endif
+      free (fz->blob);
+   memset (fz, 0, sizeof *fz);
+}
+
+static uint64_t frozen_checksum (const uint8_t *blob, size_t size)
+{
+   fhdr_t hdr;
+
+   memcpy (&hdr, blob, sizeof hdr);
+   hdr.checksum = 0;
+
+   uint64_t ret = ds_hmap_hashfn (&hdr, sizeof hdr, FROZEN_VERSION);
+   return ds_hmap_hashfn (blob + sizeof hdr, size - sizeof hdr, ret);
+}
+
+// Returns true if size bytes at blob are a well-formed frozen table: the
+// header matches this version, every offset and length lies inside the
+// block and the checksum is correct. Nothing in a block that passes is
+// read from outside the block by a lookup.
+static bool frozen_check (const uint8_t *blob, size_t size)
+{
+   fhdr_t hdr;
+
+   if (size < sizeof hdr)
+      return false;
+
+   memcpy (&hdr, blob, sizeof hdr);
+
+   if (memcmp (hdr.magic, FROZEN_MAGIC, sizeof hdr.magic) != 0
+         || hdr.version != FROZEN_VERSION
+         || hdr.size != size
+         || hdr.nbuckets == 0 || hdr.nbuckets > size / sizeof (uint32_t)
+         || hdr.nslots == 0 || hdr.nslots > size / sizeof (fslot_t)
+         || hdr.nslots != (hdr.nentries ? hdr.nentries : 1)
+         || hdr.pilots != PAD8 (sizeof hdr)
+         || hdr.slots != hdr.pilots + PAD8 (hdr.nbuckets * sizeof (uint32_t))
+         || hdr.records != hdr.slots + hdr.nslots * sizeof (fslot_t)
+         || hdr.records > size)
+      return false;
+
+   if (frozen_checksum (blob, size) != hdr.checksum)
+      return false;
+
+   for (size_t i=0; i<hdr.nentries; i++) {
+      fslot_t slot;
+      uint64_t klen, dlen;
+
+      memcpy (&slot, blob + hdr.slots + i * sizeof slot, sizeof slot);
+      if (slot.offset < hdr.records || slot.offset % 8 || size - slot.offset < 16)
+         return false;
+
+      memcpy (&klen, blob + slot.offset, sizeof klen);
+      memcpy (&dlen, blob + slot.offset + 8, sizeof dlen);
+      uint64_t avail = size - slot.offset - 16;
+      if (klen > avail || PAD8 (klen) > avail || dlen > avail - PAD8 (klen))
+         return false;
+   }
+
+   return true;
+}
+
+// Sets the pointers into the blob from the offsets in the header
+static void frozen_attach (frozen_t *fz, uint8_t *blob)
+{
+   fz->blob = blob;
+   fz->hdr = (const fhdr_t *)blob;
+   fz->pilots = (const uint32_t *)(blob + fz->hdr->pilots);
+   fz->slots = (const fslot_t *)(blob + fz->hdr->slots);
+}
+
+// An entry of the hashmap being frozen
+typedef struct fitem_t fitem_t;
+struct fitem_t {
+   uint64_t       hash;
+   const void    *key;
+   size_t         keylen;
+   const void    *data;
+   size_t         datalen;
+   size_t         bucket;
+};
+
+// Finds a pilot for every bucket, storing the slot of each item in
+// slots. Returns false if no pilots could be found with this salt.
+static bool frozen_place (fitem_t *items, size_t nitems, size_t nbuckets,
+                          uint64_t salt, uint32_t *pilots, size_t *slots)
+{
+   bool error = true;
+
+   size_t *start = calloc (nbuckets + 1, sizeof *start);
+   size_t *order = malloc (nitems * sizeof *order);
+   size_t *byorder = calloc (nbuckets, sizeof *byorder);
+   uint8_t *taken = calloc (nitems, 1);
+   size_t maxsize = 0;
+
+   if (!start || !order || !byorder || !taken)
+      goto errorexit;
+
+   // Group the items by bucket; order[start[b]..start[b+1]] are the
+   // items of bucket b.
+   for (size_t i=0; i<nitems; i++) {
+      items[i].bucket = frozen_bucket (salt, nbuckets, items[i].hash);
+      start[items[i].bucket + 1]++;
+   }
+   for (size_t b=0; b<nbuckets; b++) {
+      if (start[b + 1] > maxsize)
+         maxsize = start[b + 1];
+      start[b + 1] += start[b];
+   }
+   for (size_t i=0; i<nitems; i++) {
+      order[start[items[i].bucket]++] = i;
+   }
+   for (size_t b=nbuckets; b>0; b--) {
+      start[b] = start[b - 1];
+   }
+   start[0] = 0;
+
+   // Sort the buckets by decreasing size
+   size_t n = 0;
+   for (size_t size=maxsize; size>0; size--) {
+      for (size_t b=0; b<nbuckets; b++) {
+         if (start[b + 1] - start[b] == size)
+            byorder[n++] = b;
+      }
+   }
+
+   for (size_t o=0; o<n; o++) {
+      size_t b = byorder[o];
+      size_t first = start[b], last = start[b + 1];
+      uint64_t maxtries = 64 * (uint64_t)nitems + 1024;
+      uint32_t pilot;
+
+      for (pilot=0; pilot<maxtries && pilot<UINT32_MAX; pilot++) {
+         size_t j;
+         for (j=first; j<last; j++) {
+            size_t pos = frozen_pos (salt, nitems, items[order[j]].hash, pilot);
+            if (taken[pos])
+               break;
+            taken[pos] = 1;
+            slots[order[j]] = pos;
+         }
+         if (j == last)
+            break;
+         // Undo the slots taken by this pilot
+         while (j-- > first) {
+            taken[slots[order[j]]] = 0;
+         }
+      }
+
+      if (pilot == maxtries || pilot == UINT32_MAX)
+         goto errorexit;
+
+      pilots[b] = pilot;
+   }
+
+   error = false;
+
+errorexit:
+
+   free (start);
+   free (order);
+   free (byorder);
+   free (taken);
+
+   return !error;
+}
+
+static int cmp_hash (const void *a, const void *b)
+{
+   uint64_t ha = *(const uint64_t *)a, hb = *(const uint64_t *)b;
+   return ha < hb ? -1 : ha > hb ? 1 : 0;
+}
+
+// Builds the blob for the items; on failure returns NULL and sets *err
+static uint8_t *frozen_build (fitem_t *items, size_t nitems, uint64_t seed,
+                              uint32_t flags, ds_hmap_error_t *err)
+{
+   uint8_t *blob = NULL;
+   uint32_t *pilots = NULL;
+   size_t *slots = NULL;
+   uint64_t *hashes = NULL;
+   size_t nbuckets = nitems / FROZEN_BUCKET_LOAD + 1;
+   size_t nslots = nitems ? nitems : 1;
+   uint64_t salt = 0;
+   bool placed = false;
+
+   *err = ds_hmap_EOOM;
+
+   if (!(pilots = calloc (nbuckets, sizeof *pilots))
+         || !(slots = calloc (nslots, sizeof *slots)))
+      goto errorexit;
+
+   // Two keys with the same hash can never be separated by a pilot. This
+   // is only possible with a caller-supplied hash function.
+   if (!(hashes = malloc (nslots * sizeof *hashes)))
+      goto errorexit;
+   for (size_t i=0; i<nitems; i++) {
+      hashes[i] = items[i].hash;
+   }
+   qsort (hashes, nitems, sizeof *hashes, cmp_hash);
+   for (size_t i=1; i<nitems; i++) {
+      if (hashes[i] == hashes[i - 1]) {
+         *err = ds_hmap_EBADPARAM;
+         goto errorexit;
+      }
+   }
+
+   for (size_t s=0; s<FROZEN_MAX_SALTS && !placed; s++) {
+      salt = frozen_mix (seed + s + 1);
+      memset (pilots, 0, nbuckets * sizeof *pilots);
+      placed = frozen_place (items, nitems, nbuckets, salt, pilots, slots);
+   }
+
+   if (!placed) {
+      *err = ds_hmap_EBADPARAM;
+      goto errorexit;
+   }
+
+   size_t off_pilots = PAD8 (sizeof (fhdr_t));
+   size_t off_slots = off_pilots + PAD8 (nbuckets * sizeof *pilots);
+   size_t off_records = off_slots + nslots * sizeof (fslot_t);
+   size_t size = off_records;
+
+   for (size_t i=0; i<nitems; i++) {
+      size += 16 + PAD8 (items[i].keylen) + PAD8 (items[i].datalen);
+   }
+
+   if (!(blob = calloc (1, size)))
+      goto errorexit;
+
+   fhdr_t hdr;
+   memset (&hdr, 0, sizeof hdr);
+   memcpy (hdr.magic, FROZEN_MAGIC, sizeof hdr.magic);
+   hdr.version = FROZEN_VERSION;
+   hdr.flags = flags;
+   hdr.size = size;
+   hdr.nentries = nitems;
+   hdr.nslots = nslots;
+   hdr.nbuckets = nbuckets;
+   hdr.seed = seed;
+   hdr.salt = salt;
+   hdr.pilots = off_pilots;
+   hdr.slots = off_slots;
+   hdr.records = off_records;
+   memcpy (blob, &hdr, sizeof hdr);
+
+   memcpy (blob + off_pilots, pilots, nbuckets * sizeof *pilots);
+
+   size_t off = off_records;
+   for (size_t i=0; i<nitems; i++) {
+      fslot_t slot = { items[i].hash, off };
+      uint64_t klen = items[i].keylen, dlen = items[i].datalen;
+
+      memcpy (blob + off_slots + slots[i] * sizeof slot, &slot, sizeof slot);
+      memcpy (blob + off, &klen, sizeof klen);
+      memcpy (blob + off + 8, &dlen, sizeof dlen);
+      memcpy (blob + off + 16, items[i].key, items[i].keylen);
+      off += 16 + PAD8 (items[i].keylen);
+      if (items[i].datalen)
+         memcpy (blob + off, items[i].data, items[i].datalen);
+      off += PAD8 (items[i].datalen);
+   }
+
+   hdr.checksum = frozen_checksum (blob, size);
+   memcpy (blob, &hdr, sizeof hdr);
+
+   *err = ds_hmap_ENONE;
+
+errorexit:
+
+   free (pilots);
+   free (slots);
+   free (hashes);
+
+   return blob;
+}
+
+// The number of buckets moved from the old table to the new table on
+// each call to ds_hmap_set() and ds_hmap_remove() while a rehash is in
+// progress. ds_hmap_get() never moves entries, so that the key pointers
+// returned by ds_hmap_keys() remain valid while the hashmap is read.
+#define REHASH_STEP     (8)
+
+// The number of keys that are hashed and prefetched together by
+// ds_hmap_get_many() and ds_hmap_set_many().
+#define BATCH_LEN       (16)
+
+// The number of bins in the histogram of bucket sizes.
+#define HIST_LEN        (32)
+
+/* ******************************************************************
+ * The hashmap itself. While a rehash is in progress tables[1] is the
+ * table being grown into and all buckets in tables[0] before rehash_idx
+ * have already been moved into it.
+ */
+struct ds_hmap_t {
+   int               errnum;
+   char             *errmsg;
+
+   float             max_load;
+   ds_hmap_rehash_t  rehash;
+   ds_hmap_engine_t  engine;
+   keyfn_t           kf;
+   size_t            esize;
+   // Incremented whenever entries are moved (see ds_hmap_generation())
+   uint64_t          generation;
+
+   size_t            nentries;
+   size_t            rehash_idx;
+   table_t           tables[2];
+   flat_t            flat;
+   ordered_t         ordered;
+   frozen_t          frozen;
+   arena_t           arena;
+
+   // The optional filter of the hashes of all the keys that were added
+   // (see ds_hmap_attach_bloom()), sized for bloom_capacity keys. Keys
+   // that are removed stay in the filter until it is rebuilt.
+   ds_bloom_t       *bloom;
+   double            bloom_fp;
+   size_t            bloom_capacity;
+   size_t            bloom_nadded;
+
+   // Running bucket statistics for the chained engine: hist[n] is the
+   // number of live buckets holding n entries (the last bin holds all the
+   // larger buckets) and sumsq is the sum of the squares of the sizes of
+   // all the live buckets.
+   size_t            hist[HIST_LEN];
+   size_t            sumsq;
+};
+
+#define REHASHING(hm)      ((hm)->tables[1].buckets != NULL)
+#define KEYS_ONLY(hm)      ((hm)->esize == ENTRY_KEYS_SIZE)
+
+#define HIST_BIN(n)        ((n) < HIST_LEN ? (n) : HIST_LEN - 1)
+
+// Records that a live bucket changed from holding 'from' entries to
+// holding 'to' entries.
+static void hist_resize (ds_hmap_t *hm, size_t from, size_t to)
+{
+   hm->hist[HIST_BIN (from)]--;
+   hm->hist[HIST_BIN (to)]++;
+   hm->sumsq = hm->sumsq - from * from + to * to;
+}
+
+static void rehash_finish (ds_hmap_t *hm)
+{
+   free (hm->tables[0].buckets);
+   hm->tables[0] = hm->tables[1];
+   memset (&hm->tables[1], 0, sizeof hm->tables[1]);
+   hm->rehash_idx = 0;
+}
+
+// Move up to nsteps buckets from the old table into the new table. On
+// allocation failure the partially moved bucket is left in place and the
+// rehash is retried on the next step.
+static bool rehash_step (ds_hmap_t *hm, size_t nsteps)
+{
+   if (!REHASHING (hm))
+      return true;
+
+   table_t *src = &hm->tables[0];
+   table_t *dst = &hm->tables[1];
+
+   hm->generation++;
+
+   while (nsteps-- && hm->rehash_idx < src->nbuckets) {
+      bucket_t *b = &src->buckets[hm->rehash_idx];
+      for (size_t i=0; i<b->alen; i++) {
+         entry_t *e = ENTRY_AT (b->elems, i, hm->esize);
+         if (!e->keylen)
+            continue;
+         bucket_t *db = &dst->buckets[e->hash % dst->nbuckets];
+         if (!(bucket_move_entry (db, hm->esize, e)))
+            return false;
+         hist_resize (hm, db->nelems - 1, db->nelems);
+         hist_resize (hm, b->nelems, b->nelems - 1);
+         b->nelems--;
+      }
+      free (b->elems);
+      memset (b, 0, sizeof *b);
+      // The emptied bucket is no longer live
+      hm->hist[0]--;
+      hm->rehash_idx++;
+   }
+
+   if (hm->rehash_idx >= src->nbuckets)
+      rehash_finish (hm);
+
+   return true;
+}
+
+// Called before an insertion to start (and, for the IMMEDIATE policy,
+// complete) a rehash when the load factor would exceed the maximum.
+static bool rehash_check (ds_hmap_t *hm)
+{
+   if (hm->rehash == ds_hmap_REHASH_NONE)
+      return true;
+
+   table_t *cur = REHASHING (hm) ? &hm->tables[1] : &hm->tables[0];
+   if ((float)(hm->nentries + 1) <= hm->max_load * (float)cur->nbuckets)
+      return true;
+
+   // Cannot grow again while still moving entries into the new table;
+   // complete the current rehash before starting the next one.
+   if (REHASHING (hm) && !(rehash_step (hm, (size_t)-1)))
+      return false;
+
+   if (!(table_init (&hm->tables[1], hm->tables[0].nbuckets * 2)))
+      return false;
+
+   hm->hist[0] += hm->tables[1].nbuckets;
+
+   hm->rehash_idx = 0;
+
+   if (hm->rehash == ds_hmap_REHASH_IMMEDIATE)
+      return rehash_step (hm, (size_t)-1);
+
+   return true;
+}
+
+#ifdef __GNUC__
+#define PREFETCH(addr)     __builtin_prefetch (addr)
+#else
+#define PREFETCH(addr)     ((void)(addr))
+#endif
+
+// Prefetches the memory that hmap_find() reads for the hash. In stage 0
+// the control bytes and slots (flat), the bucket (chained), the index
+// slot (ordered) or the pilot (frozen) are fetched. The entries of a
+// chained bucket, the entry of an ordered index slot and the slot of a
+// frozen key can only be found once the first line is in the cache, so
+// they are fetched in stage 1.
+static void hmap_prefetch (ds_hmap_t *hm, uint64_t hash, int stage)
+{
+   if (hm->engine == ds_hmap_ENGINE_FROZEN) {
+      const fhdr_t *hdr = hm->frozen.hdr;
+      if (!hdr->nentries)
+         return;
+      size_t b = frozen_bucket (hdr->salt, hdr->nbuckets, hash);
+      if (stage == 0)
+         PREFETCH (&hm->frozen.pilots[b]);
+      else
+         PREFETCH (&hm->frozen.slots[frozen_pos (hdr->salt, hdr->nslots, hash,
+                                                 hm->frozen.pilots[b])]);
+      return;
+   }
+
+   if (hm->engine == ds_hmap_ENGINE_ORDERED) {
+      const ordered_t *o = &hm->ordered;
+      size_t i = (size_t)hash & (o->nindex - 1);
+      if (stage == 0)
+         PREFETCH (&o->index[i]);
+      else if (o->index[i])
+         PREFETCH (ENTRY_AT (o->entries, o->index[i] - 1, o->esize));
+      return;
+   }
+
+   if (hm->engine == ds_hmap_ENGINE_FLAT) {
+      if (stage == 0) {
+         size_t gmask = hm->flat.nslots / DS_HMAP_GROUP_WIDTH - 1;
+         size_t idx = (DS_HMAP_H1 (hash) & gmask) * DS_HMAP_GROUP_WIDTH;
+         PREFETCH (&hm->flat.ctrl[idx]);
+         PREFETCH (ENTRY_AT (hm->flat.slots, idx, hm->esize));
+      }
+      return;
+   }
+
+   // Buckets of the old table that were already moved are empty
+   table_t *t = &hm->tables[0];
+   size_t idx = hash % t->nbuckets;
+   if (REHASHING (hm) && idx < hm->rehash_idx) {
+      t = &hm->tables[1];
+      idx = hash % t->nbuckets;
+   }
+
+   if (stage == 0)
+      PREFETCH (&t->buckets[idx]);
+   else if (t->buckets[idx].elems)
+      PREFETCH (t->buckets[idx].elems);
+}
+
+// Find the entry, checking the old table before the new table during a
+// rehash. On success the bucket holding the entry is stored in *bucket
+// (the flat and ordered engines have no buckets and leave *bucket
+// unchanged).
+static entry_t *hmap_find (ds_hmap_t *hm, uint64_t hash,
+                           const void *key, size_t keylen,
+                           bucket_t **bucket)
+{
+   if (hm->bloom && !(ds_bloom_check_hash (hm->bloom, hash)))
+      return NULL;
+
+   if (hm->engine == ds_hmap_ENGINE_FLAT) {
+      size_t idx = flat_find (&hm->kf, &hm->flat, hash, key, keylen);
+      return idx == (size_t)-1 ? NULL : ENTRY_AT (hm->flat.slots, idx, hm->esize);
+   }
+
+   if (hm->engine == ds_hmap_ENGINE_ORDERED)
+      return ordered_find (&hm->kf, &hm->ordered, hash, key, keylen);
+
+   for (size_t i=0; i<2; i++) {
+      table_t *t = &hm->tables[i];
+      if (!t->buckets)
+         break;
+      bucket_t *b = &t->buckets[hash % t->nbuckets];
+      entry_t *e = bucket_find_entry (&hm->kf, b, hm->esize, hash, key, keylen);
+      if (e) {
+         if (bucket)
+            *bucket = b;
+         return e;
+      }
+   }
+
+   return NULL;
+}
+
+// Finds the data of the key in any engine
+static bool hmap_lookup (ds_hmap_t *hm, uint64_t hash,
+                         const void *key, size_t keylen,
+                         void **data, size_t *datalen)
+{
+   if (hm->engine == ds_hmap_ENGINE_FROZEN) {
+      size_t idx = frozen_find (&hm->kf, &hm->frozen, hash, key, keylen);
+      if (idx == (size_t)-1)
+         return false;
+
+      const void *k;
+      size_t klen;
+      frozen_record (&hm->frozen, idx, &k, &klen, data, datalen);
+      return true;
+   }
+
+   const entry_t *e = hmap_find (hm, hash, key, keylen, NULL);
+   if (!e)
+      return false;
+
+   entry_data (e, hm->esize, data, datalen);
+   return true;
+}
+
+ds_hmap_t *ds_hmap_new (size_t nbuckets)
+{
+   ds_hmap_config_t config = { .capacity = nbuckets };
+
+   return nbuckets ? ds_hmap_new_ex (&config) : NULL;
+}
+
+ds_hmap_t *ds_hmap_new_ex (const ds_hmap_config_t *config)
+{
+   bool error = true;
+   ds_hmap_t *ret = NULL;
+   static const ds_hmap_config_t defaults;
+
+   if (!config)
+      config = &defaults;
+
+   if (config->max_load < 0.0f)
+      goto errorexit;
+
+   if (!(ret = malloc (sizeof *ret)))
+      goto errorexit;
+
+   memset (ret, 0, sizeof *ret);
+
+   size_t capacity = config->capacity ? config->capacity : DS_HMAP_DEFAULT_CAPACITY;
+
+   ret->max_load = config->max_load > 0.0f ? config->max_load : DS_HMAP_DEFAULT_LOAD;
+   ret->rehash = config->rehash;
+   ret->engine = config->engine;
+   ret->kf.seed = config->seed ? config->seed : process_seed ();
+   ret->kf.hashfn = config->hashfn;
+   ret->kf.cmpfn = config->cmpfn;
+   ret->esize = config->keys_only ? ENTRY_KEYS_SIZE : sizeof (entry_t);
+
+   switch (config->keys) {
+      case ds_hmap_KEYS_BYTES:
+         break;
+
+      case ds_hmap_KEYS_U64:
+         if (config->hashfn || config->cmpfn)
+            goto errorexit;
+         ret->kf.u64 = true;
+         break;
+
+      default:
+         goto errorexit;
+   }
+
+   switch (ret->engine) {
+      case ds_hmap_ENGINE_CHAINED:
+         if (!(table_init (&ret->tables[0], capacity)))
+            goto errorexit;
+         ret->hist[0] = capacity;
+         break;
+
+      case ds_hmap_ENGINE_FLAT:
+         if (config->max_load <= 0.0f)
+            ret->max_load = FLAT_DEFAULT_LOAD;
+         if (ret->max_load > FLAT_MAX_LOAD)
+            ret->max_load = FLAT_MAX_LOAD;
+         if (!(flat_init (&ret->flat, capacity, ret->esize)))
+            goto errorexit;
+         break;
+
+      case ds_hmap_ENGINE_ORDERED:
+         if (!(ordered_init (&ret->ordered, capacity, ret->esize)))
+            goto errorexit;
+         break;
+
+      default:
+         goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+   if (error) {
+      ds_hmap_del (ret);
+      ret = NULL;
+   }
+
+   return ret;
+}
+
+void ds_hmap_del (ds_hmap_t *hm)
+{
+   if (!hm)
+      return;
+
+   table_clear (&hm->tables[0]);
+   table_clear (&hm->tables[1]);
+   flat_clear (&hm->flat);
+   ordered_clear (&hm->ordered);
+   frozen_clear (&hm->frozen);
+   arena_clear (&hm->arena);
+   ds_bloom_del (hm->bloom);
+   free (hm);
+}
+
+static const char *find_errmsg (ds_hmap_error_t code)
+{
+   static const struct {
+      ds_hmap_error_t   code;
+      const char       *msg;
+   } msgs[] = {
+      { ds_hmap_ENONE,       "Success"             },
+      { ds_hmap_ENULLOBJ,    "Null Object"         },
+      { ds_hmap_EOOM,        "Out of memory"       },
+      { ds_hmap_ENOTFOUND,   "Object not found"    },
+      { ds_hmap_EBADPARAM,   "Invalid parameter"   },
+      { ds_hmap_EREADONLY,   "Hashmap is frozen"   },
+      { ds_hmap_EIO,         "File error"          },
+   };
+
+   static const size_t nmsgs = sizeof msgs / sizeof msgs[0];
+
+   for (size_t i=0; i<nmsgs; i++) {
+      if (msgs[i].code == code)
+         return msgs[i].msg;
+   }
+
+   return "Unknown error code";
+}
+
+void ds_hmap_lasterr (ds_hmap_t *hm,
+                      ds_hmap_error_t *err, const char **errmsg)
+{
+   if (!err && !errmsg)
+      return;
+
+   if (!hm) {
+      if (err)    *err = ds_hmap_ENULLOBJ;
+      if (errmsg) *errmsg = find_errmsg (ds_hmap_ENULLOBJ);
+      return;
+   }
+
+   if (err)    *err = hm->errnum;
+   if (errmsg) *errmsg = find_errmsg (hm->errnum);
+}
+
+static void hmap_bloom_add (ds_hmap_t *hm, uint64_t hash);
+
+// Sets the key, which has already been hashed. Returns the entry on
+// success; on error the errnum is set and NULL is returned.
+static entry_t *hmap_set (ds_hmap_t *hm, uint64_t hash,
+                          const void *key, size_t keylen,
+                          void *data, size_t datalen)
+{
+   entry_t *e = NULL;
+   bool added = false;
+
+   if (hm->engine == ds_hmap_ENGINE_FROZEN) {
+      hm->errnum = ds_hmap_EREADONLY;
+      return NULL;
+   }
+
+   if (hm->kf.u64 && keylen != sizeof (uint64_t)) {
+      hm->errnum = ds_hmap_EBADPARAM;
+      return NULL;
+   }
+
+   if (!(rehash_step (hm, REHASH_STEP))) {
+      hm->errnum = ds_hmap_EOOM;
+      return NULL;
+   }
+
+   // Existing keys are updated in whichever table they are in, new keys
+   // always go into the newest table.
+   if ((e = hmap_find (hm, hash, key, keylen, NULL))) {
+      entry_set_data (e, hm->esize, data, datalen);
+      return e;
+   }
+
+   if (hm->engine == ds_hmap_ENGINE_ORDERED) {
+      // The entries are compacted or moved when the array is rebuilt
+      const uint8_t *entries = hm->ordered.entries;
+      size_t nused = hm->ordered.nused;
+      e = ordered_new_entry (&hm->arena, &hm->ordered, hash, key, keylen,
+                             data, datalen);
+      if (hm->ordered.entries != entries || hm->ordered.nused != nused + 1)
+         hm->generation++;
+      if (!e) {
+         hm->errnum = ds_hmap_EOOM;
+         return NULL;
+      }
+      hm->nentries++;
+      hmap_bloom_add (hm, hash);
+      return e;
+   }
+
+   if (hm->engine == ds_hmap_ENGINE_FLAT) {
+      const uint8_t *slots = hm->flat.slots;
+      bool reserved = flat_reserve (&hm->flat, hm->nentries, hm->max_load);
+      if (hm->flat.slots != slots)
+         hm->generation++;
+      if (!reserved
+            || !(e = flat_new_entry (&hm->arena, &hm->flat, hash, key, keylen, data, datalen))) {
+         hm->errnum = ds_hmap_EOOM;
+         return NULL;
+      }
+      hm->nentries++;
+      hmap_bloom_add (hm, hash);
+      return e;
+   }
+
+   if (!(rehash_check (hm))) {
+      hm->errnum = ds_hmap_EOOM;
+      return NULL;
+   }
+
+   table_t *t = REHASHING (hm) ? &hm->tables[1] : &hm->tables[0];
+   bucket_t *b = &t->buckets[hash % t->nbuckets];
+   const uint8_t *elems = b->elems;
+
+   e = bucket_set (&hm->kf, &hm->arena, b, hm->esize, hash, key, keylen,
+                   data, datalen, &added);
+   // Growing the bucket may have moved its other entries
+   if (b->elems != elems)
+      hm->generation++;
+   if (!e) {
+      hm->errnum = ds_hmap_EOOM;
+      return NULL;
+   }
+
+   if (added) {
+      hist_resize (hm, b->nelems - 1, b->nelems);
+      hm->nentries++;
+      hmap_bloom_add (hm, hash);
+   }
+
+   return e;
+}
+
+const void *ds_hmap_set (ds_hmap_t *hm, const void *key,  size_t keylen,
+                                        void *data, size_t datalen)
+{
+   if (!hm)
+      return NULL;
+
+   if (!key || (!data && !KEYS_ONLY (hm))) {
+      hm->errnum = ds_hmap_EBADPARAM;
+      return NULL;
+   }
+
+   entry_t *e = hmap_set (hm, key_hash (&hm->kf, key, keylen), key, keylen,
+                          data, datalen);
+
+   return e ? entry_key (e) : NULL;
+}
+
+bool ds_hmap_get (ds_hmap_t *hm, const void *key,  size_t keylen,
+                                 void **data,      size_t *datalen)
+{
+   bool error = true;
+
+   if (!hm)
+      return NULL;
+
+   if (!key) {
+      hm->errnum = ds_hmap_EBADPARAM;
+      return NULL;
+   }
+
+   void *d = NULL;
+   size_t dlen = 0;
+
+   if (!(hmap_lookup (hm, key_hash (&hm->kf, key, keylen), key, keylen, &d, &dlen))) {
+      hm->errnum = ds_hmap_ENOTFOUND;
+      goto errorexit;
+   }
+
+   if (data)      (*data)    = d;
+   if (datalen)   (*datalen) = dlen;
+
+   error = false;
+
+errorexit:
+
+   return !error;
+}
+
+uint64_t ds_hmap_hash (const ds_hmap_t *hm, const void *key, size_t keylen)
+{
+   return hm && key ? key_hash (&hm->kf, key, keylen) : 0;
+}
+
+bool ds_hmap_get_hashed (ds_hmap_t *hm, uint64_t hash,
+                         const void *key, size_t keylen,
+                         void **data, size_t *datalen)
+{
+   void *d = NULL;
+   size_t dlen = 0;
+
+   if (!hm)
+      return false;
+
+   if (!key) {
+      hm->errnum = ds_hmap_EBADPARAM;
+      return false;
+   }
+
+   if (!(hmap_lookup (hm, hash, key, keylen, &d, &dlen))) {
+      hm->errnum = ds_hmap_ENOTFOUND;
+      return false;
+   }
+
+   if (data)      (*data)    = d;
+   if (datalen)   (*datalen) = dlen;
+
+   return true;
+}
+
+const void *ds_hmap_set_hashed (ds_hmap_t *hm, uint64_t hash,
+                                const void *key, size_t keylen,
+                                void *data, size_t datalen)
+{
+   if (!hm)
+      return NULL;
+
+   if (!key || (!data && !KEYS_ONLY (hm))) {
+      hm->errnum = ds_hmap_EBADPARAM;
+      return NULL;
+   }
+
+   entry_t *e = hmap_set (hm, hash, key, keylen, data, datalen);
+
+   return e ? entry_key (e) : NULL;
+}
+
+// Hashes a batch of keys and prefetches everything that will be probed
+// for them, so that the cache misses of the batch overlap.
+static void hmap_prefetch_batch (ds_hmap_t *hm, uint64_t *hashes,
+                                 const void **keys, const size_t *keylens,
+                                 size_t nkeys)
+{
+   for (size_t i=0; i<nkeys; i++) {
+      hashes[i] = keys[i] ? key_hash (&hm->kf, keys[i], keylens[i]) : 0;
+      hmap_prefetch (hm, hashes[i], 0);
+   }
+
+   if (hm->engine != ds_hmap_ENGINE_FLAT) {
+      for (size_t i=0; i<nkeys; i++) {
+         hmap_prefetch (hm, hashes[i], 1);
+      }
+   }
+}
+
+size_t ds_hmap_get_many (ds_hmap_t *hm, size_t nkeys,
+                         const void **keys, const size_t *keylens,
+                         void **data, size_t *datalens)
+{
+   size_t ret = 0;
+   uint64_t hashes[BATCH_LEN];
+
+   if (!hm)
+      return 0;
+
+   if (!keys || !keylens) {
+      hm->errnum = ds_hmap_EBADPARAM;
+      return 0;
+   }
+
+   for (size_t start=0; start<nkeys; start += BATCH_LEN) {
+      size_t n = nkeys - start < BATCH_LEN ? nkeys - start : BATCH_LEN;
+
+      hmap_prefetch_batch (hm, hashes, &keys[start], &keylens[start], n);
+
+      for (size_t i=0; i<n; i++) {
+         const void *key = keys[start + i];
+         void *d = NULL;
+         size_t dlen = 0;
+
+         if (key && hmap_lookup (hm, hashes[i], key, keylens[start + i], &d, &dlen))
+            ret++;
+
+         if (data)      data[start + i] = d;
+         if (datalens)  datalens[start + i] = dlen;
+      }
+   }
+
+   if (ret < nkeys)
+      hm->errnum = ds_hmap_ENOTFOUND;
+
+   return ret;
+}
+
+size_t ds_hmap_set_many (ds_hmap_t *hm, size_t nkeys,
+                         const void **keys, const size_t *keylens,
+                         void **data, const size_t *datalens)
+{
+   uint64_t hashes[BATCH_LEN];
+
+   if (!hm)
+      return 0;
+
+   if (!keys || !keylens || (!data && !KEYS_ONLY (hm))) {
+      hm->errnum = ds_hmap_EBADPARAM;
+      return 0;
+   }
+
+   for (size_t start=0; start<nkeys; start += BATCH_LEN) {
+      size_t n = nkeys - start < BATCH_LEN ? nkeys - start : BATCH_LEN;
+
+      hmap_prefetch_batch (hm, hashes, &keys[start], &keylens[start], n);
+
+      for (size_t i=0; i<n; i++) {
+         size_t idx = start + i;
+         void *d = data ? data[idx] : NULL;
+
+         if (!keys[idx] || (!d && !KEYS_ONLY (hm))) {
+            hm->errnum = ds_hmap_EBADPARAM;
+            return idx;
+         }
+
+         if (!(hmap_set (hm, hashes[i], keys[idx], keylens[idx],
+                         d, datalens ? datalens[idx] : 0)))
+            return idx;
+      }
+   }
+
+   return nkeys;
+}
+
+/* ******************************************************************
+ * Bulk construction. The keys are hashed in slices of the input, one
+ * slice per thread, and each slice counts how many of its keys fall into
+ * each partition. A partition is a contiguous range of buckets, one per
+ * thread. The counts give every slice its own place in an array of key
+ * indexes grouped by partition, which the slices then fill in, keeping
+ * the input order within each partition. Finally each thread fills the
+ * buckets of its own partition; no bucket and no arena is ever touched by
+ * two threads, so no locking is needed.
+ */
+#define BUILD_MAX_THREADS     (64)
+
+typedef struct build_t build_t;
+struct build_t {
+   ds_hmap_t           *hm;
+   const void         **keys;
+   const size_t        *keylens;
+   void               **data;
+   const size_t        *datalens;
+   size_t               n;
+
+   size_t               nthreads;
+   uint64_t            *hashes;
+   size_t              *order;     // Key indexes, grouped by partition
+   size_t              *pstart;    // Start of each partition in order
+};
+
+typedef struct bworker_t bworker_t;
+struct bworker_t {
+   build_t             *b;
+   size_t               id;
+   void               (*fn) (bworker_t *);
+
+   // The slice of the input, and the number of its keys in each
+   // partition (later the next position in order for each partition).
+   size_t               start;
+   size_t               end;
+   size_t               counts[BUILD_MAX_THREADS];
+
+   // Keys that are too long to store inline are copied into a private
+   // arena, which is handed over to the hashmap at the end.
+   arena_t              arena;
+   size_t               nentries;
+   bool                 error;
+};
+
+static size_t build_partition (const build_t *b, uint64_t hash)
+{
+   const table_t *t = &b->hm->tables[0];
+   return (size_t)((uint64_t)(hash % t->nbuckets) * b->nthreads / t->nbuckets);
+}
+
+static void build_hash (bworker_t *w)
+{
+   build_t *b = w->b;
+
+   for (size_t i=w->start; i<w->end; i++) {
+      if (!b->keys[i] || (b->data ? !b->data[i] : !KEYS_ONLY (b->hm))
+            || (b->hm->kf.u64 && b->keylens[i] != sizeof (uint64_t))) {
+         w->error = true;
+         return;
+      }
+      b->hashes[i] = key_hash (&b->hm->kf, b->keys[i], b->keylens[i]);
+      if (b->hm->engine == ds_hmap_ENGINE_CHAINED)
+         w->counts[build_partition (b, b->hashes[i])]++;
+   }
+}
+
+static void build_scatter (bworker_t *w)
+{
+   build_t *b = w->b;
+
+   for (size_t i=w->start; i<w->end; i++) {
+      b->order[w->counts[build_partition (b, b->hashes[i])]++] = i;
+   }
+}
+
+static void build_fill (bworker_t *w)
+{
+   build_t *b = w->b;
+   table_t *t = &b->hm->tables[0];
+   size_t esize = b->hm->esize;
+   size_t first = b->pstart[w->id];
+   size_t last = b->pstart[w->id + 1];
+
+   // Count the keys in each bucket so that every bucket is allocated
+   // once, at its final size.
+   for (size_t i=first; i<last; i++) {
+      t->buckets[b->hashes[b->order[i]] % t->nbuckets].alen++;
+   }
+
+   for (size_t i=first; i<last; i++) {
+      size_t idx = b->order[i];
+      uint64_t hash = b->hashes[idx];
+      bucket_t *bk = &t->buckets[hash % t->nbuckets];
+
+      if (!bk->elems && !(bk->elems = calloc (bk->alen, esize))) {
+         // The bucket must not claim entries that it does not have
+         bk->alen = 0;
+         w->error = true;
+         return;
+      }
+
+      entry_t *e = bucket_find_entry (&b->hm->kf, bk, esize, hash,
+                                      b->keys[idx], b->keylens[idx]);
+      if (!e) {
+         e = ENTRY_AT (bk->elems, bk->nelems, esize);
+         if (!(entry_set_key (&w->arena, e, b->keys[idx], b->keylens[idx]))) {
+            w->error = true;
+            return;
+         }
+         e->hash = hash;
+         bk->nelems++;
+         w->nentries++;
+      }
+      entry_set_data (e, esize, b->data ? b->data[idx] : NULL,
+                      b->datalens ? b->datalens[idx] : 0);
+   }
+}
+
+static void *build_thread (void *arg)
+{
+   bworker_t *w = arg;
+
+   w->fn (w);
+   return NULL;
+}
+
+// Runs fn on every worker, each on its own thread except the first,
+// which runs on the calling thread. A worker whose thread cannot be
+// started runs on the calling thread too.
+static bool build_run (bworker_t *workers, size_t nworkers, void (*fn) (bworker_t *))
+{
+   pthread_t threads[BUILD_MAX_THREADS];
+   bool started[BUILD_MAX_THREADS] = { false };
+   bool ret = true;
+
+   for (size_t i=0; i<nworkers; i++) {
+      workers[i].fn = fn;
+      if (i > 0)
+         started[i] = pthread_create (&threads[i], NULL, build_thread, &workers[i]) == 0;
+   }
+
+   for (size_t i=0; i<nworkers; i++) {
+      if (!started[i])
+         fn (&workers[i]);
+   }
+
+   for (size_t i=0; i<nworkers; i++) {
+      if (started[i])
+         pthread_join (threads[i], NULL);
+      if (workers[i].error)
+         ret = false;
+   }
+
+   return ret;
+}
+
+// Gives the chunks of a worker arena to the hashmap arena. The hashmap
+// keeps allocating from its own most recent chunk.
+static void build_arena_merge (arena_t *dst, arena_t *src)
+{
+   chunk_t *tail = src->head;
+
+   if (!tail)
+      return;
+
+   while (tail->next)
+      tail = tail->next;
+
+   if (dst->head) {
+      tail->next = dst->head->next;
+      dst->head->next = src->head;
+   } else {
+      dst->head = src->head;
+   }
+   dst->nbytes += src->nbytes;
+   dst->nwasted += src->nwasted;
+   memset (src, 0, sizeof *src);
+}
+
+// Makes the table of a new hashmap large enough for n keys
+static bool build_presize (ds_hmap_t *hm, size_t n)
+{
+   size_t capacity = (size_t)((double)n / (double)hm->max_load) + 1;
+
+   switch (hm->engine) {
+      case ds_hmap_ENGINE_CHAINED:
+         if (capacity <= hm->tables[0].nbuckets)
+            return true;
+         table_clear (&hm->tables[0]);
+         hm->hist[0] = 0;
+         if (!(table_init (&hm->tables[0], capacity)))
+            return false;
+         hm->hist[0] = capacity;
+         return true;
+
+      case ds_hmap_ENGINE_FLAT:
+         if (capacity < hm->flat.nslots)
+            return true;
+         flat_clear (&hm->flat);
+         return flat_init (&hm->flat, capacity + 1, hm->esize);
+
+      case ds_hmap_ENGINE_ORDERED:
+         if (n <= hm->ordered.nalloc)
+            return true;
+         ordered_clear (&hm->ordered);
+         return ordered_init (&hm->ordered, n, hm->esize);
+
+      default:
+         return false;
+   }
+}
+
+ds_hmap_t *ds_hmap_build (size_t n, const void **keys, const size_t *keylens,
+                          void **data, const size_t *datalens,
+                          size_t nthreads)
+{
+   return ds_hmap_build_ex (n, keys, keylens, data, datalens, nthreads, NULL);
+}
+
+ds_hmap_t *ds_hmap_build_ex (size_t n, const void **keys, const size_t *keylens,
+                             void **data, const size_t *datalens,
+                             size_t nthreads, const ds_hmap_config_t *config)
+{
+   bool error = true;
+   build_t b = { .keys = keys, .keylens = keylens,
+                 .data = data, .datalens = datalens, .n = n };
+   bworker_t *workers = NULL;
+
+   if (!keys || !keylens)
+      return NULL;
+
+   if (nthreads < 1)
+      nthreads = 1;
+   if (nthreads > BUILD_MAX_THREADS)
+      nthreads = BUILD_MAX_THREADS;
+   // Threads are not worth starting for a handful of keys each
+   if (nthreads > n / 1024 + 1)
+      nthreads = n / 1024 + 1;
+   b.nthreads = nthreads;
+
+   if (!(b.hm = ds_hmap_new_ex (config)) || (!data && !KEYS_ONLY (b.hm))
+         || !(build_presize (b.hm, n)))
+      goto errorexit;
+
+   ds_hmap_t *hm = b.hm;
+
+   if (!(b.hashes = malloc ((n + 1) * sizeof *b.hashes))
+         || !(workers = calloc (nthreads, sizeof *workers)))
+      goto errorexit;
+
+   for (size_t i=0; i<nthreads; i++) {
+      workers[i].b = &b;
+      workers[i].id = i;
+      workers[i].start = n * i / nthreads;
+      workers[i].end = n * (i + 1) / nthreads;
+   }
+
+   if (!(build_run (workers, nthreads, build_hash)))
+      goto errorexit;
+
+   if (hm->engine != ds_hmap_ENGINE_CHAINED) {
+      // Only the hashing is shared out; the keys are inserted in order,
+      // prefetching a batch ahead.
+      for (size_t i=0; i<n; i++) {
+         if (i + BATCH_LEN < n)
+            hmap_prefetch (hm, b.hashes[i + BATCH_LEN], 0);
+         if (!(hmap_set (hm, b.hashes[i], keys[i], keylens[i],
+                         data ? data[i] : NULL, datalens ? datalens[i] : 0)))
+            goto errorexit;
+      }
+      error = false;
+      goto errorexit;
+   }
+
+   // Turn the per-slice counts into the position of each slice within
+   // each partition.
+   if (!(b.order = malloc ((n + 1) * sizeof *b.order))
+         || !(b.pstart = malloc ((nthreads + 1) * sizeof *b.pstart)))
+      goto errorexit;
+
+   size_t pos = 0;
+   for (size_t p=0; p<nthreads; p++) {
+      b.pstart[p] = pos;
+      for (size_t i=0; i<nthreads; i++) {
+         size_t count = workers[i].counts[p];
+         workers[i].counts[p] = pos;
+         pos += count;
+      }
+   }
+   b.pstart[nthreads] = pos;
+
+   build_run (workers, nthreads, build_scatter);
+
+   bool filled = build_run (workers, nthreads, build_fill);
+
+   for (size_t i=0; i<nthreads; i++) {
+      build_arena_merge (&hm->arena, &workers[i].arena);
+      hm->nentries += workers[i].nentries;
+   }
+
+   if (!filled)
+      goto errorexit;
+
+   // Every bucket started out empty, so the histogram is rebuilt from
+   // scratch.
+   hm->hist[0] = 0;
+   for (size_t i=0; i<hm->tables[0].nbuckets; i++) {
+      size_t nelems = hm->tables[0].buckets[i].nelems;
+      hm->hist[HIST_BIN (nelems)]++;
+      hm->sumsq += nelems * nelems;
+   }
+
+   error = false;
+
+errorexit:
+
+   free (b.hashes);
+   free (b.order);
+   free (b.pstart);
+
+   if (workers) {
+      for (size_t i=0; i<nthreads; i++) {
+         arena_clear (&workers[i].arena);
+      }
+      free (workers);
+   }
+
+   if (error) {
+      ds_hmap_del (b.hm);
+      b.hm = NULL;
+   }
+
+   return b.hm;
+}
+
+void ds_hmap_iterate (ds_hmap_t *hm, void (*fptr) (const void *key, size_t keylen,
+                                                   void *value, size_t value_len,
+                                                   void *extra_param),
+                                     void *extra_param)
+{
+   ds_hmap_iter_t it;
+
+   if (!hm || !fptr)
+      return;
+
+   ds_hmap_iter_init (hm, &it);
+   while (ds_hmap_iter_next (&it)) {
+      fptr (it.key, it.keylen, it.data, it.datalen, extra_param);
+   }
+}
+
+/* ******************************************************************
+ * The cursor. For the flat, ordered and frozen engines 'bucket' is the
+ * index of the next slot or entry to examine. For the chained engine
+ * 'table', 'bucket' and 'elem' are the position of the next entry to
+ * examine. Removing the current entry leaves a hole in place, so nothing
+ * after the cursor moves.
+ */
+#define GROUP_MASK      ((((uint32_t)1) << DS_HMAP_GROUP_WIDTH) - 1)
+
+void ds_hmap_iter_init (ds_hmap_t *hm, ds_hmap_iter_t *it)
+{
+   if (!it)
+      return;
+
+   memset (it, 0, sizeof *it);
+   it->hm = hm;
+}
+
+static bool iter_next_flat (ds_hmap_iter_t *it)
+{
+   const flat_t *f = &it->hm->flat;
+
+   while (it->bucket < f->nslots) {
+      size_t g = it->bucket & ~(size_t)(DS_HMAP_GROUP_WIDTH - 1);
+      uint32_t m = ~ds_hmap_group_match_free (&f->ctrl[g]) & GROUP_MASK;
+
+      // Skip the slots in this group that were already visited
+      m &= GROUP_MASK << (it->bucket - g);
+      if (m) {
+         const entry_t *e = ENTRY_AT (f->slots, g + ds_hmap_mask_first (m), f->esize);
+         it->bucket = g + ds_hmap_mask_first (m) + 1;
+         it->key = entry_key (e);
+         it->keylen = e->keylen;
+         entry_data (e, f->esize, &it->data, &it->datalen);
+         return true;
+      }
+      it->bucket = g + DS_HMAP_GROUP_WIDTH;
+   }
+
+   return false;
+}
+
+static bool iter_next_ordered (ds_hmap_iter_t *it)
+{
+   const ordered_t *o = &it->hm->ordered;
+
+   while (it->bucket < o->nused) {
+      const entry_t *e = ENTRY_AT (o->entries, it->bucket++, o->esize);
+      if (TOMBSTONE (o, e))
+         continue;
+      it->key = entry_key (e);
+      it->keylen = e->keylen;
+      entry_data (e, o->esize, &it->data, &it->datalen);
+      return true;
+   }
+
+   return false;
+}
+
+static bool iter_next_frozen (ds_hmap_iter_t *it)
+{
+   const frozen_t *fz = &it->hm->frozen;
+
+   if (it->bucket >= fz->hdr->nentries)
+      return false;
+
+   frozen_record (fz, it->bucket++, &it->key, &it->keylen, &it->data, &it->datalen);
+   return true;
+}
+
+static bool iter_next_chained (ds_hmap_iter_t *it)
+{
+   const ds_hmap_t *hm = it->hm;
+
+   while (it->table < 2 && hm->tables[it->table].buckets) {
+      const table_t *t = &hm->tables[it->table];
+      while (it->bucket < t->nbuckets) {
+         const bucket_t *b = &t->buckets[it->bucket];
+         while (b->nelems && it->elem < b->alen) {
+            const entry_t *e = ENTRY_AT (b->elems, it->elem++, hm->esize);
+            if (!e->keylen)
+               continue;
+            it->key = entry_key (e);
+            it->keylen = e->keylen;
+            entry_data (e, hm->esize, &it->data, &it->datalen);
+            return true;
+         }
+         it->bucket++;
+         it->elem = 0;
+      }
+      it->table++;
+      it->bucket = 0;
+   }
+
+   return false;
+}
+
+bool ds_hmap_iter_next (ds_hmap_iter_t *it)
+{
+   bool ret;
+
+   if (!it || !it->hm)
+      return false;
+
+   switch (it->hm->engine) {
+      case ds_hmap_ENGINE_FLAT:     ret = iter_next_flat (it);     break;
+      case ds_hmap_ENGINE_ORDERED:  ret = iter_next_ordered (it);  break;
+      case ds_hmap_ENGINE_FROZEN:   ret = iter_next_frozen (it);   break;
+      default:                      ret = iter_next_chained (it);  break;
+   }
+
+   if (!ret) {
+      it->key = NULL;
+      it->keylen = 0;
+      it->data = NULL;
+      it->datalen = 0;
+   }
+
+   return ret;
+}
+
+// Returns the stored hash of the current entry of the cursor
+static uint64_t iter_hash (const ds_hmap_iter_t *it)
+{
+   const ds_hmap_t *hm = it->hm;
+
+   switch (hm->engine) {
+      case ds_hmap_ENGINE_FLAT:
+         return ENTRY_AT (hm->flat.slots, it->bucket - 1, hm->esize)->hash;
+      case ds_hmap_ENGINE_ORDERED:
+         return ENTRY_AT (hm->ordered.entries, it->bucket - 1, hm->esize)->hash;
+      case ds_hmap_ENGINE_FROZEN:
+         return hm->frozen.slots[it->bucket - 1].hash;
+      default:
+         return ENTRY_AT (hm->tables[it->table].buckets[it->bucket].elems,
+                          it->elem - 1, hm->esize)->hash;
+   }
+}
+
+ds_hmap_t *ds_hmap_freeze (ds_hmap_t *hm)
+{
+   bool error = true;
+   ds_hmap_t *ret = NULL;
+   fitem_t *items = NULL;
+   uint8_t *blob = NULL;
+   ds_hmap_error_t err = ds_hmap_EOOM;
+   size_t nitems = 0;
+   ds_hmap_iter_t it;
+
+   if (!hm)
+      return NULL;
+
+   if (!(items = malloc ((hm->nentries + 1) * sizeof *items)))
+      goto errorexit;
+
+   ds_hmap_iter_init (hm, &it);
+   while (ds_hmap_iter_next (&it)) {
+      fitem_t *item = &items[nitems++];
+      item->hash = iter_hash (&it);
+      item->key = it.key;
+      item->keylen = it.keylen;
+      item->data = it.data;
+      item->datalen = it.datalen;
+   }
+
+   uint32_t flags = (hm->kf.hashfn ? FROZEN_FLAG_HASHFN : 0)
+                  | (hm->kf.u64 ? FROZEN_FLAG_U64 : 0);
+   if (!(blob = frozen_build (items, nitems, hm->kf.seed, flags, &err)))
+      goto errorexit;
+
+   if (!(ret = calloc (1, sizeof *ret))) {
+      err = ds_hmap_EOOM;
+      goto errorexit;
+   }
+
+   ret->engine = ds_hmap_ENGINE_FROZEN;
+   ret->max_load = 1.0f;
+   ret->kf = hm->kf;
+   ret->nentries = nitems;
+   frozen_attach (&ret->frozen, blob);
+
+   error = false;
+
+errorexit:
+
+   free (items);
+
+   if (error) {
+      free (blob);
+      free (ret);
+      ret = NULL;
+      hm->errnum = err;
+   }
+
+   return ret;
+}
+
+bool ds_hmap_save (ds_hmap_t *hm, const char *path)
+{
+   bool error = true;
+   ds_hmap_t *frozen = NULL;
+   FILE *outf = NULL;
+   bool created = false;
+
+   if (!hm)
+      return false;
+
+   if (!path) {
+      hm->errnum = ds_hmap_EBADPARAM;
+      return false;
+   }
+
+   if (hm->engine != ds_hmap_ENGINE_FROZEN) {
+      if (!(frozen = ds_hmap_freeze (hm)))
+         return false;
+   }
+
+   const frozen_t *fz = frozen ? &frozen->frozen : &hm->frozen;
+
+   hm->errnum = ds_hmap_EIO;
+
+   if (!(outf = fopen (path, "wb")))
+      goto errorexit;
+
+   created = true;
+
+   if (fwrite (fz->blob, 1, (size_t)fz->hdr->size, outf) != fz->hdr->size)
+      goto errorexit;
+
+   if (fclose (outf) != 0) {
+      outf = NULL;
+      goto errorexit;
+   }
+   outf = NULL;
+
+   hm->errnum = ds_hmap_ENONE;
+   error = false;
+
+errorexit:
+
+   if (outf)
+      fclose (outf);
+
+   if (error && created)
+      remove (path);
+
+   ds_hmap_del (frozen);
+
+   return !error;
+}
+
+// Maps (or on Windows, reads) the whole file into memory. Returns NULL on
+// error; on success *mapped is the length of the mapping, or zero if the
+// memory was allocated.
+static uint8_t *load_file (const char *path, size_t *size, size_t *mapped)
+{
+   uint8_t *ret = NULL;
+
+   *size = 0;
+   *mapped = 0;
+
+#ifndef _WIN32
+   int fd = open (path, O_RDONLY);
+   struct stat sb;
+
+   if (fd < 0)
+      return NULL;
+
+   if (fstat (fd, &sb) == 0 && sb.st_size > 0
+         && (uint64_t)sb.st_size <= SIZE_MAX) {
+      void *addr = mmap (NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+         ret = addr;
+         *size = *mapped = (size_t)sb.st_size;
+      }
+   }
+
+   close (fd);
+#else
+   FILE *inf = fopen (path, "rb");
+   long len;
+
+   if (!inf)
+      return NULL;
+
+   if (fseek (inf, 0, SEEK_END) == 0 && (len = ftell (inf)) > 0
+         && fseek (inf, 0, SEEK_SET) == 0
+         && (ret = malloc ((size_t)len))) {
+      if (fread (ret, 1, (size_t)len, inf) == (size_t)len) {
+         *size = (size_t)len;
+      } else {
+         free (ret);
+         ret = NULL;
+      }
+   }
+
+   fclose (inf);
+#endif
+
+   return ret;
+}
+
+ds_hmap_t *ds_hmap_open_mmap (const char *path)
+{
+   return ds_hmap_open_mmap_ex (path, NULL);
+}
+
+ds_hmap_t *ds_hmap_open_mmap_ex (const char *path, const ds_hmap_config_t *config)
+{
+   bool error = true;
+   ds_hmap_t *ret = NULL;
+   frozen_t fz;
+   size_t size = 0;
+   static const ds_hmap_config_t defaults;
+
+   memset (&fz, 0, sizeof fz);
+
+   if (!path)
+      return NULL;
+
+   if (!config)
+      config = &defaults;
+
+   if (!(fz.blob = load_file (path, &size, &fz.mapped)))
+      goto errorexit;
+
+   if (!(frozen_check (fz.blob, size)))
+      goto errorexit;
+
+   frozen_attach (&fz, fz.blob);
+
+   // The file must be read with the hash function it was written with
+   if (!(fz.hdr->flags & FROZEN_FLAG_HASHFN) != !config->hashfn)
+      goto errorexit;
+
+   if (!(ret = calloc (1, sizeof *ret)))
+      goto errorexit;
+
+   ret->engine = ds_hmap_ENGINE_FROZEN;
+   ret->max_load = 1.0f;
+   ret->kf.seed = fz.hdr->seed;
+   ret->kf.hashfn = config->hashfn;
+   ret->kf.cmpfn = config->cmpfn;
+   ret->kf.u64 = fz.hdr->flags & FROZEN_FLAG_U64;
+   ret->nentries = (size_t)fz.hdr->nentries;
+   ret->frozen = fz;
+
+   error = false;
+
+errorexit:
+
+   if (error) {
+      frozen_clear (&fz);
+      free (ret);
+      ret = NULL;
+   }
+
+   return ret;
+}
+
+// Removes an entry found by hmap_find() or by the cursor. The entry is
+// cleared in place; no other entry is moved.
+static void hmap_remove_entry (ds_hmap_t *hm, entry_t *e, bucket_t *b)
+{
+   hm->nentries--;
+
+   if (hm->engine == ds_hmap_ENGINE_FLAT) {
+      flat_remove (&hm->arena, &hm->flat,
+                   (size_t)((uint8_t *)e - hm->flat.slots) / hm->esize);
+      return;
+   }
+
+   if (hm->engine == ds_hmap_ENGINE_ORDERED) {
+      ordered_remove (&hm->arena, &hm->ordered, e);
+      return;
+   }
+
+   entry_clear (&hm->arena, e, hm->esize);
+   hist_resize (hm, b->nelems, b->nelems - 1);
+   b->nelems--;
+}
+
+void ds_hmap_iter_remove (ds_hmap_iter_t *it)
+{
+   if (!it || !it->hm || !it->key)
+      return;
+
+   ds_hmap_t *hm = it->hm;
+
+   if (hm->engine == ds_hmap_ENGINE_FROZEN) {
+      hm->errnum = ds_hmap_EREADONLY;
+      return;
+   }
+
+   if (hm->engine == ds_hmap_ENGINE_FLAT) {
+      hmap_remove_entry (hm, ENTRY_AT (hm->flat.slots, it->bucket - 1, hm->esize), NULL);
+   } else if (hm->engine == ds_hmap_ENGINE_ORDERED) {
+      hmap_remove_entry (hm, ENTRY_AT (hm->ordered.entries, it->bucket - 1, hm->esize),
+                         NULL);
+   } else {
+      bucket_t *b = &hm->tables[it->table].buckets[it->bucket];
+      hmap_remove_entry (hm, ENTRY_AT (b->elems, it->elem - 1, hm->esize), b);
+   }
+
+   // The key was stored in the entry that was removed
+   it->key = NULL;
+   it->keylen = 0;
+}
+
+// Removes the key, which has already been hashed
+static void hmap_remove (ds_hmap_t *hm, uint64_t hash,
+                         const void *key, size_t keylen)
+{
+   if (hm->engine == ds_hmap_ENGINE_FROZEN) {
+      hm->errnum = ds_hmap_EREADONLY;
+      return;
+   }
+
+   rehash_step (hm, REHASH_STEP);
+
+   bucket_t *b = NULL;
+   entry_t *e = hmap_find (hm, hash, key, keylen, &b);
+   if (e)
+      hmap_remove_entry (hm, e, b);
+
+   // Only compacted here, and not when removing through a cursor, so that
+   // entries never move under a cursor.
+   ordered_t *o = &hm->ordered;
+   if (hm->engine == ds_hmap_ENGINE_ORDERED
+         && o->ndeleted > ORDERED_MIN_ENTRIES && o->ndeleted > o->nused / 2) {
+      ordered_rebuild (o, o->nalloc);
+      hm->generation++;
+   }
+}
+
+void ds_hmap_remove (ds_hmap_t *hm, const void *key, size_t keylen)
 {
-   if (!b)
+   if (!hm)
       return;
 
-   for (size_t i=0; i<b->alen; i++) {
-      free (b->elems[i].key);
-      b->elems[i].key = NULL;
-      b->elems[i].keylen = 0;
+   if (!key) {
+      hm->errnum = ds_hmap_EBADPARAM;
+      return;
    }
-   free (b->elems);
-   memset (b, 0, sizeof *b);
+
+   hmap_remove (hm, key_hash (&hm->kf, key, keylen), key, keylen);
 }
 
-static entry_t *bucket_find_entry (bucket_t *b, const void *k, size_t klen)
+/* ******************************************************************
+ * Clearing, reserving and shrinking. Clearing keeps every allocation
+ * (buckets, slots and key chunks) so that refilling the hashmap with a
+ * similar set of keys allocates nothing. Reserving and shrinking move
+ * every entry at once; they are explicit requests, so they resize even
+ * under ds_hmap_REHASH_NONE.
+ */
+
+// Calls fn for every entry in the hashmap
+static void hmap_walk (ds_hmap_t *hm, void (*fn) (entry_t *e, void *param),
+                       void *param)
 {
-   if (!k) {
-      for (size_t i=0; i<b->alen; i++) {
-         if (!b->elems[i].keylen)
-            return &b->elems[i];
+   if (hm->engine == ds_hmap_ENGINE_FLAT) {
+      for (size_t i=0; i<hm->flat.nslots; i++) {
+         if (hm->flat.ctrl[i] >= 0)
+            fn (ENTRY_AT (hm->flat.slots, i, hm->esize), param);
       }
-      return NULL;
+      return;
    }
 
-   for (size_t i=0; i<b->alen; i++) {
-      if (!b->elems[i].keylen)
-         continue;
-      size_t mlen = klen < b->elems[i].keylen ? klen : b->elems[i].keylen;
-      if ((memcmp (b->elems[i].key, k, mlen))==0)
-         return &b->elems[i];
+   if (hm->engine == ds_hmap_ENGINE_ORDERED) {
+      for (size_t i=0; i<hm->ordered.nused; i++) {
+         entry_t *e = ENTRY_AT (hm->ordered.entries, i, hm->esize);
+         if (!TOMBSTONE (&hm->ordered, e))
+            fn (e, param);
+      }
+      return;
    }
 
-   return NULL;
+   for (size_t t=0; t<2; t++) {
+      for (size_t i=0; i<hm->tables[t].nbuckets; i++) {
+         bucket_t *b = &hm->tables[t].buckets[i];
+         for (size_t j=0; j<b->alen; j++) {
+            entry_t *e = ENTRY_AT (b->elems, j, hm->esize);
+            if (e->keylen)
+               fn (e, param);
+         }
+      }
+   }
 }
 
-static entry_t *bucket_new_entry (bucket_t *b, const void *k, size_t klen,
-                                               void *d, size_t dlen)
+static void count_long_key (entry_t *e, void *param)
 {
-   entry_t *ret = NULL;
-
-   entry_t *tmp = realloc (b->elems, (b->alen + 1) * (sizeof *tmp));
-   if (!tmp)
-      return NULL;
+   if (e->keylen > INLINE_KEYLEN)
+      *(size_t *)param += e->keylen;
+}
 
-   b->elems = tmp;
+static void move_long_key (entry_t *e, void *param)
+{
+   if (e->keylen > INLINE_KEYLEN) {
+      void *k = arena_alloc (param, e->keylen);
+      memcpy (k, e->key.ptr, e->keylen);
+      e->key.ptr = k;
+   }
+}
 
-   memset (&b->elems[b->alen], 0, sizeof b->elems[b->alen]);
+// Copies all the long keys into a single chunk of exactly the right
+// size, releasing the space of removed keys and the spare chunks.
+static bool hmap_compact_keys (ds_hmap_t *hm)
+{
+   arena_t *a = &hm->arena;
+   arena_t n;
+   size_t nbytes = 0;
+
+   hmap_walk (hm, count_long_key, &nbytes);
+
+   // Nothing to do when the only chunk holds nothing but live keys
+   if (!a->spare && (!a->head || (!a->head->next && a->head->used == nbytes)))
+      return true;
+
+   memset (&n, 0, sizeof n);
+   if (nbytes) {
+      // Allocates a chunk of at least nbytes, which move_long_key() then
+      // fills from the start.
+      if (!(arena_alloc (&n, nbytes)))
+         return false;
+      n.head->used = 0;
+   }
 
-   if (!(b->elems[b->alen].key = malloc (klen)))
-      return NULL;
+   hmap_walk (hm, move_long_key, &n);
 
-   memcpy (b->elems[b->alen].key, k, klen);
-   b->elems[b->alen].keylen = klen;
-   b->elems[b->alen].data = d;
-   b->elems[b->alen].datalen = dlen;
+   arena_clear (a);
+   *a = n;
+   return true;
+}
 
-   ret = &b->elems[b->alen];
+// Moves every entry of the chained engine into a table of nbuckets
+static bool hmap_retable (ds_hmap_t *hm, size_t nbuckets)
+{
+   // Only one rehash can be in progress at a time
+   if (!(rehash_step (hm, (size_t)-1)) || !(table_init (&hm->tables[1], nbuckets)))
+      return false;
 
-   b->alen++;
-   b->nelems++;
+   hm->hist[0] += nbuckets;
+   hm->rehash_idx = 0;
 
-   return ret;
+   return rehash_step (hm, (size_t)-1);
 }
 
-static entry_t *bucket_set (bucket_t *b, const void *k, size_t klen,
-                                         void *d, size_t dlen)
+// Squeezes the empty entries out of a bucket
+static bool bucket_compact (bucket_t *b, size_t esize)
 {
-   entry_t *e = NULL;
+   size_t n = 0;
 
-   // Look for an existing entry
-   e = bucket_find_entry (b, k, klen);
-   if (!e) {
-      // Doesn't exist, try to find an empty entry
-      e = bucket_find_entry (b, NULL, 0);
-      if (e) {
-         if (!(e->key = malloc (klen)))
-            return NULL;
-         memcpy (e->key, k, klen);
-         e->keylen = klen;
-         b->nelems++;
-      }
+   if (b->nelems == b->alen)
+      return true;
+
+   for (size_t i=0; i<b->alen; i++) {
+      entry_t *e = ENTRY_AT (b->elems, i, esize);
+      if (e->keylen)
+         memmove (ENTRY_AT (b->elems, n++, esize), e, esize);
    }
 
-   if (!e) {
-      // No existing entry and no empty entries, create a new one
-      return bucket_new_entry (b, k, klen, d, dlen);
+   if (!n) {
+      bucket_clear (b);
+      return true;
    }
 
-   e->data = d;
-   e->datalen = dlen;
+   uint8_t *tmp = realloc (b->elems, n * esize);
+   if (!tmp) {
+      // The entries have been moved to the front, so the bucket is still
+      // valid once the rest are marked empty.
+      memset (ENTRY_AT (b->elems, n, esize), 0, (b->alen - n) * esize);
+      return false;
+   }
 
-   return e;
+   b->elems = tmp;
+   b->alen = n;
+   return true;
 }
 
 /* ******************************************************************
- * The hashing functions
+ * The attached Bloom filter. Every key that is added is added to the
+ * filter and hmap_find() returns early for any hash that is not in the
+ * filter, so most misses never touch the table. The filter cannot drop
+ * removed keys, so once as many keys have been added as it was sized for
+ * it is rebuilt from the keys that are left, at twice their number.
  */
+#define BLOOM_MIN_KEYS     (64)
 
-static uint8_t rtab[256] = {
-   0xd2, 0x96, 0xdf, 0x50, 0x07, 0x3a, 0x60,
-   0xf7, 0xe8, 0x2e, 0x4e, 0x71, 0x90, 0xed,
-   0x57, 0x91, 0xf7, 0xb4, 0x22, 0x5d, 0xd8,
-   0x0c, 0xc3, 0xf7, 0x4d, 0x4e, 0xba, 0x62,
-   0x15, 0x18, 0x8f, 0x99, 0xf4, 0xf1, 0x0b,
-   0xe4, 0x82, 0x70, 0xc4, 0x95, 0x2d, 0xc2,
-   0x8b, 0xcf, 0xf1, 0x69, 0x39, 0xfb, 0x8b,
-   0xf2, 0x2a, 0x53, 0xe6, 0xad, 0x66, 0x4b,
-   0xb2, 0x5c, 0x59, 0xe7, 0xcf, 0x3d, 0x35,
-   0x56, 0x5f, 0x65, 0xbd, 0x2b, 0x56, 0xf0,
-   0x3c, 0x25, 0x92, 0xbb, 0xe3, 0x17, 0x85,
-   0xde, 0x4a, 0x54, 0x93, 0xed, 0x5f, 0x0a,
-   0x2f, 0x80, 0xfc, 0xb1, 0x86, 0x0e, 0x9a,
-   0x0f, 0xa6, 0x1e, 0x54, 0xaa, 0x67, 0x1b,
-   0xb3, 0xe7, 0x2d, 0xb0, 0x2b, 0xaa, 0xdc,
-   0x26, 0x17, 0xb1, 0xfb, 0x47, 0xb0, 0x2b,
-   0x04, 0x52, 0x47, 0x86, 0xd4, 0xe1, 0x15,
-   0x80, 0x9d, 0x06, 0xa1, 0x91, 0xe2, 0x3f,
-   0xd2, 0x6a, 0x2f, 0x3e, 0x1d, 0x53, 0x57,
-   0x3e, 0x4c, 0xaa, 0xb2, 0x3f, 0x23, 0x9d,
-   0x44, 0x37, 0x74, 0xf4, 0x7d, 0xbb, 0x7b,
-   0xf7, 0x4e, 0xf0, 0x5d, 0x7f, 0x97, 0x09,
-   0x31, 0x8b, 0x87, 0x4d, 0x90, 0x71, 0x16,
-   0x26, 0xc1, 0xdf, 0xb3, 0x7b, 0x76, 0x9c,
-   0xc4, 0x3a, 0xfb, 0x0c, 0xf0, 0xb8, 0xf5,
-   0xfc, 0x92, 0x03, 0xaa, 0xb3, 0xc2, 0x88,
-   0xbc, 0x78, 0xa2, 0xf1, 0x66, 0x01, 0x9a,
-   0x6d, 0x33, 0xbd, 0x8b, 0x5f, 0xb5, 0x8e,
-   0x0e, 0xd8, 0x04, 0xe3, 0x6c, 0xef, 0xb3,
-   0x99, 0xb9, 0xd8, 0xce, 0x51, 0xd3, 0x37,
-   0x32, 0xd4, 0x40, 0x78, 0xe6, 0x12, 0xbb,
-   0xe6, 0xe7, 0xf9, 0x0c, 0xa3, 0xe1, 0x2f,
-};
+static void bloom_add_entry (entry_t *e, void *param)
+{
+   ds_bloom_add_hash (param, e->hash);
+}
 
-static size_t make_hash (const void *k, size_t klen)
+static bool hmap_bloom_rebuild (ds_hmap_t *hm)
 {
-   const uint8_t *tmp = k;
-   uint32_t ret = 0;
+   size_t capacity = hm->nentries * 2;
+   ds_bloom_t *bloom;
 
-   for (size_t i=0; i<klen; i++) {
-      ret = (ret << 5) + ret;
-      ret = ret ^ *tmp ^ rtab[*tmp];
-      tmp++;
-   }
+   if (capacity < BLOOM_MIN_KEYS)
+      capacity = BLOOM_MIN_KEYS;
 
-   // This did not make a significant difference to the collision rate.
-   // ret *= 2654435761;
-   return ret;
-}
+   if (!(bloom = ds_bloom_new (capacity, hm->bloom_fp)))
+      return false;
 
+   hmap_walk (hm, bloom_add_entry, bloom);
 
-/* ******************************************************************
- * The data structure that stores a collection of bucket_t elements.
- */
-struct ds_hmap_t {
-   int         errnum;
-   char       *errmsg;
+   ds_bloom_del (hm->bloom);
+   hm->bloom = bloom;
+   hm->bloom_capacity = capacity;
+   hm->bloom_nadded = hm->nentries;
 
-   size_t      nbuckets;
-   bucket_t   *buckets;
-};
+   return true;
+}
 
-ds_hmap_t *ds_hmap_new (size_t nbuckets)
+// Adds the hash of a new key. If the filter cannot be rebuilt when it is
+// full it is kept as it is; lookups are still correct, but more of the
+// misses reach the table.
+static void hmap_bloom_add (ds_hmap_t *hm, uint64_t hash)
 {
-   bool error = true;
-   ds_hmap_t *ret = NULL;
-
-   if (!(ret = malloc (sizeof *ret)))
-      goto errorexit;
-
-   memset (ret, 0, sizeof *ret);
+   if (!hm->bloom)
+      return;
 
-   ret->nbuckets = nbuckets;
-   if (!(ret->buckets = malloc ((sizeof *ret->buckets) * nbuckets)))
-      goto errorexit;
+   ds_bloom_add_hash (hm->bloom, hash);
+   if (++hm->bloom_nadded > hm->bloom_capacity)
+      hmap_bloom_rebuild (hm);
+}
 
-   memset (ret->buckets, 0, (sizeof *ret->buckets) * nbuckets);
+bool ds_hmap_attach_bloom (ds_hmap_t *hm, double fp_rate)
+{
+   if (!hm)
+      return false;
 
-   error = false;
+   if (hm->engine == ds_hmap_ENGINE_FROZEN || fp_rate < 0.0 || fp_rate >= 1.0) {
+      hm->errnum = ds_hmap_EBADPARAM;
+      return false;
+   }
 
-errorexit:
-   if (error) {
-      ds_hmap_del (ret);
-      ret = NULL;
+   hm->bloom_fp = fp_rate;
+   if (!(hmap_bloom_rebuild (hm))) {
+      hm->errnum = ds_hmap_EOOM;
+      return false;
    }
 
-   return ret;
+   return true;
 }
 
-void ds_hmap_del (ds_hmap_t *hm)
+void ds_hmap_detach_bloom (ds_hmap_t *hm)
 {
    if (!hm)
       return;
 
-   for (size_t i=0; i<hm->nbuckets; i++) {
-      bucket_clear (&hm->buckets[i]);
-   }
-   free (hm->buckets);
-   free (hm);
+   ds_bloom_del (hm->bloom);
+   hm->bloom = NULL;
 }
 
-static const char *find_errmsg (ds_hmap_error_t code)
+const ds_bloom_t *ds_hmap_bloom (ds_hmap_t *hm)
 {
-   static const struct {
-      ds_hmap_error_t   code;
-      const char       *msg;
-   } msgs[] = {
-      { ds_hmap_ENONE,       "Success"             },
-      { ds_hmap_ENULLOBJ,    "Null Object"         },
-      { ds_hmap_EOOM,        "Out of memory"       },
-      { ds_hmap_ENOTFOUND,   "Object not found"    },
-      { ds_hmap_EBADPARAM,   "Invalid parameter"   },
-   };
-
-   static const size_t nmsgs = sizeof msgs / sizeof msgs[0];
-
-   for (size_t i=0; i<nmsgs; i++) {
-      if (msgs[i].code == code)
-         return msgs[i].msg;
-   }
-
-   return "Unknown error code";
+   return hm ? hm->bloom : NULL;
 }
 
-void ds_hmap_lasterr (ds_hmap_t *hm,
-                      ds_hmap_error_t *err, const char **errmsg)
+bool ds_hmap_clear (ds_hmap_t *hm)
 {
-   if (!err && !errmsg)
-      return;
-
-   if (!hm) {
-      if (err)    *err = ds_hmap_ENULLOBJ;
-      if (errmsg) *errmsg = find_errmsg (ds_hmap_ENULLOBJ);
-      return;
+   if (!hm)
+      return false;
+
+   switch (hm->engine) {
+      case ds_hmap_ENGINE_CHAINED:
+         // Keep the larger table of a rehash in progress
+         if (REHASHING (hm)) {
+            table_clear (&hm->tables[0]);
+            rehash_finish (hm);
+         }
+         for (size_t i=0; i<hm->tables[0].nbuckets; i++) {
+            bucket_t *b = &hm->tables[0].buckets[i];
+            if (b->elems)
+               memset (b->elems, 0, b->alen * hm->esize);
+            b->nelems = 0;
+         }
+         memset (hm->hist, 0, sizeof hm->hist);
+         hm->hist[0] = hm->tables[0].nbuckets;
+         hm->sumsq = 0;
+         break;
+
+      case ds_hmap_ENGINE_FLAT:
+         memset (hm->flat.ctrl, DS_HMAP_CTRL_EMPTY, hm->flat.nslots);
+         hm->flat.nused = 0;
+         break;
+
+      case ds_hmap_ENGINE_ORDERED:
+         memset (hm->ordered.index, 0, hm->ordered.nindex * sizeof *hm->ordered.index);
+         hm->ordered.nused = 0;
+         hm->ordered.ndeleted = 0;
+         break;
+
+      default:
+         hm->errnum = ds_hmap_EREADONLY;
+         return false;
    }
 
-   if (err)    *err = hm->errnum;
-   if (errmsg) *errmsg = find_errmsg (hm->errnum);
+   arena_reset (&hm->arena);
+   hm->nentries = 0;
+   hm->generation++;
+
+   ds_bloom_clear (hm->bloom);
+   hm->bloom_nadded = 0;
+
+   return true;
 }
 
-const void *ds_hmap_set (ds_hmap_t *hm, const void *key,  size_t keylen,
-                                        void *data, size_t datalen)
+bool ds_hmap_reserve (ds_hmap_t *hm, size_t nentries)
 {
-   bool error = true;
-
    if (!hm)
-      return NULL;
+      return false;
+
+   // The table that holds nentries without exceeding the load factor
+   size_t capacity = (size_t)((double)nentries / (double)hm->max_load) + 1;
+   bool ok = true;
+
+   switch (hm->engine) {
+      case ds_hmap_ENGINE_CHAINED: {
+         table_t *cur = REHASHING (hm) ? &hm->tables[1] : &hm->tables[0];
+         if (capacity > cur->nbuckets)
+            ok = hmap_retable (hm, capacity);
+         break;
+      }
 
-   if (!key || !data) {
-      hm->errnum = ds_hmap_EBADPARAM;
-      return NULL;
-   }
+      case ds_hmap_ENGINE_FLAT:
+         if (capacity >= hm->flat.nslots)
+            ok = flat_resize (&hm->flat, capacity + 1);
+         break;
 
-   size_t hash = make_hash (key, keylen) % hm->nbuckets;
-   entry_t *e = NULL;
+      case ds_hmap_ENGINE_ORDERED:
+         if (nentries > hm->ordered.nalloc)
+            ok = ordered_rebuild (&hm->ordered, nentries);
+         break;
 
-   if (!(e = bucket_set (&hm->buckets[hash], key, keylen, data, datalen))) {
-      hm->errnum = ds_hmap_EOOM;
-      goto errorexit;
+      default:
+         hm->errnum = ds_hmap_EREADONLY;
+         return false;
    }
 
-   error = false;
+   hm->generation++;
 
-errorexit:
+   if (!ok)
+      hm->errnum = ds_hmap_EOOM;
 
-   return error ? NULL : e->key;
+   return ok;
 }
 
-bool ds_hmap_get (ds_hmap_t *hm, const void *key,  size_t keylen,
-                                 void **data,      size_t *datalen)
+bool ds_hmap_shrink_to_fit (ds_hmap_t *hm)
 {
-   bool error = true;
-
    if (!hm)
-      return NULL;
+      return false;
+
+   size_t capacity = (size_t)((double)hm->nentries / (double)hm->max_load) + 1;
+   bool ok = true;
+
+   switch (hm->engine) {
+      case ds_hmap_ENGINE_CHAINED: {
+         table_t *cur = REHASHING (hm) ? &hm->tables[1] : &hm->tables[0];
+         if (capacity < cur->nbuckets) {
+            ok = hmap_retable (hm, capacity);
+         } else {
+            ok = rehash_step (hm, (size_t)-1);
+         }
+         // Moving the entries leaves each bucket exactly as long as needed,
+         // but the buckets of a table that was not replaced may have holes.
+         for (size_t i=0; ok && i<hm->tables[0].nbuckets; i++) {
+            ok = bucket_compact (&hm->tables[0].buckets[i], hm->esize);
+         }
+         break;
+      }
 
-   if (!key) {
-      hm->errnum = ds_hmap_EBADPARAM;
-      return NULL;
-   }
+      case ds_hmap_ENGINE_FLAT:
+         ok = flat_resize (&hm->flat, capacity + 1);
+         break;
 
-   size_t hash = make_hash (key, keylen) % hm->nbuckets;
-   const entry_t *entry = NULL;
+      case ds_hmap_ENGINE_ORDERED:
+         ok = ordered_rebuild (&hm->ordered, hm->nentries > ORDERED_MIN_ENTRIES
+                                                ? hm->nentries : ORDERED_MIN_ENTRIES);
+         break;
 
-   if (!(entry = bucket_find_entry (&hm->buckets[hash], key, keylen))) {
-      hm->errnum = ds_hmap_ENOTFOUND;
-      goto errorexit;
+      default:
+         hm->errnum = ds_hmap_EREADONLY;
+         return false;
    }
 
-   if (data)      (*data)    = entry->data;
-   if (datalen)   (*datalen) = entry->datalen;
+   if (ok)
+      ok = hmap_compact_keys (hm);
 
-   error = false;
+   hm->generation++;
 
-errorexit:
+   // A new filter drops the keys that were removed
+   if (ok && hm->bloom)
+      ok = hmap_bloom_rebuild (hm);
 
-   return !error;
+   if (!ok)
+      hm->errnum = ds_hmap_EOOM;
+
+   return ok;
 }
 
-void ds_hmap_iterate (ds_hmap_t *hm, void (*fptr) (const void *key, size_t keylen,
-                                                   void *value, size_t value_len,
-                                                   void *extra_param),
-                                     void *extra_param)
+/* ******************************************************************
+ * Integer keys. In ds_hmap_KEYS_U64 mode the key is hashed directly from
+ * the integer; other hashmaps hash the bytes of the integer as usual.
+ */
+static uint64_t hash_u64 (const ds_hmap_t *hm, const uint64_t *key)
 {
-   if (!hm || !fptr)
-      return;
+   return hm->kf.u64 ? ds_hmap_hash_u64 (*key, hm->kf.seed)
+                     : key_hash (&hm->kf, key, sizeof *key);
+}
 
-   for (size_t i=0; i<hm->nbuckets; i++) {
-      for (size_t j=0; j<hm->buckets[i].nelems; j++) {
-         fptr (hm->buckets[i].elems[j].key, hm->buckets[i].elems[j].keylen,
-               hm->buckets[i].elems[j].data, hm->buckets[i].elems[j].datalen,
-               extra_param);
-      }
+bool ds_hmap_set_u64 (ds_hmap_t *hm, uint64_t key, void *data, size_t datalen)
+{
+   if (!hm)
+      return false;
+
+   if (!data && !KEYS_ONLY (hm)) {
+      hm->errnum = ds_hmap_EBADPARAM;
+      return false;
    }
+
+   return hmap_set (hm, hash_u64 (hm, &key), &key, sizeof key, data, datalen) != NULL;
 }
 
-void ds_hmap_remove (ds_hmap_t *hm, const void *key, size_t keylen)
+bool ds_hmap_get_u64 (ds_hmap_t *hm, uint64_t key, void **data, size_t *datalen)
 {
+   void *d = NULL;
+   size_t dlen = 0;
+
    if (!hm)
-      return;
+      return false;
 
-   if (!key) {
-      hm->errnum = ds_hmap_EBADPARAM;
-      return;
+   if (!(hmap_lookup (hm, hash_u64 (hm, &key), &key, sizeof key, &d, &dlen))) {
+      hm->errnum = ds_hmap_ENOTFOUND;
+      return false;
    }
 
-   size_t hash = make_hash (key, keylen) % hm->nbuckets;
-   entry_t *e = bucket_find_entry (&hm->buckets[hash], key, keylen);
-   if (!e)
+   if (data)      (*data)    = d;
+   if (datalen)   (*datalen) = dlen;
+
+   return true;
+}
+
+void ds_hmap_remove_u64 (ds_hmap_t *hm, uint64_t key)
+{
+   if (!hm)
       return;
 
-   free (e->key);
-   memset (e, 0, sizeof *e);
-   hm->buckets[hash].nelems--;
+   hmap_remove (hm, hash_u64 (hm, &key), &key, sizeof key);
+}
+
+uint64_t ds_hmap_generation (const ds_hmap_t *hm)
+{
+   return hm ? hm->generation : 0;
 }
 
 size_t ds_hmap_keys (ds_hmap_t *hm, void ***keys, size_t **keylens)
@@ -394,15 +3195,11 @@ size_t ds_hmap_keys (ds_hmap_t *hm, void ***keys, size_t **keylens)
       goto errorexit;
    }
 
-   size_t index = 0;
-   for (size_t i=0; i<hm->nbuckets; i++) {
-      for (size_t j=0; j<hm->buckets[i].alen; j++) {
-         if (!hm->buckets[i].elems[j].keylen)
-            continue;
-         k[index] = hm->buckets[i].elems[j].key;
-         kl[index] = hm->buckets[i].elems[j].keylen;
-         index++;
-      }
+   ds_hmap_iter_t it;
+   ds_hmap_iter_init (hm, &it);
+   for (size_t index=0; ds_hmap_iter_next (&it); index++) {
+      k[index] = (void *)it.key;
+      kl[index] = it.keylen;
    }
 
    if (keys) {
@@ -433,9 +3230,86 @@ errorexit:
 }
 
 /* ******************************************************************
- * The statistics functions
+ * The statistics functions. While a rehash is in progress the buckets of
+ * the old table that have already been moved are skipped. For the flat,
+ * ordered and frozen engines each slot (of the index) is a bucket.
  */
 
+static size_t live_buckets (ds_hmap_t *hm)
+{
+   if (hm->engine == ds_hmap_ENGINE_FLAT)
+      return hm->flat.nslots;
+
+   if (hm->engine == ds_hmap_ENGINE_ORDERED)
+      return hm->ordered.nindex;
+
+   if (hm->engine == ds_hmap_ENGINE_FROZEN)
+      return (size_t)hm->frozen.hdr->nslots;
+
+   size_t ret = hm->tables[0].nbuckets;
+   if (REHASHING (hm))
+      ret += hm->tables[1].nbuckets - hm->rehash_idx;
+   return ret;
+}
+
+// Returns the number of entries in live bucket i, 0 <= i < live_buckets()
+static size_t bucket_size (ds_hmap_t *hm, size_t i)
+{
+   if (hm->engine == ds_hmap_ENGINE_FLAT)
+      return hm->flat.ctrl[i] >= 0 ? 1 : 0;
+
+   if (hm->engine == ds_hmap_ENGINE_ORDERED) {
+      const ordered_t *o = &hm->ordered;
+      return o->index[i] && !TOMBSTONE (o, ENTRY_AT (o->entries, o->index[i] - 1,
+                                                      o->esize)) ? 1 : 0;
+   }
+
+   if (hm->engine == ds_hmap_ENGINE_FROZEN)
+      return i < hm->nentries ? 1 : 0;
+
+   if (REHASHING (hm)) {
+      size_t nold = hm->tables[0].nbuckets - hm->rehash_idx;
+      if (i >= nold)
+         return hm->tables[1].buckets[i - nold].nelems;
+      i += hm->rehash_idx;
+   }
+
+   return hm->tables[0].buckets[i].nelems;
+}
+
+// Finds the smallest and largest live bucket from the histogram. Only
+// when either of them is in the last bin are the buckets scanned.
+static void bucket_extremes (ds_hmap_t *hm, size_t *min, size_t *max)
+{
+   size_t nbuckets = live_buckets (hm);
+
+   if (hm->engine != ds_hmap_ENGINE_CHAINED) {
+      *min = hm->nentries < nbuckets ? 0 : 1;
+      *max = hm->nentries ? 1 : 0;
+      return;
+   }
+
+   size_t lo = 0, hi = HIST_LEN - 1;
+   while (lo < HIST_LEN - 1 && !hm->hist[lo])
+      lo++;
+   while (hi > 0 && !hm->hist[hi])
+      hi--;
+
+   *min = lo;
+   *max = hi;
+
+   if (lo < HIST_LEN - 1 && hi < HIST_LEN - 1)
+      return;
+
+   *min = (size_t)-1;
+   *max = 0;
+   for (size_t i=0; i<nbuckets; i++) {
+      size_t n = bucket_size (hm, i);
+      if (n < *min) *min = n;
+      if (n > *max) *max = n;
+   }
+}
+
 float ds_hmap_load (ds_hmap_t *hm)
 {
    if (!hm)
@@ -447,21 +3321,19 @@ float ds_hmap_load (ds_hmap_t *hm)
 }
 
 size_t ds_hmap_num_buckets (ds_hmap_t *hm)
-{
-   return hm ? hm->nbuckets : 0;
-}
-
-size_t ds_hmap_num_entries (ds_hmap_t *hm)
 {
    if (!hm)
       return 0;
 
-   size_t sum = 0;
-   for (size_t i=0; i<hm->nbuckets; i++) {
-      sum += hm->buckets[i].nelems;
-   }
+   if (hm->engine != ds_hmap_ENGINE_CHAINED)
+      return live_buckets (hm);
+
+   return REHASHING (hm) ? hm->tables[1].nbuckets : hm->tables[0].nbuckets;
+}
 
-   return sum;
+size_t ds_hmap_num_entries (ds_hmap_t *hm)
+{
+   return hm ? hm->nentries : 0;
 }
 
 size_t ds_hmap_mean_entries (ds_hmap_t *hm)
@@ -469,7 +3341,7 @@ size_t ds_hmap_mean_entries (ds_hmap_t *hm)
    if (!hm)
       return 0;
 
-   return ds_hmap_num_entries (hm) / ds_hmap_num_buckets (hm);
+   return ds_hmap_num_entries (hm) / live_buckets (hm);
 }
 
 float ds_hmap_stddev_entries (ds_hmap_t *hm)
@@ -477,17 +3349,15 @@ float ds_hmap_stddev_entries (ds_hmap_t *hm)
    if (!hm)
       return 0;
 
-   float avg = ds_hmap_load (hm);
-   float dev = 0.0;
-
-   for (size_t i=0; i<hm->nbuckets; i++) {
-      float diff = avg - (float)(hm->buckets[i].nelems);
-      dev += diff * diff;
-   }
-
-   float stddev = sqrtf (dev / (float)hm->nbuckets);
+   // The variance is the mean of the squares less the square of the
+   // mean. Every bucket of the flat and frozen engines holds zero or one
+   // entries, so the sum of the squares is the number of entries.
+   double nbuckets = (double)live_buckets (hm);
+   double avg = (double)hm->nentries / nbuckets;
+   size_t sumsq = hm->engine != ds_hmap_ENGINE_CHAINED ? hm->nentries : hm->sumsq;
+   double var = (double)sumsq / nbuckets - avg * avg;
 
-   return stddev;
+   return var > 0.0 ? (float)sqrt (var) : 0.0f;
 }
 
 size_t ds_hmap_min_entries (ds_hmap_t *hm)
@@ -495,13 +3365,9 @@ size_t ds_hmap_min_entries (ds_hmap_t *hm)
    if (!hm)
       return 0;
 
-   size_t ret = (size_t)-1;
-
-   for (size_t i=0; i<hm->nbuckets; i++) {
-      if (hm->buckets[i].nelems < ret)
-         ret = hm->buckets[i].nelems;
-   }
-   return ret;
+   size_t min, max;
+   bucket_extremes (hm, &min, &max);
+   return min;
 }
 
 size_t ds_hmap_max_entries (ds_hmap_t *hm)
@@ -509,20 +3375,40 @@ size_t ds_hmap_max_entries (ds_hmap_t *hm)
    if (!hm)
       return 0;
 
-   size_t ret = 0;
-
-   for (size_t i=0; i<hm->nbuckets; i++) {
-      // TODO: Remove this after testing.
-      // printf ("%zu : %zu\n", i, hm->buckets[i].nelems);
-      if (hm->buckets[i].nelems > ret)
-         ret = hm->buckets[i].nelems;
-   }
-   return ret;
+   size_t min, max;
+   bucket_extremes (hm, &min, &max);
+   return max;
 }
 
 size_t ds_hmap_range_entries (ds_hmap_t *hm)
 {
-   return ds_hmap_max_entries (hm) - ds_hmap_min_entries (hm);
+   if (!hm)
+      return 0;
+
+   size_t min, max;
+   bucket_extremes (hm, &min, &max);
+   return max - min;
+}
+
+bool ds_hmap_stats (ds_hmap_t *hm, ds_hmap_stats_t *stats)
+{
+   if (!hm || !stats)
+      return false;
+
+   memset (stats, 0, sizeof *stats);
+
+   stats->nentries = hm->nentries;
+   stats->nbuckets = ds_hmap_num_buckets (hm);
+   stats->load = ds_hmap_load (hm);
+   stats->mean_entries = ds_hmap_mean_entries (hm);
+   stats->stddev_entries = ds_hmap_stddev_entries (hm);
+   bucket_extremes (hm, &stats->min_entries, &stats->max_entries);
+   stats->range_entries = stats->max_entries - stats->min_entries;
+   stats->rehashing = REHASHING (hm);
+   stats->key_bytes = hm->arena.nbytes;
+   stats->wasted_key_bytes = hm->arena.nwasted;
+
+   return true;
 }
 
 void ds_hmap_print_freq (ds_hmap_t *hm, const char *marker, FILE *outf)
@@ -533,8 +3419,9 @@ void ds_hmap_print_freq (ds_hmap_t *hm, const char *marker, FILE *outf)
    if (!outf)
       outf = stdout;
 
-   for (size_t i=0; i<hm->nbuckets; i++) {
-      fprintf (outf, "%s:%zu : %zu\n", marker, i, hm->buckets[i].nelems);
+   size_t nbuckets = live_buckets (hm);
+
+   for (size_t i=0; i<nbuckets; i++) {
+      fprintf (outf, "%s:%zu : %zu\n", marker, i, bucket_size (hm, i));
    }
 }
-
@@ -0,0 +1,604 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "ds_str.h"
+#include "ds_hmap.h"
+#include "ds_hmap_define.h"
+
+/* Benchmarks for the ds_hmap engines. The number of keys can be given as
+ * the first argument, for example:
+ *    ds_hmap_bench.elf 1000000
+ */
+
+#define DEFAULT_NKEYS      (200000)
+#define IN_CACHE_NKEYS     (4096)
+
+static double now (void)
+{
+   struct timespec tp;
+   clock_gettime (CLOCK_MONOTONIC, &tp);
+   return (double)tp.tv_sec + (double)tp.tv_nsec / 1000000000.0;
+}
+
+static uint64_t rng_next (uint64_t *state)
+{
+   uint64_t x = *state;
+   x ^= x << 13;
+   x ^= x >> 7;
+   x ^= x << 17;
+   return *state = x;
+}
+
+static void free_keys (char **keys, size_t nkeys)
+{
+   for (size_t i=0; keys && i<nkeys; i++) {
+      free (keys[i]);
+   }
+   free (keys);
+}
+
+// Creates nkeys keys in a shuffled order; keys with different prefixes
+// never compare equal.
+static char **make_keys (size_t nkeys, const char *prefix)
+{
+   char **ret = calloc (nkeys, sizeof *ret);
+   uint64_t state = 0x9e3779b97f4a7c15;
+
+   if (!ret)
+      return NULL;
+
+   for (size_t i=0; i<nkeys; i++) {
+      if (!(ds_str_printf (&ret[i], "%s/%zu/bench-key", prefix, i))) {
+         free_keys (ret, nkeys);
+         return NULL;
+      }
+   }
+
+   for (size_t i=nkeys - 1; i>0; i--) {
+      size_t j = (size_t)(rng_next (&state) % (i + 1));
+      char *tmp = ret[i];
+      ret[i] = ret[j];
+      ret[j] = tmp;
+   }
+
+   return ret;
+}
+
+static void print_result (const char *engine, const char *test,
+                          double elapsed, size_t nops)
+{
+   printf ("%-10s %-16s %10.1f ns/op\n", engine, test,
+           elapsed * 1000000000.0 / (double)nops);
+}
+
+static bool bench_engine (ds_hmap_engine_t engine, const char *name,
+                          char **keys, char **misses, size_t nkeys)
+{
+   bool error = true;
+   ds_hmap_config_t config = { .engine = engine };
+   ds_hmap_t *hm = NULL;
+   size_t nfound = 0;
+   double start;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", name);
+      goto errorexit;
+   }
+
+   start = now ();
+   for (size_t i=0; i<nkeys; i++) {
+      if (!(ds_hmap_set_str_str (hm, keys[i], keys[i]))) {
+         fprintf (stderr, "[%s] Failed to set [%s]\n", name, keys[i]);
+         goto errorexit;
+      }
+   }
+   print_result (name, "insert", now () - start, nkeys);
+
+   start = now ();
+   for (size_t i=0; i<nkeys; i++) {
+      char *data;
+      nfound += ds_hmap_get_str_str (hm, keys[nkeys - i - 1], &data);
+   }
+   print_result (name, "lookup (hits)", now () - start, nkeys);
+
+   start = now ();
+   for (size_t i=0; i<nkeys; i++) {
+      char *data;
+      nfound += ds_hmap_get_str_str (hm, misses[i], &data);
+   }
+   print_result (name, "lookup (misses)", now () - start, nkeys);
+
+   if (nfound != nkeys) {
+      fprintf (stderr, "[%s] Expected %zu keys found, got %zu\n", name, nkeys, nfound);
+      goto errorexit;
+   }
+
+   start = now ();
+   for (size_t i=0; i<nkeys; i++) {
+      ds_hmap_remove_str (hm, keys[i]);
+   }
+   print_result (name, "remove", now () - start, nkeys);
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+
+   return !error;
+}
+
+// Lookups in a frozen copy of a flat hashmap, where each key is found
+// with a single probe.
+static bool bench_frozen (char **keys, char **misses, size_t nkeys)
+{
+   bool error = true;
+   ds_hmap_config_t config = { .engine = ds_hmap_ENGINE_FLAT };
+   ds_hmap_t *hm = NULL;
+   ds_hmap_t *frozen = NULL;
+   size_t nfound = 0;
+   double start;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[frozen] Failed to create hashmap\n");
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nkeys; i++) {
+      if (!(ds_hmap_set_str_str (hm, keys[i], keys[i]))) {
+         fprintf (stderr, "[frozen] Failed to set [%s]\n", keys[i]);
+         goto errorexit;
+      }
+   }
+
+   start = now ();
+   if (!(frozen = ds_hmap_freeze (hm))) {
+      fprintf (stderr, "[frozen] Failed to freeze hashmap\n");
+      goto errorexit;
+   }
+   print_result ("frozen", "freeze", now () - start, nkeys);
+
+   start = now ();
+   for (size_t i=0; i<nkeys; i++) {
+      char *data;
+      nfound += ds_hmap_get_str_str (frozen, keys[nkeys - i - 1], &data);
+   }
+   print_result ("frozen", "lookup (hits)", now () - start, nkeys);
+
+   start = now ();
+   for (size_t i=0; i<nkeys; i++) {
+      char *data;
+      nfound += ds_hmap_get_str_str (frozen, misses[i], &data);
+   }
+   print_result ("frozen", "lookup (misses)", now () - start, nkeys);
+
+   if (nfound != nkeys) {
+      fprintf (stderr, "[frozen] Expected %zu keys found, got %zu\n", nkeys, nfound);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+   ds_hmap_del (frozen);
+
+   return !error;
+}
+
+// Inserts and lookups of integer keys, passed as bytes to a hashmap of
+// byte keys and by value to a hashmap of ds_hmap_KEYS_U64 keys.
+static bool bench_u64 (ds_hmap_engine_t engine, ds_hmap_keys_t keys,
+                       const char *name, size_t nkeys)
+{
+   bool error = true;
+   ds_hmap_config_t config = { .engine = engine, .keys = keys };
+   ds_hmap_t *hm = NULL;
+   size_t nfound = 0;
+   uint64_t state = 1;
+   double start;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", name);
+      goto errorexit;
+   }
+
+   start = now ();
+   for (size_t i=0; i<nkeys; i++) {
+      uint64_t id = i * 0x9e3779b97f4a7c15;
+      bool ok = keys == ds_hmap_KEYS_U64
+              ? ds_hmap_set_u64 (hm, id, hm, 0)
+              : ds_hmap_set (hm, &id, sizeof id, hm, 0) != NULL;
+      if (!ok) {
+         fprintf (stderr, "[%s] Failed to set %zu\n", name, i);
+         goto errorexit;
+      }
+   }
+   print_result (name, "insert", now () - start, nkeys);
+
+   start = now ();
+   for (size_t i=0; i<nkeys; i++) {
+      uint64_t id = (rng_next (&state) % nkeys) * 0x9e3779b97f4a7c15;
+      nfound += keys == ds_hmap_KEYS_U64
+              ? ds_hmap_get_u64 (hm, id, NULL, NULL)
+              : ds_hmap_get (hm, &id, sizeof id, NULL, NULL);
+   }
+   print_result (name, "lookup (random)", now () - start, nkeys);
+
+   if (nfound != nkeys) {
+      fprintf (stderr, "[%s] Expected %zu keys found, got %zu\n", name, nkeys, nfound);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+
+   return !error;
+}
+
+// The keys are generated here, so a fixed seed is safe
+#define ID_HASH(k)         (ds_hmap_hash_u64 ((k), 0))
+#define ID_EQ(a, b)        ((a) == (b))
+
+DS_HMAP_DEFINE (idmap, uint64_t, uint64_t, ID_HASH, ID_EQ)
+
+// The same integer keys as bench_u64() in a generated hashmap, where the
+// values are stored in the table.
+static bool bench_define (size_t nkeys)
+{
+   bool error = true;
+   idmap_t *m = NULL;
+   size_t nfound = 0;
+   uint64_t state = 1;
+   double start;
+
+   if (!(m = idmap_new (0))) {
+      fprintf (stderr, "[generated] Failed to create hashmap\n");
+      goto errorexit;
+   }
+
+   start = now ();
+   for (size_t i=0; i<nkeys; i++) {
+      if (!(idmap_set (m, i * 0x9e3779b97f4a7c15, i))) {
+         fprintf (stderr, "[generated] Failed to set %zu\n", i);
+         goto errorexit;
+      }
+   }
+   print_result ("generated", "insert", now () - start, nkeys);
+
+   start = now ();
+   for (size_t i=0; i<nkeys; i++) {
+      uint64_t id = (rng_next (&state) % nkeys) * 0x9e3779b97f4a7c15;
+      nfound += idmap_get (m, id) != NULL;
+   }
+   print_result ("generated", "lookup (random)", now () - start, nkeys);
+
+   if (nfound != nkeys) {
+      fprintf (stderr, "[generated] Expected %zu keys found, got %zu\n", nkeys, nfound);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   idmap_del (m);
+
+   return !error;
+}
+
+// Lookups of missing keys in a chained hashmap that is not allowed to
+// grow, so that every lookup has to reject a long chain of entries.
+static bool bench_chains (char **keys, char **misses, size_t nkeys)
+{
+   bool error = true;
+   ds_hmap_config_t config = { .capacity = nkeys / 8 + 1,
+                               .rehash = ds_hmap_REHASH_NONE };
+   ds_hmap_t *hm = NULL;
+   size_t nfound = 0;
+   double start;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[chains] Failed to create hashmap\n");
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nkeys; i++) {
+      if (!(ds_hmap_set_str_str (hm, keys[i], keys[i]))) {
+         fprintf (stderr, "[chains] Failed to set [%s]\n", keys[i]);
+         goto errorexit;
+      }
+   }
+
+   start = now ();
+   for (size_t i=0; i<nkeys; i++) {
+      char *data;
+      nfound += ds_hmap_get_str_str (hm, misses[i], &data);
+   }
+   print_result ("chained", "misses (load 8)", now () - start, nkeys);
+
+   if (nfound) {
+      fprintf (stderr, "[chains] Found %zu keys that were never set\n", nfound);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+
+   return !error;
+}
+
+// Looks up keys in a random order, one key at a time and then in batches
+// of BATCH_KEYS keys, in a hashmap of nmap keys. Small hashmaps fit in the
+// cache, so the difference between the two shows the effect of
+// prefetching.
+#define BATCH_KEYS         (64)
+
+static bool bench_batch (ds_hmap_engine_t engine, const char *name,
+                         char **keys, size_t nmap, size_t nops)
+{
+   bool error = true;
+   ds_hmap_config_t config = { .engine = engine };
+   ds_hmap_t *hm = NULL;
+   const void **order = NULL;
+   size_t *keylens = NULL;
+   void *data[BATCH_KEYS];
+   uint64_t state = 0x2545f4914f6cdd1d;
+   size_t nsingle = 0, nbatch = 0;
+   char test[32];
+   double start;
+
+   if (!(hm = ds_hmap_new_ex (&config))
+         || !(order = malloc (nops * sizeof *order))
+         || !(keylens = malloc (nops * sizeof *keylens))) {
+      fprintf (stderr, "[%s] Out of memory\n", name);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nmap; i++) {
+      if (!(ds_hmap_set_str_str (hm, keys[i], keys[i]))) {
+         fprintf (stderr, "[%s] Failed to set [%s]\n", name, keys[i]);
+         goto errorexit;
+      }
+   }
+
+   for (size_t i=0; i<nops; i++) {
+      order[i] = keys[rng_next (&state) % nmap];
+      keylens[i] = strlen (order[i]) + 1;
+   }
+
+   start = now ();
+   for (size_t i=0; i<nops; i++) {
+      nsingle += ds_hmap_get (hm, order[i], keylens[i], NULL, NULL);
+   }
+   snprintf (test, sizeof test, "get %zu", nmap);
+   print_result (name, test, now () - start, nops);
+
+   start = now ();
+   for (size_t i=0; i<nops; i += BATCH_KEYS) {
+      size_t n = nops - i < BATCH_KEYS ? nops - i : BATCH_KEYS;
+      nbatch += ds_hmap_get_many (hm, n, &order[i], &keylens[i], data, NULL);
+   }
+   snprintf (test, sizeof test, "get_many %zu", nmap);
+   print_result (name, test, now () - start, nops);
+
+   if (nsingle != nops || nbatch != nops) {
+      fprintf (stderr, "[%s] Expected %zu keys found, got %zu and %zu\n", name,
+               nops, nsingle, nbatch);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+   free (order);
+   free (keylens);
+
+   return !error;
+}
+
+// Building a hashmap from all the keys at once, compared with setting
+// the keys one at a time.
+static bool bench_build (ds_hmap_engine_t engine, const char *name,
+                         char **keys, size_t nkeys)
+{
+   bool error = true;
+   ds_hmap_config_t config = { .engine = engine };
+   ds_hmap_t *hm = NULL;
+   size_t *keylens = NULL;
+   size_t *datalens = NULL;
+   double start;
+
+   static const size_t nthreads[] = { 1, 2, 4, 8 };
+
+   if (!(keylens = malloc (nkeys * sizeof *keylens))
+         || !(datalens = malloc (nkeys * sizeof *datalens))) {
+      fprintf (stderr, "[%s] Out of memory\n", name);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nkeys; i++) {
+      keylens[i] = datalens[i] = strlen (keys[i]) + 1;
+   }
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", name);
+      goto errorexit;
+   }
+
+   start = now ();
+   for (size_t i=0; i<nkeys; i++) {
+      if (!(ds_hmap_set (hm, keys[i], keylens[i], keys[i], datalens[i]))) {
+         fprintf (stderr, "[%s] Failed to set [%s]\n", name, keys[i]);
+         goto errorexit;
+      }
+   }
+   print_result (name, "set loop", now () - start, nkeys);
+
+   for (size_t i=0; i<sizeof nthreads / sizeof nthreads[0]; i++) {
+      char test[32];
+
+      ds_hmap_del (hm);
+
+      start = now ();
+      if (!(hm = ds_hmap_build_ex (nkeys, (const void **)keys, keylens,
+                                   (void **)keys, datalens, nthreads[i], &config))
+            || ds_hmap_num_entries (hm) != nkeys) {
+         fprintf (stderr, "[%s] Failed to build hashmap\n", name);
+         goto errorexit;
+      }
+      snprintf (test, sizeof test, "build %zu thr", nthreads[i]);
+      print_result (name, test, now () - start, nkeys);
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+   free (keylens);
+   free (datalens);
+
+   return !error;
+}
+
+// Lookups of missing keys with and without an attached filter, and the
+// cost the filter adds to lookups of keys that are present.
+static bool bench_bloom (ds_hmap_engine_t engine, const char *name,
+                         char **keys, char **misses, size_t nkeys)
+{
+   bool error = true;
+   ds_hmap_config_t config = { .engine = engine };
+   ds_hmap_t *hm = NULL;
+   size_t nfound = 0;
+   double start;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", name);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nkeys; i++) {
+      if (!(ds_hmap_set_str_str (hm, keys[i], keys[i]))) {
+         fprintf (stderr, "[%s] Failed to set [%s]\n", name, keys[i]);
+         goto errorexit;
+      }
+   }
+
+   for (size_t pass=0; pass<2; pass++) {
+      const char *suffix = pass ? "+bloom" : "";
+      char test[32];
+
+      if (pass && !(ds_hmap_attach_bloom (hm, 0.01))) {
+         fprintf (stderr, "[%s] Failed to attach a filter\n", name);
+         goto errorexit;
+      }
+
+      start = now ();
+      for (size_t i=0; i<nkeys; i++) {
+         char *data;
+         nfound += ds_hmap_get_str_str (hm, keys[nkeys - i - 1], &data);
+      }
+      snprintf (test, sizeof test, "hits%s", suffix);
+      print_result (name, test, now () - start, nkeys);
+
+      start = now ();
+      for (size_t i=0; i<nkeys; i++) {
+         char *data;
+         nfound += ds_hmap_get_str_str (hm, misses[i], &data);
+      }
+      snprintf (test, sizeof test, "misses%s", suffix);
+      print_result (name, test, now () - start, nkeys);
+   }
+
+   if (nfound != 2 * nkeys) {
+      fprintf (stderr, "[%s] Expected %zu keys found, got %zu\n", name, 2 * nkeys, nfound);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+
+   return !error;
+}
+
+int main (int argc, char **argv)
+{
+   int ret = EXIT_FAILURE;
+   size_t nkeys = DEFAULT_NKEYS;
+   char **keys = NULL;
+   char **misses = NULL;
+
+   if (argc > 1 && (sscanf (argv[1], "%zu", &nkeys) != 1 || nkeys == 0)) {
+      fprintf (stderr, "Invalid number of keys [%s]\n", argv[1]);
+      goto errorexit;
+   }
+
+   if (!(keys = make_keys (nkeys, "hit")) || !(misses = make_keys (nkeys, "miss"))) {
+      fprintf (stderr, "Failed to allocate %zu keys\n", nkeys);
+      goto errorexit;
+   }
+
+   printf ("Benchmarking with %zu keys\n", nkeys);
+
+   if (!(bench_engine (ds_hmap_ENGINE_CHAINED, "chained", keys, misses, nkeys))
+         || !(bench_engine (ds_hmap_ENGINE_FLAT, "flat", keys, misses, nkeys))
+         || !(bench_engine (ds_hmap_ENGINE_ORDERED, "ordered", keys, misses, nkeys))
+         || !(bench_frozen (keys, misses, nkeys))
+         || !(bench_chains (keys, misses, nkeys))) {
+      goto errorexit;
+   }
+
+   size_t nsmall = nkeys < IN_CACHE_NKEYS ? nkeys : IN_CACHE_NKEYS;
+   if (!(bench_batch (ds_hmap_ENGINE_CHAINED, "chained", keys, nsmall, nkeys))
+         || !(bench_batch (ds_hmap_ENGINE_CHAINED, "chained", keys, nkeys, nkeys))
+         || !(bench_batch (ds_hmap_ENGINE_FLAT, "flat", keys, nsmall, nkeys))
+         || !(bench_batch (ds_hmap_ENGINE_FLAT, "flat", keys, nkeys, nkeys))) {
+      goto errorexit;
+   }
+
+   if (!(bench_u64 (ds_hmap_ENGINE_FLAT, ds_hmap_KEYS_BYTES, "flat/bytes", nkeys))
+         || !(bench_u64 (ds_hmap_ENGINE_FLAT, ds_hmap_KEYS_U64, "flat/u64", nkeys))
+         || !(bench_u64 (ds_hmap_ENGINE_CHAINED, ds_hmap_KEYS_BYTES, "chain/bytes", nkeys))
+         || !(bench_u64 (ds_hmap_ENGINE_CHAINED, ds_hmap_KEYS_U64, "chain/u64", nkeys))
+         || !(bench_define (nkeys))) {
+      goto errorexit;
+   }
+
+   if (!(bench_build (ds_hmap_ENGINE_CHAINED, "chained", keys, nkeys))
+         || !(bench_build (ds_hmap_ENGINE_FLAT, "flat", keys, nkeys))) {
+      goto errorexit;
+   }
+
+   if (!(bench_bloom (ds_hmap_ENGINE_CHAINED, "chained", keys, misses, nkeys))
+         || !(bench_bloom (ds_hmap_ENGINE_FLAT, "flat", keys, misses, nkeys))) {
+      goto errorexit;
+   }
+
+   ret = EXIT_SUCCESS;
+
+errorexit:
+
+   free_keys (keys, nkeys);
+   free_keys (misses, nkeys);
+
+   return ret;
+}
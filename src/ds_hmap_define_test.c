@@ -0,0 +1,148 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ds_hmap_define.h"
+
+struct point_t {
+   int x, y;
+};
+
+#define ID_HASH(k)         (ds_hmap_hash_u64 ((k), ds_hmap_process_seed ()))
+#define ID_EQ(a, b)        ((a) == (b))
+#define STR_EQ(a, b)       (strcmp ((a), (b)) == 0)
+
+DS_HMAP_DEFINE (idmap, uint64_t, double, ID_HASH, ID_EQ)
+DS_HMAP_DEFINE (pointmap, const char *, struct point_t, ds_hmap_hash_str, STR_EQ)
+
+#define NKEYS     (100000)
+
+static bool id_test (void)
+{
+   bool error = true;
+   idmap_t *m = NULL;
+   size_t pos = 0;
+   size_t count = 0;
+   uint64_t key;
+   double *value;
+
+   if (!(m = idmap_new (0))) {
+      fprintf (stderr, "Failed to create idmap\n");
+      goto errorexit;
+   }
+
+   for (uint64_t i=0; i<NKEYS; i++) {
+      if (!(idmap_set (m, i * 7, (double)i / 2.0))) {
+         fprintf (stderr, "Failed to set %zu\n", (size_t)i);
+         goto errorexit;
+      }
+   }
+
+   // Replace some of the values and remove others, over and over, so
+   // that deleted slots are reused and dropped.
+   for (size_t round=0; round<3; round++) {
+      for (uint64_t i=0; i<NKEYS; i += 3) {
+         idmap_remove (m, i * 7);
+         if (i + 1 < NKEYS)
+            idmap_set (m, (i + 1) * 7, -1.0);
+      }
+      for (uint64_t i=0; i<NKEYS; i += 3) {
+         idmap_set (m, i * 7, (double)i / 2.0);
+      }
+   }
+
+   for (uint64_t i=0; i<NKEYS; i++) {
+      double expected = i % 3 == 1 ? -1.0 : (double)i / 2.0;
+      if (!(value = idmap_get (m, i * 7)) || *value != expected
+            || idmap_get (m, i * 7 + 1)) {
+         fprintf (stderr, "Wrong result for %zu\n", (size_t)i);
+         goto errorexit;
+      }
+   }
+
+   while (idmap_next (m, &pos, &key, &value)) {
+      if (key % 7 != 0) {
+         fprintf (stderr, "Iterated over unknown key %zu\n", (size_t)key);
+         goto errorexit;
+      }
+      count++;
+   }
+
+   if (count != NKEYS || idmap_num_entries (m) != NKEYS
+         || !(idmap_remove (m, 0)) || idmap_remove (m, 0)
+         || idmap_num_entries (m) != NKEYS - 1) {
+      fprintf (stderr, "Wrong number of entries: %zu\n", count);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   idmap_del (m);
+
+   return !error;
+}
+
+static bool point_test (void)
+{
+   bool error = true;
+   pointmap_t *m = NULL;
+   struct point_t *p;
+   char key[20];
+
+   if (!(m = pointmap_new (16))) {
+      fprintf (stderr, "Failed to create pointmap\n");
+      goto errorexit;
+   }
+
+   if (!(pointmap_set (m, "origin", (struct point_t) { 0, 0 }))
+         || !(pointmap_set (m, "unit", (struct point_t) { 1, 1 }))
+         || !(pointmap_set (m, "origin", (struct point_t) { 5, 6 }))) {
+      fprintf (stderr, "Failed to set points\n");
+      goto errorexit;
+   }
+
+   // The keys are compared as strings, not as pointers
+   strcpy (key, "origin");
+   if (pointmap_num_entries (m) != 2
+         || !(p = pointmap_get (m, key)) || p->x != 5 || p->y != 6
+         || !(p = pointmap_get (m, "unit")) || p->x != 1
+         || pointmap_get (m, "unit ")) {
+      fprintf (stderr, "Wrong points\n");
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   pointmap_del (m);
+
+   return !error;
+}
+
+int main (void)
+{
+   int ret = EXIT_FAILURE;
+
+   printf ("Testing generated hashmaps, %s\n", ds_version);
+
+   if (!(id_test ())) {
+      fprintf (stderr, "Failed integer key test\n");
+      goto errorexit;
+   }
+
+   if (!(point_test ())) {
+      fprintf (stderr, "Failed string key test\n");
+      goto errorexit;
+   }
+
+   ret = EXIT_SUCCESS;
+
+errorexit:
+
+   return ret;
+}
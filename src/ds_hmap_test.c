@@ -3,6 +3,9 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
 
 #include "ds_str.h"
 #include "ds_hmap.h"
@@ -45,6 +48,14 @@ static void print_kv (const void *key, size_t keylen, void *data, size_t datalen
    fprintf (outf, "[name:%s] = [value:%s]\n", name, value);
 }
 
+// Writes the key for n into buf and returns buf. Every third key is too
+// long to be stored inline, so that both kinds of key storage are used.
+static char *make_key (size_t n, char *buf, size_t len)
+{
+   snprintf (buf, len, n % 3 ? "%zu" : "a key that is stored in the arena %zu", n);
+   return buf;
+}
+
 
 static bool small_test (void)
 {
@@ -228,70 +239,1685 @@ errorexit:
    return !error;
 }
 
-static bool large_test (void)
+static bool growth_test (ds_hmap_engine_t engine, ds_hmap_rehash_t policy,
+                         const char *msg)
 {
    bool error = true;
 
-   char *string = NULL;
+   static const size_t nkeys = 5000;
+   ds_hmap_config_t config = { .capacity = 4, .max_load = 0.75f,
+                               .rehash = policy, .engine = engine };
    ds_hmap_t *hm = NULL;
 
-   if (!(hm = ds_hmap_new (32000))) {
-      fprintf (stderr, "Failed to allocate hashmap of 32k entries\n");
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "Failed to create hashmap for [%s]\n", msg);
       goto errorexit;
    }
 
-   printf ("Waiting for input from stdin\n");
+   for (size_t i=0; i<nkeys; i++) {
+      if (!(ds_hmap_set (hm, &i, sizeof i, hm, i))) {
+         fprintf (stderr, "[%s] Failed to set key %zu\n", msg, i);
+         goto errorexit;
+      }
+      // Every key inserted so far must still be reachable, even while
+      // the entries are being moved into a larger table.
+      if ((i % 997) == 0) {
+         for (size_t j=0; j<=i; j++) {
+            size_t datalen = 0;
+            if (!(ds_hmap_get (hm, &j, sizeof j, NULL, &datalen)) || datalen != j) {
+               fprintf (stderr, "[%s] Lost key %zu after %zu inserts\n", msg, j, i);
+               goto errorexit;
+            }
+         }
+      }
+   }
 
-   int c = 0;
-   while (!feof (stdin) && !ferror (stdin) && (c = fgetc (stdin))!=EOF) {
-      if (isspace (c)) {
-         if (!string) {
-            continue;
+   for (size_t i=0; i<nkeys; i+=2) {
+      ds_hmap_remove (hm, &i, sizeof i);
+   }
+
+   if (ds_hmap_num_entries (hm) != nkeys / 2) {
+      fprintf (stderr, "[%s] Expected %zu entries, found %zu\n", msg,
+               nkeys / 2, ds_hmap_num_entries (hm));
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nkeys; i++) {
+      bool found = ds_hmap_get (hm, &i, sizeof i, NULL, NULL);
+      if (found != (i & 1)) {
+         fprintf (stderr, "[%s] Key %zu: expected found=%i\n", msg, i, (int)(i & 1));
+         goto errorexit;
+      }
+   }
+
+   if (engine == ds_hmap_ENGINE_CHAINED && policy == ds_hmap_REHASH_NONE
+         && ds_hmap_num_buckets (hm) != 4) {
+      fprintf (stderr, "[%s] Bucket count changed to %zu\n", msg,
+               ds_hmap_num_buckets (hm));
+      goto errorexit;
+   }
+
+   printf ("[%s] Buckets: %zu, Load: %.2f, Max entries/bucket: %zu\n", msg,
+           ds_hmap_num_buckets (hm), (double)ds_hmap_load (hm),
+           ds_hmap_max_entries (hm));
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+
+   return !error;
+}
+
+static uint64_t nocase_hash (const void *key, size_t keylen, uint64_t seed)
+{
+   char tmp[64];
+   const char *src = key;
+
+   if (keylen > sizeof tmp)
+      keylen = sizeof tmp;
+
+   for (size_t i=0; i<keylen; i++) {
+      tmp[i] = (char)tolower (src[i]);
+   }
+   return ds_hmap_hashfn (tmp, keylen, seed);
+}
+
+static int nocase_cmp (const void *k1, size_t k1len, const void *k2, size_t k2len)
+{
+   const char *s1 = k1, *s2 = k2;
+
+   if (k1len != k2len)
+      return 1;
+
+   for (size_t i=0; i<k1len; i++) {
+      if (tolower (s1[i]) != tolower (s2[i]))
+         return 1;
+   }
+   return 0;
+}
+
+static bool callback_test (ds_hmap_engine_t engine, const char *msg)
+{
+   bool error = true;
+
+   ds_hmap_config_t config = { .engine = engine,
+                               .hashfn = nocase_hash, .cmpfn = nocase_cmp };
+   ds_hmap_t *hm = NULL;
+   char *data = NULL;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   if (!(ds_hmap_set_str_str (hm, "Content-Type", "text/plain"))
+         || !(ds_hmap_set_str_str (hm, "CONTENT-LENGTH", "42"))
+         || !(ds_hmap_set_str_str (hm, "content-type", "text/html"))) {
+      fprintf (stderr, "[%s] Failed to set headers\n", msg);
+      goto errorexit;
+   }
+
+   if (ds_hmap_num_entries (hm) != 2
+         || !(ds_hmap_get_str_str (hm, "CONTENT-TYPE", &data))
+         || strcmp (data, "text/html") != 0
+         || !(ds_hmap_get_str_str (hm, "Content-Length", &data))
+         || strcmp (data, "42") != 0) {
+      fprintf (stderr, "[%s] Keys were not compared with the callbacks\n", msg);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+
+   return !error;
+}
+
+static bool hashfn_test (void)
+{
+   uint8_t key[200];
+
+   for (size_t i=0; i<sizeof key; i++) {
+      key[i] = (uint8_t)(i * 7);
+   }
+
+   // Every key length must depend on every byte of the key and on the
+   // seed, and must be repeatable.
+   for (size_t len=1; len<=sizeof key; len++) {
+      uint64_t h = ds_hmap_hashfn (key, len, 1);
+      if (h != ds_hmap_hashfn (key, len, 1) || h == ds_hmap_hashfn (key, len, 2)) {
+         fprintf (stderr, "Seeding failed for keylen %zu\n", len);
+         return false;
+      }
+      for (size_t i=0; i<len; i++) {
+         key[i] ^= 0x10;
+         bool same = h == ds_hmap_hashfn (key, len, 1);
+         key[i] ^= 0x10;
+         if (same) {
+            fprintf (stderr, "Byte %zu ignored for keylen %zu\n", i, len);
+            return false;
          }
-         if (!(ds_hmap_set_str_str (hm, string, string))) {
-            fprintf (stderr, "Failed to set string [%s]\n", string);
+      }
+   }
+
+   return true;
+}
+
+static bool prefix_test (ds_hmap_engine_t engine, const char *msg)
+{
+   bool error = true;
+
+   static const char key[] = "prefix-key";
+   static char short_value[] = "short";
+   static char long_value[] = "long";
+
+   ds_hmap_config_t config = { .engine = engine };
+   ds_hmap_t *hm = NULL;
+   void *data = NULL;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   // Keys that are prefixes of each other are different keys.
+   if (!(ds_hmap_set (hm, key, 6, short_value, sizeof short_value))
+         || !(ds_hmap_set (hm, key, 10, long_value, sizeof long_value))) {
+      fprintf (stderr, "[%s] Failed to set prefix keys\n", msg);
+      goto errorexit;
+   }
+
+   if (ds_hmap_num_entries (hm) != 2
+         || !(ds_hmap_get (hm, key, 6, &data, NULL)) || data != short_value
+         || !(ds_hmap_get (hm, key, 10, &data, NULL)) || data != long_value
+         || ds_hmap_get (hm, key, 3, NULL, NULL)
+         || ds_hmap_get (hm, key, 8, NULL, NULL)) {
+      fprintf (stderr, "[%s] Prefix keys matched each other\n", msg);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+
+   return !error;
+}
+
+// Keys on either side of the inline key length, with keys removed and
+// added again so that both the inline keys and the arena are reused.
+static bool keylen_test (ds_hmap_engine_t engine, const char *msg)
+{
+   bool error = true;
+
+   static char values[100];
+   uint8_t key[100];
+
+   ds_hmap_config_t config = { .capacity = 4, .engine = engine };
+   ds_hmap_t *hm = NULL;
+   void **keys = NULL;
+   size_t *keylens = NULL;
+   size_t nkeys = 0;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   for (int pass=0; pass<2; pass++) {
+      for (size_t len=1; len<=sizeof key; len++) {
+         if (pass && len % 2)
+            continue;
+         memset (key, (int)len, len);
+         const void *stored = ds_hmap_set (hm, key, len, &values[len - 1], len);
+         if (!stored || memcmp (stored, key, len) != 0) {
+            fprintf (stderr, "[%s] Failed to set key of length %zu\n", msg, len);
             goto errorexit;
          }
-         // fprintf (stderr, "Added [%s]\n", string);
-         free (string);
-         string = NULL;
-         continue;
       }
-      char st[2];
-      st[0] = (char)c;
-      st[1] = 0;
-      if (!(ds_str_append (&string, st, NULL))) {
-         fprintf (stderr, "Out of memory allocating string\n");
+
+      for (size_t len=1; len<=sizeof key; len += 2) {
+         memset (key, (int)len, len);
+         ds_hmap_remove (hm, key, len);
+      }
+   }
+
+   for (size_t len=1; len<=sizeof key; len++) {
+      void *data = NULL;
+      size_t datalen = 0;
+      bool found;
+
+      memset (key, (int)len, len);
+      found = ds_hmap_get (hm, key, len, &data, &datalen);
+      if (found != !(len % 2) || (found && (data != &values[len - 1] || datalen != len))) {
+         fprintf (stderr, "[%s] Wrong result for key of length %zu\n", msg, len);
+         goto errorexit;
+      }
+   }
+
+   nkeys = ds_hmap_keys (hm, &keys, &keylens);
+   if (nkeys != sizeof key / 2) {
+      fprintf (stderr, "[%s] Expected %zu keys, got %zu\n", msg, sizeof key / 2, nkeys);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nkeys; i++) {
+      memset (key, (int)keylens[i], keylens[i]);
+      if (keylens[i] % 2 || memcmp (keys[i], key, keylens[i]) != 0) {
+         fprintf (stderr, "[%s] Key of length %zu is corrupted\n", msg, keylens[i]);
          goto errorexit;
       }
    }
 
-   print_stats (hm, "Large test: results");
    error = false;
 
 errorexit:
 
+   free (keys);
+   free (keylens);
    ds_hmap_del (hm);
-   free (string);
 
    return !error;
 }
 
-int main (void)
+// Compares the running statistics against the bucket sizes written by
+// ds_hmap_print_freq().
+static bool check_stats (ds_hmap_t *hm, const char *msg)
 {
-   int ret = EXIT_FAILURE;
-   ret = EXIT_SUCCESS;
+   bool error = true;
 
-   if (!(small_test ())) {
-      fprintf (stderr, "Failed small test\n");
+   FILE *tmpf = NULL;
+   ds_hmap_stats_t stats;
+   size_t nbuckets = 0, nentries = 0, min = (size_t)-1, max = 0;
+   double sumsq = 0.0;
+   size_t idx, n;
+
+   if (!(tmpf = tmpfile ())) {
+      fprintf (stderr, "[%s] Failed to create temporary file\n", msg);
       goto errorexit;
    }
 
-   if (!(large_test ())) {
-      fprintf (stderr, "Failed large test\n");
+   ds_hmap_print_freq (hm, "freq", tmpf);
+   rewind (tmpf);
+
+   while (fscanf (tmpf, "freq:%zu : %zu\n", &idx, &n) == 2) {
+      nbuckets++;
+      nentries += n;
+      sumsq += (double)(n * n);
+      if (n < min) min = n;
+      if (n > max) max = n;
+   }
+
+   double avg = (double)nentries / (double)nbuckets;
+   double stddev = sqrt (sumsq / (double)nbuckets - avg * avg);
+
+   if (!(ds_hmap_stats (hm, &stats))
+         || stats.nentries != nentries
+         || stats.mean_entries != nentries / nbuckets
+         || stats.min_entries != min
+         || stats.max_entries != max
+         || stats.range_entries != max - min
+         || fabs ((double)stats.stddev_entries - stddev) > 0.001
+         || ds_hmap_num_entries (hm) != nentries
+         || ds_hmap_min_entries (hm) != min
+         || ds_hmap_max_entries (hm) != max) {
+      fprintf (stderr, "[%s] Statistics do not match the buckets:\n"
+                       "   entries %zu/%zu, min %zu/%zu, max %zu/%zu, "
+                       "stddev %f/%f\n", msg,
+                       stats.nentries, nentries, stats.min_entries, min,
+                       stats.max_entries, max,
+                       (double)stats.stddev_entries, stddev);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   if (tmpf)
+      fclose (tmpf);
+
+   return !error;
+}
+
+static bool stats_test (ds_hmap_engine_t engine, ds_hmap_rehash_t policy,
+                        float max_load, const char *msg)
+{
+   bool error = true;
+
+   static char value[] = "value";
+   ds_hmap_config_t config = { .capacity = 4,
+                               .max_load = max_load,
+                               .rehash = policy,
+                               .engine = engine };
+   ds_hmap_t *hm = NULL;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   if (!(check_stats (hm, msg)))
+      goto errorexit;
+
+   for (size_t i=0; i<600; i++) {
+      if (!(ds_hmap_set (hm, &i, sizeof i, value, sizeof value))) {
+         fprintf (stderr, "[%s] Failed to set key %zu\n", msg, i);
+         goto errorexit;
+      }
+      if (i % 3 == 0)
+         ds_hmap_remove (hm, &i, sizeof i);
+      if (i % 37 == 0 && !(check_stats (hm, msg)))
+         goto errorexit;
+   }
+
+   if (!(check_stats (hm, msg)))
+      goto errorexit;
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+
+   return !error;
+}
+
+static void count_kv (const void *key, size_t keylen, void *data, size_t datalen,
+                      void *extra_param)
+{
+   size_t *count = extra_param;
+
+   (void)key;
+   (void)keylen;
+   (void)data;
+   (void)datalen;
+   (*count)++;
+}
+
+// Visits every entry exactly once after some have been removed, then
+// removes half of the entries through the cursor.
+static bool iter_test (ds_hmap_engine_t engine, const char *msg)
+{
+   bool error = true;
+
+   static char value[] = "value";
+   static unsigned char seen[1000];
+   ds_hmap_config_t config = { .capacity = 4, .engine = engine };
+   ds_hmap_t *hm = NULL;
+   ds_hmap_iter_t it;
+   size_t count = 0;
+
+   memset (seen, 0, sizeof seen);
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<sizeof seen; i++) {
+      if (!(ds_hmap_set (hm, &i, sizeof i, value, sizeof value))) {
+         fprintf (stderr, "[%s] Failed to set key %zu\n", msg, i);
+         goto errorexit;
+      }
+   }
+
+   for (size_t i=0; i<sizeof seen; i += 3) {
+      ds_hmap_remove (hm, &i, sizeof i);
+   }
+
+   ds_hmap_iterate (hm, count_kv, &count);
+   if (count != ds_hmap_num_entries (hm)) {
+      fprintf (stderr, "[%s] Callback visited %zu of %zu entries\n", msg,
+               count, ds_hmap_num_entries (hm));
+      goto errorexit;
+   }
+
+   ds_hmap_iter_init (hm, &it);
+   while (ds_hmap_iter_next (&it)) {
+      size_t key;
+      if (it.keylen != sizeof key || it.data != value) {
+         fprintf (stderr, "[%s] Cursor returned a bad entry\n", msg);
+         goto errorexit;
+      }
+      memcpy (&key, it.key, sizeof key);
+      if (key >= sizeof seen || key % 3 == 0 || seen[key]++) {
+         fprintf (stderr, "[%s] Cursor returned key %zu\n", msg, key);
+         goto errorexit;
+      }
+      if (key % 2 == 0)
+         ds_hmap_iter_remove (&it);
+   }
+
+   for (size_t i=0; i<sizeof seen; i++) {
+      bool expected = i % 3 && i % 2;
+      if ((i % 3 && !seen[i]) || ds_hmap_get (hm, &i, sizeof i, NULL, NULL) != expected) {
+         fprintf (stderr, "[%s] Key %zu was not visited or not removed\n", msg, i);
+         goto errorexit;
+      }
+   }
+
+   count = 0;
+   ds_hmap_iter_init (hm, &it);
+   while (ds_hmap_iter_next (&it)) {
+      count++;
+   }
+   if (count != ds_hmap_num_entries (hm)) {
+      fprintf (stderr, "[%s] Cursor visited %zu of %zu entries\n", msg,
+               count, ds_hmap_num_entries (hm));
       goto errorexit;
    }
 
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+
+   return !error;
+}
+
+static bool many_test (ds_hmap_engine_t engine, const char *msg)
+{
+   bool error = true;
+
+   static char values[300];
+   char *strings[300];
+   const void *keys[300];
+   size_t keylens[300];
+   void *data[300];
+   size_t datalens[300];
+
+   ds_hmap_config_t config = { .capacity = 4, .engine = engine };
+   ds_hmap_t *hm = NULL;
+   size_t n;
+
+   memset (strings, 0, sizeof strings);
+
+   for (size_t i=0; i<300; i++) {
+      // Every third key is a long key; the last 100 keys are never set
+      if (!(ds_str_printf (&strings[i], i % 3 ? "%zu" : "long key number %zu", i))) {
+         fprintf (stderr, "[%s] Out of memory\n", msg);
+         goto errorexit;
+      }
+      keys[i] = strings[i];
+      keylens[i] = strlen (strings[i]) + 1;
+      data[i] = &values[i];
+      datalens[i] = i;
+   }
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   if ((n = ds_hmap_set_many (hm, 200, keys, keylens, data, datalens)) != 200
+         || ds_hmap_num_entries (hm) != 200) {
+      fprintf (stderr, "[%s] Set %zu of 200 keys\n", msg, n);
+      goto errorexit;
+   }
+
+   memset (data, 0, sizeof data);
+   memset (datalens, 0, sizeof datalens);
+
+   if ((n = ds_hmap_get_many (hm, 300, keys, keylens, data, datalens)) != 200) {
+      fprintf (stderr, "[%s] Found %zu of 200 keys\n", msg, n);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<300; i++) {
+      void *expected = i < 200 ? &values[i] : NULL;
+      void *single = NULL;
+      ds_hmap_get (hm, keys[i], keylens[i], &single, NULL);
+      if (data[i] != expected || datalens[i] != (i < 200 ? i : 0) || single != expected) {
+         fprintf (stderr, "[%s] Wrong result for key [%s]\n", msg, strings[i]);
+         goto errorexit;
+      }
+   }
+
+   // A NULL data pointer stops the batch at that key
+   data[0] = &values[0];
+   data[1] = &values[1];
+   data[2] = NULL;
+   if ((n = ds_hmap_set_many (hm, 3, keys, keylens, data, NULL)) != 2) {
+      fprintf (stderr, "[%s] Expected the batch to stop at key 2, stopped at %zu\n",
+               msg, n);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+   for (size_t i=0; i<300; i++) {
+      free (strings[i]);
+   }
+
+   return !error;
+}
+
+static bool build_test (ds_hmap_engine_t engine, size_t nthreads, const char *msg)
+{
+   bool error = true;
+
+   // Keys repeat after nunique, so the last nkeys - nunique values replace
+   // earlier ones.
+   static const size_t nkeys = 20000;
+   static const size_t nunique = 15000;
+   static char values[20000];
+   char key[64];
+   char **strings = NULL;
+   const void **keys = NULL;
+   size_t *keylens = NULL;
+   void **data = NULL;
+   size_t *datalens = NULL;
+
+   ds_hmap_config_t config = { .engine = engine };
+   ds_hmap_t *hm = NULL;
+
+   if (!(strings = calloc (nkeys, sizeof *strings))
+         || !(keys = calloc (nkeys, sizeof *keys))
+         || !(keylens = calloc (nkeys, sizeof *keylens))
+         || !(data = calloc (nkeys, sizeof *data))
+         || !(datalens = calloc (nkeys, sizeof *datalens))) {
+      fprintf (stderr, "[%s] Out of memory\n", msg);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nkeys; i++) {
+      size_t k = i % nunique;
+      if (!(strings[i] = ds_str_dup (make_key (k, key, sizeof key)))) {
+         fprintf (stderr, "[%s] Out of memory\n", msg);
+         goto errorexit;
+      }
+      keys[i] = strings[i];
+      keylens[i] = strlen (strings[i]) + 1;
+      data[i] = &values[i];
+      datalens[i] = i;
+   }
+
+   if (!(hm = ds_hmap_build_ex (nkeys, keys, keylens, data, datalens, nthreads, &config))
+         || ds_hmap_num_entries (hm) != nunique) {
+      fprintf (stderr, "[%s] Failed to build the hashmap\n", msg);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nunique; i++) {
+      size_t last = i + nunique < nkeys ? i + nunique : i;
+      void *found = NULL;
+      size_t datalen = 0;
+      if (!(ds_hmap_get (hm, keys[i], keylens[i], &found, &datalen))
+            || found != &values[last] || datalen != last) {
+         fprintf (stderr, "[%s] Wrong result for key [%s]\n", msg, strings[i]);
+         goto errorexit;
+      }
+   }
+
+   if (!(check_stats (hm, msg)))
+      goto errorexit;
+
+   // The result is an ordinary hashmap
+   for (size_t i=0; i<nunique; i+=2) {
+      ds_hmap_remove (hm, keys[i], keylens[i]);
+   }
+   if (!(ds_hmap_set_str_str (hm, "new key", "new value"))
+         || ds_hmap_num_entries (hm) != nunique / 2 + 1
+         || !(check_stats (hm, msg))) {
+      fprintf (stderr, "[%s] Failed to update the hashmap\n", msg);
+      goto errorexit;
+   }
+
+   ds_hmap_del (hm);
+
+   // A NULL key fails the whole build
+   keys[nkeys / 2] = NULL;
+   if ((hm = ds_hmap_build_ex (nkeys, keys, keylens, data, datalens, nthreads, &config))) {
+      fprintf (stderr, "[%s] Built a hashmap with a NULL key\n", msg);
+      goto errorexit;
+   }
+
+   if (!(hm = ds_hmap_build_ex (0, keys, keylens, data, datalens, nthreads, &config))
+         || ds_hmap_num_entries (hm) != 0) {
+      fprintf (stderr, "[%s] Failed to build an empty hashmap\n", msg);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+   for (size_t i=0; strings && i<nkeys; i++) {
+      free (strings[i]);
+   }
+   free (strings);
+   free (keys);
+   free (keylens);
+   free (data);
+   free (datalens);
+
+   return !error;
+}
+
+static bool fill_keys (ds_hmap_t *hm, size_t first, size_t n, const char *msg)
+{
+   // Frozen copies hold datalen bytes of the data
+   static char value[21000];
+
+   for (size_t i=first; i<first + n; i++) {
+      char key[64];
+      make_key (i, key, sizeof key);
+      if (!(ds_hmap_set (hm, key, strlen (key) + 1, value, i))) {
+         fprintf (stderr, "[%s] Failed to set [%s]\n", msg, key);
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static bool check_keys (ds_hmap_t *hm, size_t first, size_t n, size_t step,
+                        const char *msg)
+{
+   for (size_t i=first; i<first + n; i++) {
+      char key[64];
+      size_t datalen = 0;
+      bool expected = (i - first) % step == 0;
+      make_key (i, key, sizeof key);
+      if (ds_hmap_get (hm, key, strlen (key) + 1, NULL, &datalen) != expected
+            || (expected && datalen != i)) {
+         fprintf (stderr, "[%s] Wrong result for [%s]\n", msg, key);
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static bool resize_test (ds_hmap_engine_t engine, const char *msg)
+{
+   bool error = true;
+
+   ds_hmap_config_t config = { .capacity = 4, .engine = engine };
+   ds_hmap_t *hm = NULL;
+   ds_hmap_t *frozen = NULL;
+   ds_hmap_stats_t before, after;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   // Once the hashmap has grown, clearing and refilling it with the same
+   // keys does not change its size or allocate space for keys.
+   for (size_t round=0; round<4; round++) {
+      if (!(fill_keys (hm, 0, 1000, msg)) || !(check_keys (hm, 0, 1000, 1, msg)))
+         goto errorexit;
+
+      ds_hmap_stats (hm, &after);
+      if (round > 1 && (after.nbuckets != before.nbuckets
+                        || after.key_bytes != before.key_bytes)) {
+         fprintf (stderr, "[%s] Refilling changed the size from %zu/%zu to %zu/%zu\n",
+                  msg, before.nbuckets, before.key_bytes, after.nbuckets, after.key_bytes);
+         goto errorexit;
+      }
+      before = after;
+
+      ds_hmap_iter_t it;
+      ds_hmap_iter_init (hm, &it);
+      if (!(ds_hmap_clear (hm)) || ds_hmap_num_entries (hm) != 0
+            || ds_hmap_iter_next (&it)
+            || ds_hmap_get_str_str (hm, "1", NULL)
+            || !(check_stats (hm, msg))) {
+         fprintf (stderr, "[%s] Failed to clear the hashmap\n", msg);
+         goto errorexit;
+      }
+   }
+
+   // No growth after reserving room for the keys
+   if (!(ds_hmap_reserve (hm, 10000))) {
+      fprintf (stderr, "[%s] Failed to reserve room\n", msg);
+      goto errorexit;
+   }
+   ds_hmap_stats (hm, &before);
+   if (!(fill_keys (hm, 0, 10000, msg)))
+      goto errorexit;
+   ds_hmap_stats (hm, &after);
+   if (after.nbuckets != before.nbuckets || after.rehashing) {
+      fprintf (stderr, "[%s] Grew from %zu to %zu buckets after reserving\n",
+               msg, before.nbuckets, after.nbuckets);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<10000; i++) {
+      if (i % 100) {
+         char key[64];
+         make_key (i, key, sizeof key);
+         ds_hmap_remove_str (hm, key);
+      }
+   }
+
+   if (!(ds_hmap_shrink_to_fit (hm)))  {
+      fprintf (stderr, "[%s] Failed to shrink\n", msg);
+      goto errorexit;
+   }
+
+   ds_hmap_stats (hm, &after);
+   if (after.nbuckets >= before.nbuckets / 10 || after.wasted_key_bytes
+         || ds_hmap_num_entries (hm) != 100
+         || !(check_keys (hm, 0, 10000, 100, msg))
+         || !(check_stats (hm, msg))) {
+      fprintf (stderr, "[%s] Shrunk to %zu buckets and %zu/%zu key bytes\n", msg,
+               after.nbuckets, after.key_bytes, after.wasted_key_bytes);
+      goto errorexit;
+   }
+
+   // The hashmap is still usable
+   if (!(fill_keys (hm, 20000, 1000, msg)) || !(check_keys (hm, 20000, 1000, 1, msg)))
+      goto errorexit;
+
+   if (!(frozen = ds_hmap_freeze (hm)) || ds_hmap_clear (frozen)
+         || ds_hmap_reserve (frozen, 10) || ds_hmap_shrink_to_fit (frozen)) {
+      fprintf (stderr, "[%s] Changed a frozen hashmap\n", msg);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+   ds_hmap_del (frozen);
+
+   return !error;
+}
+
+static bool bloom_test (ds_hmap_engine_t engine, const char *msg)
+{
+   bool error = true;
+
+   ds_hmap_config_t config = { .engine = engine };
+   ds_hmap_t *hm = NULL;
+   ds_hmap_t *frozen = NULL;
+   ds_bloom_stats_t stats;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   // Keys that were set before the filter was attached are in it too, and
+   // the filter is rebuilt as it fills up.
+   if (!(fill_keys (hm, 0, 100, msg)) || !(ds_hmap_attach_bloom (hm, 0.01))
+         || !(fill_keys (hm, 100, 9900, msg)) || !(check_keys (hm, 0, 10000, 1, msg))) {
+      fprintf (stderr, "[%s] Failed to attach a filter\n", msg);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<10000; i++) {
+      char key[32];
+      snprintf (key, sizeof key, "missing %zu", i);
+      if (ds_hmap_get_str_str (hm, key, NULL)) {
+         fprintf (stderr, "[%s] Found [%s]\n", msg, key);
+         goto errorexit;
+      }
+   }
+
+   ds_bloom_stats (ds_hmap_bloom (hm), &stats);
+   if (stats.nitems != 10000 || stats.capacity < stats.nitems
+         || stats.fp_rate != 0.01 || !stats.nbytes) {
+      fprintf (stderr, "[%s] Wrong filter statistics\n", msg);
+      goto errorexit;
+   }
+
+   // Removed keys are not found although they are still in the filter,
+   // and are found again when they are set again.
+   for (size_t i=0; i<10000; i++) {
+      char key[64];
+      if (i % 2) {
+         make_key (i, key, sizeof key);
+         ds_hmap_remove_str (hm, key);
+      }
+   }
+   if (!(check_keys (hm, 0, 10000, 2, msg)) || !(fill_keys (hm, 0, 10000, msg))
+         || !(check_keys (hm, 0, 10000, 1, msg))) {
+      goto errorexit;
+   }
+
+   // Shrinking rebuilds the filter from the keys that are left
+   for (size_t i=5000; i<10000; i++) {
+      char key[64];
+      make_key (i, key, sizeof key);
+      ds_hmap_remove_str (hm, key);
+   }
+   ds_hmap_shrink_to_fit (hm);
+   ds_bloom_stats (ds_hmap_bloom (hm), &stats);
+   if (stats.nitems != 5000 || !(check_keys (hm, 0, 5000, 1, msg))) {
+      fprintf (stderr, "[%s] Filter holds %zu keys after shrinking\n", msg, stats.nitems);
+      goto errorexit;
+   }
+
+   ds_hmap_clear (hm);
+   ds_bloom_stats (ds_hmap_bloom (hm), &stats);
+   if (stats.nitems || !(fill_keys (hm, 100, 100, msg))
+         || !(check_keys (hm, 100, 100, 1, msg))
+         || ds_hmap_num_entries (hm) != 100) {
+      fprintf (stderr, "[%s] Failed to clear the filter\n", msg);
+      goto errorexit;
+   }
+
+   if (!(frozen = ds_hmap_freeze (hm)) || ds_hmap_attach_bloom (frozen, 0.01)) {
+      fprintf (stderr, "[%s] Attached a filter to a frozen hashmap\n", msg);
+      goto errorexit;
+   }
+
+   ds_hmap_detach_bloom (hm);
+   if (ds_hmap_bloom (hm) || !(check_keys (hm, 100, 100, 1, msg)))
+      goto errorexit;
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+   ds_hmap_del (frozen);
+
+   return !error;
+}
+
+static bool hashed_test (void)
+{
+   bool error = true;
+   static const char *msg = "Precomputed hashes";
+
+   ds_hmap_config_t configs[] = {
+      { .engine = ds_hmap_ENGINE_CHAINED },
+      { .engine = ds_hmap_ENGINE_FLAT },
+      { .engine = ds_hmap_ENGINE_ORDERED },
+   };
+   static const size_t nmaps = sizeof configs / sizeof configs[0];
+   ds_hmap_t *maps[sizeof configs / sizeof configs[0]] = { NULL };
+   ds_hmap_t *frozen = NULL;
+   ds_hmap_t *seeded = NULL;
+   // Frozen copies hold datalen bytes of the data
+   static char values[2000];
+
+   ds_hmap_config_t seeded_config = { .seed = 12345 };
+
+   for (size_t i=0; i<nmaps; i++) {
+      if (!(maps[i] = ds_hmap_new_ex (&configs[i]))) {
+         fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+         goto errorexit;
+      }
+   }
+
+   if (!(seeded = ds_hmap_new_ex (&seeded_config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   // Each key is hashed once and set in every hashmap
+   for (size_t i=0; i<1000; i++) {
+      char key[64];
+      make_key (i, key, sizeof key);
+      uint64_t hash = ds_hmap_hash (maps[0], key, strlen (key) + 1);
+      for (size_t j=0; j<nmaps; j++) {
+         if (!(ds_hmap_set_hashed (maps[j], hash, key, strlen (key) + 1, &values[i], i))) {
+            fprintf (stderr, "[%s] Failed to set [%s]\n", msg, key);
+            goto errorexit;
+         }
+      }
+      if (!(ds_hmap_set_hashed (seeded, ds_hmap_hash (seeded, key, strlen (key) + 1),
+                                key, strlen (key) + 1, &values[i], i))) {
+         fprintf (stderr, "[%s] Failed to set [%s]\n", msg, key);
+         goto errorexit;
+      }
+   }
+
+   if (!(frozen = ds_hmap_freeze (maps[0]))) {
+      fprintf (stderr, "[%s] Failed to freeze hashmap\n", msg);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<1000; i++) {
+      char key[64];
+      make_key (i, key, sizeof key);
+      size_t keylen = strlen (key) + 1;
+      uint64_t hash = ds_hmap_hash (maps[1], key, keylen);
+
+      for (size_t j=0; j<=nmaps; j++) {
+         ds_hmap_t *hm = j < nmaps ? maps[j] : frozen;
+         void *data = NULL;
+         size_t datalen = 0;
+         if (!(ds_hmap_get_hashed (hm, hash, key, keylen, &data, &datalen))
+               || (hm != frozen && data != &values[i]) || datalen != i) {
+            fprintf (stderr, "[%s] Wrong result for [%s] in hashmap %zu\n", msg, key, j);
+            goto errorexit;
+         }
+      }
+
+      // Plain lookups find the keys that were set with a hash
+      if (!(ds_hmap_get (seeded, key, keylen, NULL, NULL))
+            || !(ds_hmap_get (maps[2], key, keylen, NULL, NULL))) {
+         fprintf (stderr, "[%s] Failed to get [%s]\n", msg, key);
+         goto errorexit;
+      }
+   }
+
+   if (ds_hmap_hash (seeded, "key", 4) == ds_hmap_hash (maps[0], "key", 4)) {
+      fprintf (stderr, "[%s] The seed did not change the hash\n", msg);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   for (size_t i=0; i<nmaps; i++) {
+      ds_hmap_del (maps[i]);
+   }
+   ds_hmap_del (frozen);
+   ds_hmap_del (seeded);
+
+   return !error;
+}
+
+static bool large_test (void)
+{
+   bool error = true;
+
+   char *string = NULL;
+   ds_hmap_t *hm = NULL;
+
+   if (!(hm = ds_hmap_new (32000))) {
+      fprintf (stderr, "Failed to allocate hashmap of 32k entries\n");
+      goto errorexit;
+   }
+
+   printf ("Waiting for input from stdin\n");
+
+   int c = 0;
+   while (!feof (stdin) && !ferror (stdin) && (c = fgetc (stdin))!=EOF) {
+      if (isspace (c)) {
+         if (!string) {
+            continue;
+         }
+         if (!(ds_hmap_set_str_str (hm, string, string))) {
+            fprintf (stderr, "Failed to set string [%s]\n", string);
+            goto errorexit;
+         }
+         // fprintf (stderr, "Added [%s]\n", string);
+         free (string);
+         string = NULL;
+         continue;
+      }
+      char st[2];
+      st[0] = (char)c;
+      st[1] = 0;
+      if (!(ds_str_append (&string, st, NULL))) {
+         fprintf (stderr, "Out of memory allocating string\n");
+         goto errorexit;
+      }
+   }
+
+   print_stats (hm, "Large test: results");
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+   free (string);
+
+   return !error;
+}
+
+static bool freeze_test (ds_hmap_engine_t engine, size_t nkeys, const char *msg)
+{
+   bool error = true;
+
+   ds_hmap_config_t config = { .engine = engine,
+                               .hashfn = nocase_hash,
+                               .cmpfn = nocase_cmp };
+   ds_hmap_t *hm = NULL;
+   ds_hmap_t *frozen = NULL;
+   char **strings = NULL;
+   ds_hmap_error_t err;
+   ds_hmap_iter_t it;
+   size_t count = 0;
+
+   if (!(strings = calloc (nkeys + 1, sizeof *strings))
+         || !(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nkeys; i++) {
+      if (!(ds_str_printf (&strings[i], i % 4 ? "Key-%zu" : "A Much Longer Key, Number %zu", i))
+            || !(ds_hmap_set_str_str (hm, strings[i], strings[i]))) {
+         fprintf (stderr, "[%s] Failed to set key %zu\n", msg, i);
+         goto errorexit;
+      }
+   }
+
+   for (size_t i=0; i<nkeys; i += 5) {
+      ds_hmap_remove_str (hm, strings[i]);
+   }
+
+   if (!(frozen = ds_hmap_freeze (hm))) {
+      fprintf (stderr, "[%s] Failed to freeze hashmap\n", msg);
+      goto errorexit;
+   }
+
+   // The frozen hashmap does not depend on the original
+   ds_hmap_del (hm);
+   hm = NULL;
+
+   if (ds_hmap_num_entries (frozen) != nkeys - (nkeys + 4) / 5) {
+      fprintf (stderr, "[%s] Frozen hashmap has %zu entries\n", msg,
+               ds_hmap_num_entries (frozen));
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nkeys; i++) {
+      char *data = NULL;
+      char upper[64];
+      size_t j;
+      for (j=0; strings[i][j] && j < sizeof upper - 1; j++) {
+         upper[j] = (char)toupper (strings[i][j]);
+      }
+      upper[j] = 0;
+      bool found = ds_hmap_get_str_str (frozen, upper, &data);
+      if (found != (i % 5 != 0) || (found && strcmp (data, strings[i]) != 0)) {
+         fprintf (stderr, "[%s] Wrong result for [%s]\n", msg, upper);
+         goto errorexit;
+      }
+   }
+
+   if (ds_hmap_get_str_str (frozen, "not a key", NULL)
+         || ds_hmap_set_str_str (frozen, "new key", "value")) {
+      fprintf (stderr, "[%s] Frozen hashmap was modified\n", msg);
+      goto errorexit;
+   }
+
+   ds_hmap_lasterr (frozen, &err, NULL);
+   if (err != ds_hmap_EREADONLY) {
+      fprintf (stderr, "[%s] Expected a read-only error, got %i\n", msg, err);
+      goto errorexit;
+   }
+
+   ds_hmap_remove_str (frozen, "Key-1");
+
+   ds_hmap_iter_init (frozen, &it);
+   while (ds_hmap_iter_next (&it)) {
+      if (strcmp (it.key, it.data) != 0) {
+         fprintf (stderr, "[%s] Key [%s] has data [%s]\n", msg,
+                  (const char *)it.key, (const char *)it.data);
+         goto errorexit;
+      }
+      count++;
+   }
+
+   if (count != ds_hmap_num_entries (frozen)
+         || ds_hmap_max_entries (frozen) > 1) {
+      fprintf (stderr, "[%s] Iterated over %zu of %zu entries\n", msg, count,
+               ds_hmap_num_entries (frozen));
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+   ds_hmap_del (frozen);
+   for (size_t i=0; strings && i<nkeys; i++) {
+      free (strings[i]);
+   }
+   free (strings);
+
+   return !error;
+}
+
+#define SNAPSHOT_FNAME     ("ds_hmap_test.snapshot")
+
+// Flips one byte in the middle of the snapshot file
+static bool corrupt_snapshot (void)
+{
+   FILE *f = fopen (SNAPSHOT_FNAME, "r+b");
+   int c;
+
+   if (!f)
+      return false;
+
+   fseek (f, 0, SEEK_END);
+   long middle = ftell (f) / 2;
+   fseek (f, middle, SEEK_SET);
+   c = fgetc (f);
+   fseek (f, middle, SEEK_SET);
+   fputc (c ^ 0x55, f);
+
+   return fclose (f) == 0;
+}
+
+static bool save_test (ds_hmap_engine_t engine, size_t nkeys, const char *msg)
+{
+   bool error = true;
+
+   ds_hmap_config_t config = { .engine = engine };
+   ds_hmap_config_t nocase = { .engine = engine,
+                               .hashfn = nocase_hash, .cmpfn = nocase_cmp };
+   ds_hmap_t *hm = NULL;
+   ds_hmap_t *loaded = NULL;
+   static const char *values[] = { "zero", "one", "two" };
+   char key[64];
+   char *data = NULL;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nkeys; i++) {
+      make_key (i, key, sizeof key);
+      if (!(ds_hmap_set_str_str (hm, key, values[i % 3]))) {
+         fprintf (stderr, "[%s] Failed to set [%s]\n", msg, key);
+         goto errorexit;
+      }
+   }
+
+   if (!(ds_hmap_save (hm, SNAPSHOT_FNAME))
+         || !(loaded = ds_hmap_open_mmap (SNAPSHOT_FNAME))) {
+      fprintf (stderr, "[%s] Failed to save and reopen hashmap\n", msg);
+      goto errorexit;
+   }
+
+   if (ds_hmap_num_entries (loaded) != nkeys
+         || ds_hmap_get_str_str (loaded, "Key number", NULL)
+         || ds_hmap_set_str_str (loaded, "new key", "value")) {
+      fprintf (stderr, "[%s] Wrong entries in the reopened hashmap\n", msg);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<nkeys; i++) {
+      make_key (i, key, sizeof key);
+      if (!(ds_hmap_get_str_str (loaded, key, &data)) || strcmp (data, values[i % 3]) != 0) {
+         fprintf (stderr, "[%s] Failed to find [%s] in the reopened hashmap\n", msg, key);
+         goto errorexit;
+      }
+   }
+
+   ds_hmap_del (loaded);
+   loaded = NULL;
+
+   // A corrupted file must be rejected
+   if (!(corrupt_snapshot ()) || (loaded = ds_hmap_open_mmap (SNAPSHOT_FNAME))) {
+      fprintf (stderr, "[%s] Corrupted file was not rejected\n", msg);
+      goto errorexit;
+   }
+
+   // A file written with a caller-supplied hash function can only be
+   // opened with that function.
+   ds_hmap_del (hm);
+   if (!(hm = ds_hmap_new_ex (&nocase))
+         || !(ds_hmap_set_str_str (hm, "Content-Type", "text/plain"))
+         || !(ds_hmap_save (hm, SNAPSHOT_FNAME))
+         || (loaded = ds_hmap_open_mmap (SNAPSHOT_FNAME))
+         || !(loaded = ds_hmap_open_mmap_ex (SNAPSHOT_FNAME, &nocase))
+         || !(ds_hmap_get_str_str (loaded, "CONTENT-TYPE", &data))
+         || strcmp (data, "text/plain") != 0) {
+      fprintf (stderr, "[%s] Failed to reopen with a hash function\n", msg);
+      goto errorexit;
+   }
+
+   if ((ds_hmap_open_mmap ("no-such-directory/ds_hmap_test.snapshot"))) {
+      fprintf (stderr, "[%s] Opened a missing file\n", msg);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+   ds_hmap_del (loaded);
+   remove (SNAPSHOT_FNAME);
+
+   return !error;
+}
+
+static bool u64_test (ds_hmap_engine_t engine, ds_hmap_keys_t keys, const char *msg)
+{
+   bool error = true;
+
+   ds_hmap_config_t config = { .engine = engine, .keys = keys };
+   ds_hmap_t *hm = NULL;
+   ds_hmap_t *frozen = NULL;
+   // Each key i has datalen i, which freezing copies from &values[i]
+   static char values[2000];
+   ds_hmap_error_t err;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   for (uint64_t i=0; i<1000; i++) {
+      if (!(ds_hmap_set_u64 (hm, i * 0x9e3779b97f4a7c15, &values[i], (size_t)i))) {
+         fprintf (stderr, "[%s] Failed to set key %zu\n", msg, (size_t)i);
+         goto errorexit;
+      }
+   }
+
+   for (uint64_t i=0; i<1000; i += 2) {
+      ds_hmap_remove_u64 (hm, i * 0x9e3779b97f4a7c15);
+   }
+
+   for (uint64_t i=0; i<1000; i++) {
+      uint64_t key = i * 0x9e3779b97f4a7c15;
+      void *data = NULL;
+      size_t datalen = 0;
+      bool found = ds_hmap_get_u64 (hm, key, &data, &datalen);
+      if (found != (i % 2 == 1)
+            || (found && (data != &values[i] || datalen != i))
+            || found != ds_hmap_get (hm, &key, sizeof key, NULL, NULL)) {
+         fprintf (stderr, "[%s] Wrong result for key %zu\n", msg, (size_t)i);
+         goto errorexit;
+      }
+   }
+
+   if (ds_hmap_num_entries (hm) != 500 || ds_hmap_get_u64 (hm, 1, NULL, NULL)) {
+      fprintf (stderr, "[%s] Wrong entries\n", msg);
+      goto errorexit;
+   }
+
+   // Only eight-byte keys may be stored in a hashmap of integer keys
+   bool set = ds_hmap_set (hm, "abc", 4, values, 1) != NULL;
+   ds_hmap_lasterr (hm, &err, NULL);
+   if (keys == ds_hmap_KEYS_U64 && (set || err != ds_hmap_EBADPARAM
+                                    || ds_hmap_get (hm, "abc", 4, NULL, NULL))) {
+      fprintf (stderr, "[%s] Set a short key in an integer hashmap\n", msg);
+      goto errorexit;
+   }
+
+   if (!(frozen = ds_hmap_freeze (hm))
+         || !(ds_hmap_get_u64 (frozen, 999 * 0x9e3779b97f4a7c15, NULL, NULL))
+         || ds_hmap_get_u64 (frozen, 998 * 0x9e3779b97f4a7c15, NULL, NULL)) {
+      fprintf (stderr, "[%s] Wrong results from the frozen hashmap\n", msg);
+      goto errorexit;
+   }
+
+   ds_hmap_config_t bad = { .keys = ds_hmap_KEYS_U64, .hashfn = nocase_hash };
+   ds_hmap_t *tmp = ds_hmap_new_ex (&bad);
+   if (tmp) {
+      ds_hmap_del (tmp);
+      fprintf (stderr, "[%s] Created an integer hashmap with a hashfn\n", msg);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+   ds_hmap_del (frozen);
+
+   return !error;
+}
+
+// Checks that the cursor visits exactly the keys "%zu" of order[0..n-1],
+// in that order.
+static bool check_order (ds_hmap_t *hm, const size_t *order, size_t n, const char *msg)
+{
+   ds_hmap_iter_t it;
+   size_t count = 0;
+   char key[32];
+
+   ds_hmap_iter_init (hm, &it);
+   while (ds_hmap_iter_next (&it)) {
+      if (count < n)
+         snprintf (key, sizeof key, "%zu", order[count]);
+      if (count >= n || strcmp (it.key, key) != 0) {
+         fprintf (stderr, "[%s] Entry %zu is [%s], expected [%s]\n", msg, count,
+                  (const char *)it.key, count < n ? key : "none");
+         return false;
+      }
+      count++;
+   }
+
+   if (count != n || ds_hmap_num_entries (hm) != n) {
+      fprintf (stderr, "[%s] Found %zu of %zu entries\n", msg, count, n);
+      return false;
+   }
+
+   return true;
+}
+
+static bool order_test (void)
+{
+   bool error = true;
+   static const char *msg = "Insertion order";
+
+   ds_hmap_config_t config = { .engine = ds_hmap_ENGINE_ORDERED };
+   ds_hmap_t *hm = NULL;
+   size_t order[3000];
+   size_t n = 0;
+   char key[32];
+   ds_hmap_iter_t it;
+
+   if (!(hm = ds_hmap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   // Keys in descending order, so that no other order can match by chance
+   for (size_t i=2000; i>0; i--) {
+      snprintf (key, sizeof key, "%zu", i);
+      if (!(ds_hmap_set_str_str (hm, key, "value"))) {
+         fprintf (stderr, "[%s] Failed to set [%s]\n", msg, key);
+         goto errorexit;
+      }
+   }
+
+   // Remove two thirds of the keys, which compacts the entries several
+   // times, and replace the values of some of the others, which must not
+   // move them.
+   for (size_t i=2000; i>0; i--) {
+      snprintf (key, sizeof key, "%zu", i);
+      if (i % 3) {
+         ds_hmap_remove_str (hm, key);
+      } else {
+         ds_hmap_set_str_str (hm, key, "new value");
+         order[n++] = i;
+      }
+   }
+
+   // Keys that are added again after being removed go to the end
+   for (size_t i=1; i<=10; i++) {
+      if (i % 3 == 0)
+         continue;
+      snprintf (key, sizeof key, "%zu", i);
+      ds_hmap_set_str_str (hm, key, "value");
+      order[n++] = i;
+   }
+
+   if (!(check_order (hm, order, n, msg)))
+      goto errorexit;
+
+   // Removing through the cursor leaves the rest of the order intact
+   ds_hmap_iter_init (hm, &it);
+   for (size_t i=0; ds_hmap_iter_next (&it); i++) {
+      if (i % 2)
+         ds_hmap_iter_remove (&it);
+   }
+   for (size_t i=0; i<(n + 1) / 2; i++) {
+      order[i] = order[2 * i];
+   }
+   n = (n + 1) / 2;
+
+   if (!(check_order (hm, order, n, msg)))
+      goto errorexit;
+
+   for (size_t i=2001; i<=3000; i++) {
+      snprintf (key, sizeof key, "%zu", i);
+      ds_hmap_set_str_str (hm, key, "value");
+      order[n++] = i;
+   }
+
+   if (!(check_order (hm, order, n, msg)))
+      goto errorexit;
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+
+   return !error;
+}
+
+// Keys-only hashmaps store no data: the set functions accept NULL data
+// and every lookup returns the stored key as the data.
+static bool keys_only_test (ds_hmap_engine_t engine, const char *msg)
+{
+   bool error = true;
+
+   ds_hmap_config_t config = { .capacity = 4, .engine = engine, .keys_only = true };
+   ds_hmap_config_t with_data = { .engine = engine };
+   ds_hmap_t *hm = NULL, *built = NULL, *plain = NULL;
+   const void *keys[3000];
+   size_t keylens[3000];
+   char keybufs[3000][64];
+   void *data[3000];
+   size_t datalen = 1, count = 0;
+   ds_hmap_iter_t it;
+
+   for (size_t i=0; i<3000; i++) {
+      keys[i] = make_key (i, keybufs[i], sizeof keybufs[i]);
+      keylens[i] = strlen (keybufs[i]) + 1;
+   }
+
+   if (!(hm = ds_hmap_new_ex (&config)) || !(plain = ds_hmap_new_ex (&with_data))) {
+      fprintf (stderr, "[%s] Failed to create hashmap\n", msg);
+      goto errorexit;
+   }
+
+   if (ds_hmap_set (plain, keys[0], keylens[0], NULL, 0)) {
+      fprintf (stderr, "[%s] Set NULL data in a hashmap with data\n", msg);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<1000; i++) {
+      if (!(ds_hmap_set (hm, keys[i], keylens[i], NULL, 0))) {
+         fprintf (stderr, "[%s] Failed to set [%s]\n", msg, keybufs[i]);
+         goto errorexit;
+      }
+   }
+   if (ds_hmap_set_many (hm, 2000, &keys[1000], &keylens[1000], NULL, NULL) != 2000) {
+      fprintf (stderr, "[%s] Failed to set a batch of keys\n", msg);
+      goto errorexit;
+   }
+
+   // Remove every other key, half of them through the cursor
+   for (size_t i=0; i<1500; i+=2) {
+      ds_hmap_remove (hm, keys[i], keylens[i]);
+   }
+   ds_hmap_iter_init (hm, &it);
+   while (ds_hmap_iter_next (&it)) {
+      size_t i = (size_t)strtoull (strchr (it.key, ' ') ? strrchr (it.key, ' ') + 1
+                                                        : it.key, NULL, 10);
+      if (it.data != it.key || it.datalen) {
+         fprintf (stderr, "[%s] Cursor returned data for [%s]\n", msg, keybufs[i]);
+         goto errorexit;
+      }
+      if (i >= 1500 && i % 2 == 0)
+         ds_hmap_iter_remove (&it);
+   }
+
+   if (!(ds_hmap_shrink_to_fit (hm)) || ds_hmap_num_entries (hm) != 1500) {
+      fprintf (stderr, "[%s] %zu entries after removal\n", msg, ds_hmap_num_entries (hm));
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<3000; i++) {
+      const void *d = NULL;
+      bool found = ds_hmap_get (hm, keys[i], keylens[i], (void **)&d, &datalen);
+      if (found != (i % 2 == 1) || (found && (memcmp (d, keys[i], keylens[i]) || datalen))) {
+         fprintf (stderr, "[%s] Wrong result for [%s]\n", msg, keybufs[i]);
+         goto errorexit;
+      }
+   }
+
+   if (ds_hmap_get_many (hm, 3000, keys, keylens, data, NULL) != 1500) {
+      fprintf (stderr, "[%s] Wrong batch lookup\n", msg);
+      goto errorexit;
+   }
+   for (size_t i=0; i<3000; i++) {
+      if ((data[i] != NULL) != (i % 2 == 1)) {
+         fprintf (stderr, "[%s] Wrong batch result for [%s]\n", msg, keybufs[i]);
+         goto errorexit;
+      }
+   }
+
+   if (!(built = ds_hmap_build_ex (3000, keys, keylens, NULL, NULL, 4, &config))
+         || ds_hmap_num_entries (built) != 3000) {
+      fprintf (stderr, "[%s] Failed to build a keys-only hashmap\n", msg);
+      goto errorexit;
+   }
+   ds_hmap_iter_init (built, &it);
+   while (ds_hmap_iter_next (&it)) {
+      count++;
+   }
+   if (count != 3000 || ds_hmap_build_ex (3000, keys, keylens, NULL, NULL, 4, &with_data)) {
+      fprintf (stderr, "[%s] Wrong keys-only build\n", msg);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmap_del (hm);
+   ds_hmap_del (built);
+   ds_hmap_del (plain);
+
+   return !error;
+}
+
+int main (void)
+{
+   int ret = EXIT_FAILURE;
+
+   if (!(small_test ())) {
+      fprintf (stderr, "Failed small test\n");
+      goto errorexit;
+   }
+
+   if (!(growth_test (ds_hmap_ENGINE_CHAINED, ds_hmap_REHASH_INCREMENTAL,
+                      "Incremental growth"))
+         || !(growth_test (ds_hmap_ENGINE_CHAINED, ds_hmap_REHASH_IMMEDIATE,
+                           "Immediate growth"))
+         || !(growth_test (ds_hmap_ENGINE_CHAINED, ds_hmap_REHASH_NONE,
+                           "No growth"))
+         || !(growth_test (ds_hmap_ENGINE_FLAT, ds_hmap_REHASH_INCREMENTAL,
+                           "Flat table growth"))
+         || !(growth_test (ds_hmap_ENGINE_ORDERED, ds_hmap_REHASH_INCREMENTAL,
+                           "Ordered table growth"))) {
+      fprintf (stderr, "Failed growth test\n");
+      goto errorexit;
+   }
+
+   if (!(hashfn_test ())
+         || !(callback_test (ds_hmap_ENGINE_CHAINED, "Chained callbacks"))
+         || !(callback_test (ds_hmap_ENGINE_FLAT, "Flat callbacks"))
+         || !(callback_test (ds_hmap_ENGINE_ORDERED, "Ordered callbacks"))
+         || !(prefix_test (ds_hmap_ENGINE_CHAINED, "Chained prefix keys"))
+         || !(prefix_test (ds_hmap_ENGINE_FLAT, "Flat prefix keys"))
+         || !(prefix_test (ds_hmap_ENGINE_ORDERED, "Ordered prefix keys"))
+         || !(keylen_test (ds_hmap_ENGINE_CHAINED, "Chained key lengths"))
+         || !(keylen_test (ds_hmap_ENGINE_FLAT, "Flat key lengths"))
+         || !(keylen_test (ds_hmap_ENGINE_ORDERED, "Ordered key lengths"))) {
+      fprintf (stderr, "Failed hash function test\n");
+      goto errorexit;
+   }
+
+   if (!(stats_test (ds_hmap_ENGINE_CHAINED, ds_hmap_REHASH_INCREMENTAL, 0.0f,
+                     "Incremental statistics"))
+         || !(stats_test (ds_hmap_ENGINE_CHAINED, ds_hmap_REHASH_NONE, 0.0f,
+                          "Large bucket statistics"))
+         || !(stats_test (ds_hmap_ENGINE_FLAT, ds_hmap_REHASH_INCREMENTAL, 0.0f,
+                          "Flat statistics"))
+         || !(stats_test (ds_hmap_ENGINE_ORDERED, ds_hmap_REHASH_INCREMENTAL, 0.0f,
+                          "Ordered statistics"))) {
+      fprintf (stderr, "Failed statistics test\n");
+      goto errorexit;
+   }
+
+   if (!(iter_test (ds_hmap_ENGINE_CHAINED, "Chained cursor"))
+         || !(iter_test (ds_hmap_ENGINE_FLAT, "Flat cursor"))
+         || !(iter_test (ds_hmap_ENGINE_ORDERED, "Ordered cursor"))
+         || !(order_test ())) {
+      fprintf (stderr, "Failed iterator test\n");
+      goto errorexit;
+   }
+
+   if (!(keys_only_test (ds_hmap_ENGINE_CHAINED, "Chained keys only"))
+         || !(keys_only_test (ds_hmap_ENGINE_FLAT, "Flat keys only"))
+         || !(keys_only_test (ds_hmap_ENGINE_ORDERED, "Ordered keys only"))) {
+      fprintf (stderr, "Failed keys-only test\n");
+      goto errorexit;
+   }
+
+   if (!(many_test (ds_hmap_ENGINE_CHAINED, "Chained batches"))
+         || !(many_test (ds_hmap_ENGINE_FLAT, "Flat batches"))
+         || !(many_test (ds_hmap_ENGINE_ORDERED, "Ordered batches"))) {
+      fprintf (stderr, "Failed batch test\n");
+      goto errorexit;
+   }
+
+   if (!(build_test (ds_hmap_ENGINE_CHAINED, 1, "Chained build"))
+         || !(build_test (ds_hmap_ENGINE_CHAINED, 4, "Chained parallel build"))
+         || !(build_test (ds_hmap_ENGINE_FLAT, 4, "Flat build"))
+         || !(build_test (ds_hmap_ENGINE_ORDERED, 4, "Ordered build"))) {
+      fprintf (stderr, "Failed bulk build test\n");
+      goto errorexit;
+   }
+
+   if (!(resize_test (ds_hmap_ENGINE_CHAINED, "Chained clear and resize"))
+         || !(resize_test (ds_hmap_ENGINE_FLAT, "Flat clear and resize"))
+         || !(resize_test (ds_hmap_ENGINE_ORDERED, "Ordered clear and resize"))) {
+      fprintf (stderr, "Failed clear and resize test\n");
+      goto errorexit;
+   }
+
+   if (!(hashed_test ())) {
+      fprintf (stderr, "Failed precomputed hash test\n");
+      goto errorexit;
+   }
+
+   if (!(bloom_test (ds_hmap_ENGINE_CHAINED, "Chained filter"))
+         || !(bloom_test (ds_hmap_ENGINE_FLAT, "Flat filter"))
+         || !(bloom_test (ds_hmap_ENGINE_ORDERED, "Ordered filter"))) {
+      fprintf (stderr, "Failed filter test\n");
+      goto errorexit;
+   }
+
+   if (!(freeze_test (ds_hmap_ENGINE_CHAINED, 5000, "Frozen chained"))
+         || !(freeze_test (ds_hmap_ENGINE_FLAT, 5000, "Frozen flat"))
+         || !(freeze_test (ds_hmap_ENGINE_ORDERED, 5000, "Frozen ordered"))
+         || !(freeze_test (ds_hmap_ENGINE_FLAT, 1, "Frozen single key"))
+         || !(freeze_test (ds_hmap_ENGINE_CHAINED, 0, "Frozen empty"))) {
+      fprintf (stderr, "Failed freeze test\n");
+      goto errorexit;
+   }
+
+   if (!(save_test (ds_hmap_ENGINE_CHAINED, 5000, "Saved chained"))
+         || !(save_test (ds_hmap_ENGINE_FLAT, 5000, "Saved flat"))
+         || !(save_test (ds_hmap_ENGINE_FLAT, 0, "Saved empty"))) {
+      fprintf (stderr, "Failed save test\n");
+      goto errorexit;
+   }
+
+   if (!(u64_test (ds_hmap_ENGINE_CHAINED, ds_hmap_KEYS_U64, "Chained integer keys"))
+         || !(u64_test (ds_hmap_ENGINE_FLAT, ds_hmap_KEYS_U64, "Flat integer keys"))
+         || !(u64_test (ds_hmap_ENGINE_ORDERED, ds_hmap_KEYS_U64, "Ordered integer keys"))
+         || !(u64_test (ds_hmap_ENGINE_FLAT, ds_hmap_KEYS_BYTES, "Integers as bytes"))) {
+      fprintf (stderr, "Failed integer key test\n");
+      goto errorexit;
+   }
+
+   if (!(large_test ())) {
+      fprintf (stderr, "Failed large test\n");
+      goto errorexit;
+   }
+
+   ret = EXIT_SUCCESS;
+
 errorexit:
 
    return ret;
@@ -0,0 +1,221 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds_hmultimap.h"
+
+/* ******************************************************************
+ * The hashmap maps each key to a block holding all of its values. The
+ * block starts with room for a single value, which is all that most keys
+ * ever have, and doubles in size as values are added. Each key is hashed
+ * once per call; the hash is used both to find the block and to point the
+ * entry at a larger block.
+ */
+typedef struct mvals_t mvals_t;
+struct mvals_t {
+   size_t                  nvalues;
+   size_t                  nalloc;
+   ds_hmultimap_value_t    values[];
+};
+
+struct ds_hmultimap_t {
+   ds_hmap_t     *hm;
+   size_t         nvalues;
+};
+
+static mvals_t *mm_find (ds_hmultimap_t *mm, uint64_t hash,
+                         const void *key, size_t keylen)
+{
+   void *ret = NULL;
+
+   return ds_hmap_get_hashed (mm->hm, hash, key, keylen, &ret, NULL) ? ret : NULL;
+}
+
+static void free_block (const void *key, size_t keylen,
+                        void *data, size_t datalen, void *param)
+{
+   (void)key;
+   (void)keylen;
+   (void)datalen;
+   (void)param;
+   free (data);
+}
+
+ds_hmultimap_t *ds_hmultimap_new (void)
+{
+   return ds_hmultimap_new_ex (NULL);
+}
+
+ds_hmultimap_t *ds_hmultimap_new_ex (const ds_hmap_config_t *config)
+{
+   bool error = true;
+   ds_hmultimap_t *ret = NULL;
+
+   if (!(ret = calloc (1, sizeof *ret)))
+      goto errorexit;
+
+   if (!(ret->hm = ds_hmap_new_ex (config)))
+      goto errorexit;
+
+   error = false;
+
+errorexit:
+
+   if (error) {
+      ds_hmultimap_del (ret);
+      ret = NULL;
+   }
+
+   return ret;
+}
+
+void ds_hmultimap_del (ds_hmultimap_t *mm)
+{
+   if (!mm)
+      return;
+
+   if (mm->hm)
+      ds_hmap_iterate (mm->hm, free_block, NULL);
+   ds_hmap_del (mm->hm);
+   free (mm);
+}
+
+bool ds_hmultimap_add (ds_hmultimap_t *mm, const void *key, size_t keylen,
+                                           void *data, size_t datalen)
+{
+   if (!mm || !key)
+      return false;
+
+   uint64_t hash = ds_hmap_hash (mm->hm, key, keylen);
+   mvals_t *mv = mm_find (mm, hash, key, keylen);
+
+   // The entry is pointed at the larger block before the old one is
+   // freed, so that a failure leaves the key with the values it had.
+   if (!mv || mv->nvalues == mv->nalloc) {
+      size_t nalloc = mv ? mv->nalloc * 2 : 1;
+      mvals_t *tmp = malloc (sizeof *tmp + nalloc * sizeof tmp->values[0]);
+      if (!tmp)
+         return false;
+
+      tmp->nvalues = 0;
+      tmp->nalloc = nalloc;
+      if (mv) {
+         memcpy (tmp->values, mv->values, mv->nvalues * sizeof mv->values[0]);
+         tmp->nvalues = mv->nvalues;
+      }
+
+      if (!(ds_hmap_set_hashed (mm->hm, hash, key, keylen, tmp, sizeof *tmp))) {
+         free (tmp);
+         return false;
+      }
+      free (mv);
+      mv = tmp;
+   }
+
+   mv->values[mv->nvalues].data = data;
+   mv->values[mv->nvalues].datalen = datalen;
+   mv->nvalues++;
+   mm->nvalues++;
+
+   return true;
+}
+
+size_t ds_hmultimap_get (ds_hmultimap_t *mm, const void *key, size_t keylen,
+                         const ds_hmultimap_value_t **values)
+{
+   mvals_t *mv = NULL;
+
+   if (mm && key)
+      mv = mm_find (mm, ds_hmap_hash (mm->hm, key, keylen), key, keylen);
+
+   if (values)
+      *values = mv ? mv->values : NULL;
+
+   return mv ? mv->nvalues : 0;
+}
+
+bool ds_hmultimap_remove_value (ds_hmultimap_t *mm,
+                                const void *key, size_t keylen,
+                                const void *data)
+{
+   mvals_t *mv;
+
+   if (!mm || !key)
+      return false;
+
+   if (!(mv = mm_find (mm, ds_hmap_hash (mm->hm, key, keylen), key, keylen)))
+      return false;
+
+   for (size_t i=0; i<mv->nvalues; i++) {
+      if (mv->values[i].data != data)
+         continue;
+
+      if (mv->nvalues == 1) {
+         ds_hmultimap_remove (mm, key, keylen);
+         return true;
+      }
+
+      memmove (&mv->values[i], &mv->values[i + 1],
+               (mv->nvalues - i - 1) * sizeof mv->values[0]);
+      mv->nvalues--;
+      mm->nvalues--;
+      return true;
+   }
+
+   return false;
+}
+
+void ds_hmultimap_remove (ds_hmultimap_t *mm, const void *key, size_t keylen)
+{
+   mvals_t *mv;
+
+   if (!mm || !key)
+      return;
+
+   if (!(mv = mm_find (mm, ds_hmap_hash (mm->hm, key, keylen), key, keylen)))
+      return;
+
+   ds_hmap_remove (mm->hm, key, keylen);
+   mm->nvalues -= mv->nvalues;
+   free (mv);
+}
+
+size_t ds_hmultimap_num_keys (ds_hmultimap_t *mm)
+{
+   return mm ? ds_hmap_num_entries (mm->hm) : 0;
+}
+
+size_t ds_hmultimap_num_values (ds_hmultimap_t *mm)
+{
+   return mm ? mm->nvalues : 0;
+}
+
+bool ds_hmultimap_clear (ds_hmultimap_t *mm)
+{
+   if (!mm)
+      return false;
+
+   ds_hmap_iterate (mm->hm, free_block, NULL);
+   mm->nvalues = 0;
+
+   return ds_hmap_clear (mm->hm);
+}
+
+void ds_hmultimap_iterate (ds_hmultimap_t *mm,
+                           void (*fptr) (const void *key, size_t keylen,
+                                         const ds_hmultimap_value_t *values,
+                                         size_t nvalues,
+                                         void *extra_param),
+                           void *extra_param)
+{
+   ds_hmap_iter_t it;
+
+   if (!mm || !fptr)
+      return;
+
+   ds_hmap_iter_init (mm->hm, &it);
+   while (ds_hmap_iter_next (&it)) {
+      const mvals_t *mv = it.data;
+      fptr (it.key, it.keylen, mv->values, mv->nvalues, extra_param);
+   }
+}
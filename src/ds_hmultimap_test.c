@@ -0,0 +1,174 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ds_hmultimap.h"
+
+#define NKEYS        (2000)
+
+// Key i has i % 7 values, value j of key i is &values[i + j]
+static char values[NKEYS + 7];
+
+// The same keys as make_key() in ds_hmap_test.c: every third key is too
+// long to be stored inline.
+static char *make_key (size_t n, char *buf, size_t len)
+{
+   snprintf (buf, len, n % 3 ? "%zu" : "a key that is stored in the arena %zu", n);
+   return buf;
+}
+
+static bool check_key (ds_hmultimap_t *mm, const char *msg, size_t i,
+                       size_t first, size_t nvalues)
+{
+   const ds_hmultimap_value_t *v = NULL;
+   char key[64];
+   size_t n = ds_hmultimap_get_str (mm, make_key (i, key, sizeof key), &v);
+
+   if (n != nvalues || (!n && v)) {
+      fprintf (stderr, "[%s] Key [%s] has %zu values, expected %zu\n", msg,
+               key, n, nvalues);
+      return false;
+   }
+
+   for (size_t j=0; j<n; j++) {
+      if (v[j].data != &values[i + first + j] || v[j].datalen != first + j) {
+         fprintf (stderr, "[%s] Key [%s] value %zu is wrong\n", msg,
+                  key, j);
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static void count_values (const void *key, size_t keylen,
+                          const ds_hmultimap_value_t *values, size_t nvalues,
+                          void *extra_param)
+{
+   size_t *counts = extra_param;
+
+   (void)key;
+   (void)keylen;
+   (void)values;
+   counts[0]++;
+   counts[1] += nvalues;
+}
+
+static bool multimap_test (ds_hmap_engine_t engine, const char *msg)
+{
+   bool error = true;
+   ds_hmap_config_t config = { .engine = engine };
+   ds_hmultimap_t *mm = NULL;
+   size_t nkeys = 0, nvalues = 0;
+   size_t counts[2] = { 0, 0 };
+   char key[64];
+
+   if (!(mm = ds_hmultimap_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create multimap\n", msg);
+      goto errorexit;
+   }
+
+   // The values of the keys are added interleaved
+   for (size_t j=0; j<7; j++) {
+      for (size_t i=0; i<NKEYS; i++) {
+         make_key (i, key, sizeof key);
+         if (j < i % 7
+               && !(ds_hmultimap_add (mm, key, strlen (key) + 1, &values[i + j], j))) {
+            fprintf (stderr, "[%s] Failed to add [%s]\n", msg, key);
+            goto errorexit;
+         }
+      }
+   }
+
+   for (size_t i=0; i<NKEYS; i++) {
+      if (!(check_key (mm, msg, i, 0, i % 7)))
+         goto errorexit;
+      nkeys += i % 7 > 0;
+      nvalues += i % 7;
+   }
+
+   ds_hmultimap_iterate (mm, count_values, counts);
+   if (ds_hmultimap_num_keys (mm) != nkeys || ds_hmultimap_num_values (mm) != nvalues
+         || counts[0] != nkeys || counts[1] != nvalues) {
+      fprintf (stderr, "[%s] Wrong number of keys or values\n", msg);
+      goto errorexit;
+   }
+
+   // Removing the first value of each key keeps the order of the rest,
+   // and removes the keys that had a single value.
+   for (size_t i=0; i<NKEYS; i++) {
+      make_key (i, key, sizeof key);
+      if (ds_hmultimap_remove_value (mm, key, strlen (key) + 1, &values[i]) != (i % 7 > 0)) {
+         fprintf (stderr, "[%s] Failed to remove a value of [%s]\n", msg, key);
+         goto errorexit;
+      }
+   }
+   for (size_t i=0; i<NKEYS; i++) {
+      if (!(check_key (mm, msg, i, 1, i % 7 ? i % 7 - 1 : 0)))
+         goto errorexit;
+   }
+
+   make_key (6, key, sizeof key);
+   if (ds_hmultimap_remove_value (mm, key, strlen (key) + 1, values)) {
+      fprintf (stderr, "[%s] Removed a value that is not there\n", msg);
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<NKEYS; i+=2) {
+      make_key (i, key, sizeof key);
+      ds_hmultimap_remove (mm, key, strlen (key) + 1);
+   }
+   nkeys = nvalues = 0;
+   for (size_t i=0; i<NKEYS; i++) {
+      size_t n = i % 2 && i % 7 ? i % 7 - 1 : 0;
+      if (!(check_key (mm, msg, i, 1, n)))
+         goto errorexit;
+      nkeys += n > 0;
+      nvalues += n;
+   }
+   if (ds_hmultimap_num_keys (mm) != nkeys || ds_hmultimap_num_values (mm) != nvalues) {
+      fprintf (stderr, "[%s] Wrong number of keys or values after removal\n", msg);
+      goto errorexit;
+   }
+
+   // NULL data is allowed
+   if (!(ds_hmultimap_clear (mm)) || ds_hmultimap_num_keys (mm)
+         || ds_hmultimap_num_values (mm)
+         || !(ds_hmultimap_add_str (mm, "null", NULL))
+         || !(ds_hmultimap_add_str (mm, "null", NULL))
+         || ds_hmultimap_get_str (mm, "null", NULL) != 2
+         || ds_hmultimap_get_str (mm, "0", NULL) != 0) {
+      fprintf (stderr, "[%s] Failed to clear\n", msg);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hmultimap_del (mm);
+
+   return !error;
+}
+
+int main (void)
+{
+   int ret = EXIT_FAILURE;
+
+   printf ("Testing hash multimaps, %s\n", ds_version);
+
+   if (!(multimap_test (ds_hmap_ENGINE_CHAINED, "Chained"))
+         || !(multimap_test (ds_hmap_ENGINE_FLAT, "Flat"))
+         || !(multimap_test (ds_hmap_ENGINE_ORDERED, "Ordered"))) {
+      fprintf (stderr, "Failed multimap test\n");
+      goto errorexit;
+   }
+
+   ret = EXIT_SUCCESS;
+
+errorexit:
+
+   return ret;
+}
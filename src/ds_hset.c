@@ -0,0 +1,174 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds_hset.h"
+
+/* ******************************************************************
+ * The keys are stored in a keys-only hashmap, whose entries have no data.
+ * A lookup in such a hashmap returns the stored key as the data, so a
+ * key that is not found is still the only one with NULL data.
+ */
+#define BATCH_LEN       (64)
+
+struct ds_hset_t {
+   ds_hmap_t     *hm;
+};
+
+ds_hset_t *ds_hset_new (void)
+{
+   return ds_hset_new_ex (NULL);
+}
+
+ds_hset_t *ds_hset_new_ex (const ds_hmap_config_t *config)
+{
+   bool error = true;
+   ds_hset_t *ret = NULL;
+   ds_hmap_config_t hconfig = { .keys_only = true };
+
+   if (config) {
+      hconfig = *config;
+      hconfig.keys_only = true;
+   }
+
+   if (!(ret = calloc (1, sizeof *ret)))
+      goto errorexit;
+
+   if (!(ret->hm = ds_hmap_new_ex (&hconfig)))
+      goto errorexit;
+
+   error = false;
+
+errorexit:
+
+   if (error) {
+      ds_hset_del (ret);
+      ret = NULL;
+   }
+
+   return ret;
+}
+
+void ds_hset_del (ds_hset_t *hs)
+{
+   if (!hs)
+      return;
+
+   ds_hmap_del (hs->hm);
+   free (hs);
+}
+
+bool ds_hset_add (ds_hset_t *hs, const void *key, size_t keylen)
+{
+   if (!hs || !key)
+      return false;
+
+   return ds_hmap_set (hs->hm, key, keylen, NULL, 0) != NULL;
+}
+
+bool ds_hset_contains (ds_hset_t *hs, const void *key, size_t keylen)
+{
+   if (!hs || !key)
+      return false;
+
+   return ds_hmap_get (hs->hm, key, keylen, NULL, NULL);
+}
+
+void ds_hset_remove (ds_hset_t *hs, const void *key, size_t keylen)
+{
+   if (!hs || !key)
+      return;
+
+   ds_hmap_remove (hs->hm, key, keylen);
+}
+
+size_t ds_hset_num_entries (ds_hset_t *hs)
+{
+   return hs ? ds_hmap_num_entries (hs->hm) : 0;
+}
+
+bool ds_hset_clear (ds_hset_t *hs)
+{
+   return hs ? ds_hmap_clear (hs->hm) : false;
+}
+
+// Fills the batch with the next keys of the cursor and returns how many
+// there were.
+static size_t gather_keys (ds_hmap_iter_t *it, const void **keys, size_t *keylens)
+{
+   size_t ret = 0;
+
+   while (ret < BATCH_LEN && ds_hmap_iter_next (it)) {
+      keys[ret] = it->key;
+      keylens[ret] = it->keylen;
+      ret++;
+   }
+
+   return ret;
+}
+
+bool ds_hset_union (ds_hset_t *dst, ds_hset_t *src)
+{
+   const void *keys[BATCH_LEN];
+   size_t keylens[BATCH_LEN];
+   ds_hmap_iter_t it;
+   size_t n;
+
+   if (!dst || !src)
+      return false;
+
+   if (dst == src)
+      return true;
+
+   ds_hmap_iter_init (src->hm, &it);
+   while ((n = gather_keys (&it, keys, keylens))) {
+      if (ds_hmap_set_many (dst->hm, n, keys, keylens, NULL, NULL) != n)
+         return false;
+   }
+
+   return true;
+}
+
+// The keys of dst are gathered a batch at a time by one cursor and looked
+// up in src, and a second cursor then walks over the same entries,
+// removing the ones that were not found. Removing an entry never moves
+// any other entry, so both cursors visit the entries in the same order.
+bool ds_hset_intersect (ds_hset_t *dst, ds_hset_t *src)
+{
+   const void *keys[BATCH_LEN];
+   size_t keylens[BATCH_LEN];
+   void *found[BATCH_LEN];
+   ds_hmap_iter_t ahead, behind;
+   size_t n;
+
+   if (!dst || !src)
+      return false;
+
+   if (dst == src)
+      return true;
+
+   ds_hmap_iter_init (dst->hm, &ahead);
+   ds_hmap_iter_init (dst->hm, &behind);
+
+   while ((n = gather_keys (&ahead, keys, keylens))) {
+      ds_hmap_get_many (src->hm, n, keys, keylens, found, NULL);
+
+      for (size_t i=0; i<n; i++) {
+         if (!(ds_hmap_iter_next (&behind)))
+            return false;
+
+         if (!found[i])
+            ds_hmap_iter_remove (&behind);
+      }
+   }
+
+   return true;
+}
+
+void ds_hset_iter_init (ds_hset_t *hs, ds_hmap_iter_t *it)
+{
+   if (!hs || !it)
+      return;
+
+   ds_hmap_iter_init (hs->hm, it);
+}
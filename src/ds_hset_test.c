@@ -0,0 +1,165 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ds_hset.h"
+
+// The same keys as make_key() in ds_hmap_test.c: every third key is too
+// long to be stored inline.
+static char *make_key (size_t n, char *buf, size_t len)
+{
+   snprintf (buf, len, n % 3 ? "%zu" : "a key that is stored in the arena %zu", n);
+   return buf;
+}
+
+// Adds the keys first to first + n - 1 that are multiples of step
+static bool add_keys (ds_hset_t *hs, size_t first, size_t n, size_t step)
+{
+   char key[64];
+
+   for (size_t i=first; i<first + n; i++) {
+      if (i % step == 0 && !(ds_hset_add_str (hs, make_key (i, key, sizeof key))))
+         return false;
+   }
+   return true;
+}
+
+// Checks that exactly the keys first to first + n - 1 that are multiples
+// of every one of the steps are in the set.
+static bool check_keys (ds_hset_t *hs, const char *msg, size_t first, size_t n,
+                        size_t step1, size_t step2)
+{
+   size_t count = 0;
+   char key[64];
+
+   for (size_t i=first; i<first + n; i++) {
+      bool expected = i % step1 == 0 && i % step2 == 0;
+      if (ds_hset_contains_str (hs, make_key (i, key, sizeof key)) != expected) {
+         fprintf (stderr, "[%s] Key [%s] %s\n", msg, key,
+                  expected ? "not found" : "found");
+         return false;
+      }
+      count += expected;
+   }
+
+   if (ds_hset_num_entries (hs) != count) {
+      fprintf (stderr, "[%s] Expected %zu keys, found %zu\n", msg, count,
+               ds_hset_num_entries (hs));
+      return false;
+   }
+
+   return true;
+}
+
+static bool set_test (ds_hmap_engine_t engine, const char *msg)
+{
+   bool error = true;
+   ds_hmap_config_t config = { .engine = engine };
+   ds_hset_t *a = NULL, *b = NULL;
+   ds_hmap_iter_t it;
+   size_t count = 0;
+   char key[64];
+
+   if (!(a = ds_hset_new_ex (&config)) || !(b = ds_hset_new_ex (&config))) {
+      fprintf (stderr, "[%s] Failed to create sets\n", msg);
+      goto errorexit;
+   }
+
+   // Adding a key twice keeps a single copy
+   if (!(add_keys (a, 0, 1000, 1)) || !(add_keys (a, 0, 1000, 1))
+         || !(check_keys (a, msg, 0, 1000, 1, 1)))
+      goto errorexit;
+
+   for (size_t i=1; i<1000; i+=2) {
+      ds_hset_remove_str (a, make_key (i, key, sizeof key));
+   }
+   if (!(check_keys (a, msg, 0, 1000, 2, 1)))
+      goto errorexit;
+
+   ds_hset_iter_init (a, &it);
+   while (ds_hmap_iter_next (&it)) {
+      size_t n;
+      const char *key = it.key;
+      if (strncmp (key, "a key", 5) == 0)
+         key = strrchr (key, ' ') + 1;
+      if (sscanf (key, "%zu", &n) != 1 || n % 2) {
+         fprintf (stderr, "[%s] Unexpected key [%s]\n", msg, (const char *)it.key);
+         goto errorexit;
+      }
+      count++;
+   }
+   if (count != 500) {
+      fprintf (stderr, "[%s] Iterated over %zu keys\n", msg, count);
+      goto errorexit;
+   }
+
+   // Multiples of 2 and of 3 from 0 to 20000 give the multiples of 6
+   if (!(ds_hset_clear (a)) || !(add_keys (a, 0, 20000, 2))
+         || !(add_keys (b, 0, 20000, 3))
+         || !(ds_hset_intersect (a, b))
+         || !(check_keys (a, msg, 0, 20000, 2, 3))
+         || !(check_keys (b, msg, 0, 20000, 3, 1))) {
+      fprintf (stderr, "[%s] Failed intersection\n", msg);
+      goto errorexit;
+   }
+
+   // Multiples of 6 and of 3 give the multiples of 3
+   if (!(ds_hset_union (a, b)) || !(check_keys (a, msg, 0, 20000, 3, 1))) {
+      fprintf (stderr, "[%s] Failed union\n", msg);
+      goto errorexit;
+   }
+
+   // With an empty set
+   if (!(ds_hset_clear (b)) || !(ds_hset_union (a, b))
+         || !(check_keys (a, msg, 0, 20000, 3, 1))
+         || !(ds_hset_union (b, a)) || !(check_keys (b, msg, 0, 20000, 3, 1))
+         || !(ds_hset_clear (b)) || !(ds_hset_intersect (a, b))
+         || ds_hset_num_entries (a)) {
+      fprintf (stderr, "[%s] Failed operations with an empty set\n", msg);
+      goto errorexit;
+   }
+
+   // With itself
+   if (!(add_keys (a, 0, 100, 1)) || !(ds_hset_union (a, a))
+         || !(ds_hset_intersect (a, a)) || !(check_keys (a, msg, 0, 100, 1, 1))) {
+      fprintf (stderr, "[%s] Failed operations with itself\n", msg);
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_hset_del (a);
+   ds_hset_del (b);
+
+   return !error;
+}
+
+int main (void)
+{
+   int ret = EXIT_FAILURE;
+
+   printf ("Testing hash sets, %s\n", ds_version);
+
+   if (!(set_test (ds_hmap_ENGINE_CHAINED, "Chained"))
+         || !(set_test (ds_hmap_ENGINE_FLAT, "Flat"))
+         || !(set_test (ds_hmap_ENGINE_ORDERED, "Ordered"))) {
+      fprintf (stderr, "Failed set test\n");
+      goto errorexit;
+   }
+
+   if (ds_hset_add (NULL, "a", 2) || ds_hset_contains (NULL, "a", 2)
+         || ds_hset_num_entries (NULL) || ds_hset_union (NULL, NULL)) {
+      fprintf (stderr, "Failed NULL parameter test\n");
+      goto errorexit;
+   }
+
+   ret = EXIT_SUCCESS;
+
+errorexit:
+
+   return ret;
+}
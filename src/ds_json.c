@@ -254,8 +254,12 @@ size_t ds_json_nbuckets = 20;
 
 static ds_json_t *json_new_object (void)
 {
+   // Fields are kept in the order that they were parsed or added in, so
+   // that stringifying an object gives back the same document.
+   ds_hmap_config_t config = { .engine = ds_hmap_ENGINE_ORDERED,
+                               .capacity = ds_json_nbuckets };
    ds_json_t *ret = json_new (ds_json_OBJECT);
-   if (!ret || !(ret->value._kvpairs = ds_hmap_new (ds_json_nbuckets))) {
+   if (!ret || !(ret->value._kvpairs = ds_hmap_new_ex (&config))) {
       ds_json_del (ret);
       ret = NULL;
    }
@@ -936,31 +940,25 @@ static void stringify (const ds_json_t *json, struct stringify_t *sobj);
 
 void stringify_object (const ds_json_t *json, struct stringify_t *sobj)
 {
-   char **keys = NULL;
+   ds_hmap_iter_t it;
    const char *delim = "";
-   if (!(ds_hmap_keys (json->value._kvpairs, (void ***)&keys, NULL))) {
-      // ERROR
-   }
 
    ds_str_append (&sobj->output, "{\n", NULL);
    sobj->depth++;
 
-   for (size_t i=0; keys && keys[i]; i++) {
-      ds_json_t *value = NULL;
+   ds_hmap_iter_init (json->value._kvpairs, &it);
+   while (ds_hmap_iter_next (&it)) {
       ds_str_append (&sobj->output, delim, NULL);
       delim = ",\n";
       INDENT(sobj);
-      ds_str_append (&sobj->output, "\"", keys[i], "\": ", NULL);
-      ds_hmap_get_str_ptr (json->value._kvpairs, keys[i], (void **)&value);
-      stringify (value, sobj);
+      ds_str_append (&sobj->output, "\"", (const char *)it.key, "\": ", NULL);
+      stringify (it.data, sobj);
    }
 
    ds_str_append (&sobj->output, "\n", NULL);
    sobj->depth--;
    INDENT(sobj);
    ds_str_append (&sobj->output, "}", NULL);
-
-   free (keys);
 }
 
 void stringify_array (const ds_json_t *json, struct stringify_t *sobj)
@@ -1109,50 +1107,43 @@ ds_json_t *ds_json_get_index (const ds_json_t *json, size_t index)
 
 static const ds_json_t * json_geta (const ds_json_t *obj, char **path)
 {
-   char **names = NULL;
-
    if (!obj || path[0] == NULL)
       return obj;
 
-   if (!(names = ds_json_fieldnames (obj)))
+   if (obj->type != ds_json_OBJECT)
       return NULL;
 
-   for (size_t i=0; names && names[i]; i++) {
-      char *arr_start = strchr (path[0], '[');
-      char *arr_end = strchr (path[0], ']');
-      if (arr_start && !arr_end) {
-         free (names);
-         return NULL;
-      }
+   char *arr_start = strchr (path[0], '[');
+   char *arr_end = strchr (path[0], ']');
+   if (arr_start && !arr_end)
+      return NULL;
 
-      size_t arr_index = (size_t)-1;
-      if (arr_start) {
-         *arr_start = 0;
-         *arr_end = 0;
-         sscanf (&arr_start[1], "%zu", &arr_index);
-      }
+   // The name is the part of the path element before any index
+   size_t namelen = arr_start ? (size_t)(arr_start - path[0]) : strlen (path[0]);
+   size_t arr_index = (size_t)-1;
+   if (arr_start)
+      sscanf (&arr_start[1], "%zu", &arr_index);
 
-      if ((strcmp (names[i], path[0])) == 0) {
-         if (arr_start) {
-            *arr_start = '[';
-            *arr_end = ']';
-         }
-         ds_json_t *found = NULL;
-         ds_hmap_get_str_ptr (obj->value._kvpairs, names[i], (void **)&found);
-         free (names);
-         if (arr_index != (size_t)-1) {
-            return json_geta (ds_json_get_index (found, arr_index), &path[1]);
-         } else {
-            return json_geta (found, &path[1]);
-         }
-      }
-      if (arr_start) {
-         *arr_start = '[';
-         *arr_end = ']';
-      }
-   }
-   free (names);
-   return NULL;
+   // The keys are stored with their terminating nul byte, so the name is
+   // terminated in place for the lookup when an index follows it.
+   ds_hmap_t *kvpairs = obj->value._kvpairs;
+   ds_json_t *found = NULL;
+
+   if (arr_start)
+      *arr_start = 0;
+
+   bool exists = ds_hmap_get (kvpairs, path[0], namelen + 1, (void **)&found, NULL);
+
+   if (arr_start)
+      *arr_start = '[';
+
+   if (!exists)
+      return NULL;
+
+   if (arr_index != (size_t)-1)
+      return json_geta (ds_json_get_index (found, arr_index), &path[1]);
+
+   return json_geta (found, &path[1]);
 }
 
 const ds_json_t *ds_json_geta (const ds_json_t *obj, char **path)
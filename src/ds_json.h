@@ -41,9 +41,11 @@ extern "C" {
    // Get the type of the object
    enum ds_json_object_type_t ds_json_type (const ds_json_t *json);
 
-   // Gets the fieldnames of the object, IFF it is of type ds_json_OBJECT. On error
-   // or if the specified object is not a ds_json_OBJECT type, returns NULL.
-   // Caller must free the returned array as well as all the elements of the array
+   // Gets the fieldnames of the object, IFF it is of type ds_json_OBJECT, in the
+   // order that the fields appear in the source. On error or if the specified
+   // object is not a ds_json_OBJECT type, returns NULL.
+   // Caller must free only the array; the names are valid until the object
+   // is next modified.
    char **ds_json_fieldnames (const ds_json_t *json);
 
    // Gets the value from an array at the specified index, or NULL if the specified
@@ -228,6 +228,52 @@ cleanup:
    return ret;
 }
 
+static int test_field_order (void)
+{
+   int ret = EXIT_FAILURE;
+   static const char *src = "{ \"zulu\": 1, \"alpha\": 2, \"mike\": { \"yankee\": 3, \"bravo\": 4 } }";
+   static const char *expected[] = { "zulu", "alpha", "mike", "yankee", "bravo" };
+   ds_json_t *obj = NULL;
+   char *output = NULL;
+   char **names = NULL;
+
+   if (!(obj = ds_json_parse_string ("field-order", src))) {
+      EPRINTF ("Failed to parse [%s]\n", src);
+      goto cleanup;
+   }
+
+   // Fields come out in the order that they appear in the source
+   if (!(names = ds_json_fieldnames (obj))
+         || !names[0] || strcmp (names[0], "zulu") != 0
+         || !names[1] || strcmp (names[1], "alpha") != 0
+         || !names[2] || strcmp (names[2], "mike") != 0
+         || names[3]) {
+      EPRINTF ("Fieldnames are not in source order\n");
+      goto cleanup;
+   }
+
+   if (!(output = ds_json_stringify (obj))) {
+      EPRINTF ("Failed to stringify object\n");
+      goto cleanup;
+   }
+
+   const char *pos = output;
+   for (size_t i=0; i<sizeof expected / sizeof expected[0]; i++) {
+      if (!(pos = strstr (pos, expected[i]))) {
+         EPRINTF ("Field [%s] out of order in:\n%s\n", expected[i], output);
+         goto cleanup;
+      }
+   }
+
+   ret = EXIT_SUCCESS;
+
+cleanup:
+   free (names);
+   free (output);
+   ds_json_del (obj);
+   return ret;
+}
+
 int main (void)
 {
    int ret = EXIT_FAILURE;
@@ -238,6 +284,7 @@ int main (void)
    } tests[] = {
       { "fslurp",          test_fslurp },
       { "json_string",     test_json_string},
+      { "field_order",     test_field_order},
    };
 
 
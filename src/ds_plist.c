@@ -4,13 +4,15 @@
 
 #include "ds_plist.h"
 #include "ds_array.h"
+#include "ds_deque.h"
 #include "ds_str.h"
 
 
 /* ************************************************************************ */
 struct nvlist_t {
    char *name;
-   ds_array_t *array_values;
+   // New values are inserted at the head
+   ds_deque_t *values;
 };
 
 static void lfree (void *p, void *param)
@@ -24,8 +26,8 @@ static void nvlist_del (struct nvlist_t *nvl, void *param)
    (void)param;
    if (nvl) {
       free (nvl->name);
-      ds_array_iterate (nvl->array_values, lfree, NULL);
-      ds_array_del (nvl->array_values);
+      ds_deque_iterate (nvl->values, lfree, NULL);
+      ds_deque_del (nvl->values);
       free (nvl);
    }
 }
@@ -36,10 +38,10 @@ static struct nvlist_t *nvlist_new (const char *name)
 
    if (ret) {
       ret->name = ds_str_dup (name);
-      ret->array_values = ds_array_new ();
+      ret->values = ds_deque_new ();
    }
 
-   if (!ret || !ret->name || !ret->array_values) {
+   if (!ret || !ret->name || !ret->values) {
       nvlist_del (ret, NULL);
       ret = NULL;
    }
@@ -52,16 +54,19 @@ static bool nvlist_append (struct nvlist_t *nvl, const char *value)
    if (!nvl || !value)
       return false;
 
-   size_t nitems = ds_array_length (nvl->array_values);
+   size_t nitems = ds_deque_length (nvl->values);
    for (size_t i=0; i<nitems; i++) {
-      const char *item = ds_array_get (nvl->array_values, i);
+      const char *item = ds_deque_get (nvl->values, i);
       if ((strcmp (item, value))==0) {
          return true;
       }
    }
 
-   if (!(ds_array_ins_head (nvl->array_values, ds_str_dup (value))))
+   char *tmp = ds_str_dup (value);
+   if (!tmp || !(ds_deque_ins_head (nvl->values, tmp))) {
+      free (tmp);
       return false;
+   }
 
    return true;
 }
@@ -174,9 +179,9 @@ static void plist_dump (ds_plist_t *plist, FILE *outf, size_t indent)
       struct nvlist_t *value = ds_array_get (plist->array_elements, i);
       PRINT_INDENT (indent + 3);
       fprintf (outf, "name [%s]: ", value->name);
-      size_t nvalues = ds_array_length (value->array_values);
+      size_t nvalues = ds_deque_length (value->values);
       for (size_t j=0; j<nvalues; j++) {
-         fprintf (outf, "[%s] ", (char *)ds_array_get (value->array_values, j));
+         fprintf (outf, "[%s] ", (char *)ds_deque_get (value->values, j));
       }
       fprintf (outf, "\n");
    }
@@ -0,0 +1,274 @@
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ds_varray.h"
+
+#define MIN_CAPACITY       (4)
+
+struct ds_varray_t {
+   unsigned char *data;
+   size_t         elemsize;
+   size_t         nitems;
+   size_t         capacity;
+};
+
+#define ELEM(va,i)         (&(va)->data[(i) * (va)->elemsize])
+
+ds_varray_t *ds_varray_new (size_t elemsize)
+{
+   ds_varray_t *ret = NULL;
+
+   if (!elemsize || !(ret = calloc (1, sizeof *ret)))
+      return NULL;
+
+   ret->elemsize = elemsize;
+
+   return ret;
+}
+
+void ds_varray_del (ds_varray_t *va)
+{
+   if (!va)
+      return;
+
+   free (va->data);
+   free (va);
+}
+
+ds_varray_t *ds_varray_copy (const ds_varray_t *src, size_t from, size_t to)
+{
+   ds_varray_t *ret = NULL;
+
+   if (!src || !(ret = ds_varray_new (src->elemsize)))
+      return NULL;
+
+   if (to > src->nitems)
+      to = src->nitems;
+
+   if (from >= to)
+      return ret;
+
+   if (!(ds_varray_reserve (ret, to - from))) {
+      ds_varray_del (ret);
+      return NULL;
+   }
+
+   memcpy (ret->data, ELEM (src, from), (to - from) * src->elemsize);
+   ret->nitems = to - from;
+
+   return ret;
+}
+
+size_t ds_varray_length (const ds_varray_t *va)
+{
+   return va ? va->nitems : 0;
+}
+
+size_t ds_varray_elemsize (const ds_varray_t *va)
+{
+   return va ? va->elemsize : 0;
+}
+
+void *ds_varray_get (const ds_varray_t *va, size_t i)
+{
+   if (!va || i >= va->nitems)
+      return NULL;
+
+   return ELEM (va, i);
+}
+
+void *ds_varray_data (const ds_varray_t *va)
+{
+   return va && va->nitems ? va->data : NULL;
+}
+
+void ds_varray_iterate (const ds_varray_t *va,
+                        void (*fptr) (void *, void *), void *param)
+{
+   if (!va || !fptr)
+      return;
+
+   for (size_t i=0; i<va->nitems; i++) {
+      fptr (ELEM (va, i), param);
+   }
+}
+
+// Sets the capacity, which must not be less than the number of elements
+static bool varray_resize (ds_varray_t *va, size_t capacity)
+{
+   if (capacity > SIZE_MAX / va->elemsize)
+      return false;
+
+   // A zero-sized realloc may free the buffer and return NULL
+   if (!capacity) {
+      free (va->data);
+      va->data = NULL;
+      va->capacity = 0;
+      return true;
+   }
+
+   unsigned char *tmp = realloc (va->data, capacity * va->elemsize);
+   if (!tmp)
+      return false;
+
+   va->data = tmp;
+   va->capacity = capacity;
+   return true;
+}
+
+// Makes room for one more element, at least doubling the capacity
+static bool varray_grow (ds_varray_t *va)
+{
+   if (va->nitems < va->capacity)
+      return true;
+
+   size_t capacity = va->capacity * 2;
+   if (capacity < MIN_CAPACITY)
+      capacity = MIN_CAPACITY;
+
+   return varray_resize (va, capacity);
+}
+
+size_t ds_varray_capacity (const ds_varray_t *va)
+{
+   return va ? va->capacity : 0;
+}
+
+bool ds_varray_reserve (ds_varray_t *va, size_t nelems)
+{
+   if (!va)
+      return false;
+
+   if (nelems <= va->capacity)
+      return true;
+
+   return varray_resize (va, nelems);
+}
+
+void ds_varray_shrink_to_fit (ds_varray_t *va)
+{
+   if (!va || va->capacity == va->nitems)
+      return;
+
+   varray_resize (va, va->nitems);
+}
+
+// Opens up index i and stores a copy of el, or zeros, there
+static void *varray_insert (ds_varray_t *va, size_t i, const void *el)
+{
+   void *ret = NULL;
+   void *copy = NULL;
+
+   // An element of the array itself would move while the array is grown
+   // and opened up, so it is copied first.
+   uintptr_t start = (uintptr_t)va->data,
+             end = start + va->capacity * va->elemsize;
+   if (el && (uintptr_t)el >= start && (uintptr_t)el < end) {
+      if (!(copy = malloc (va->elemsize)))
+         goto errorexit;
+      memcpy (copy, el, va->elemsize);
+      el = copy;
+   }
+
+   if (!(varray_grow (va)))
+      goto errorexit;
+
+   memmove (ELEM (va, i + 1), ELEM (va, i), (va->nitems - i) * va->elemsize);
+   va->nitems++;
+
+   if (el) {
+      memcpy (ELEM (va, i), el, va->elemsize);
+   } else {
+      memset (ELEM (va, i), 0, va->elemsize);
+   }
+
+   ret = ELEM (va, i);
+
+errorexit:
+
+   free (copy);
+
+   return ret;
+}
+
+void *ds_varray_ins_tail (ds_varray_t *va, const void *el)
+{
+   return va ? varray_insert (va, va->nitems, el) : NULL;
+}
+
+void *ds_varray_ins_head (ds_varray_t *va, const void *el)
+{
+   return va ? varray_insert (va, 0, el) : NULL;
+}
+
+bool ds_varray_rm (ds_varray_t *va, size_t index, void *dst)
+{
+   if (!va || index >= va->nitems)
+      return false;
+
+   if (dst)
+      memcpy (dst, ELEM (va, index), va->elemsize);
+
+   memmove (ELEM (va, index), ELEM (va, index + 1),
+            (va->nitems - index - 1) * va->elemsize);
+   va->nitems--;
+
+   return true;
+}
+
+bool ds_varray_rm_tail (ds_varray_t *va, void *dst)
+{
+   return va && va->nitems ? ds_varray_rm (va, va->nitems - 1, dst) : false;
+}
+
+bool ds_varray_rm_head (ds_varray_t *va, void *dst)
+{
+   return ds_varray_rm (va, 0, dst);
+}
+
+/* ******************************************************************
+ * Sorting and searching. Elements of any size are sorted with qsort(),
+ * which is given the buffer directly.
+ */
+
+void ds_varray_sort (ds_varray_t *va, ds_varray_cmpfn_t *cmp)
+{
+   if (!va || !cmp || va->nitems < 2)
+      return;
+
+   qsort (va->data, va->nitems, va->elemsize, cmp);
+}
+
+size_t ds_varray_lower_bound (const ds_varray_t *va, const void *key,
+                              ds_varray_cmpfn_t *cmp)
+{
+   if (!va || !cmp)
+      return 0;
+
+   size_t lo = 0, hi = va->nitems;
+
+   while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (cmp (ELEM (va, mid), key) < 0) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+
+   return lo;
+}
+
+void *ds_varray_bsearch (const ds_varray_t *va, const void *key,
+                         ds_varray_cmpfn_t *cmp)
+{
+   size_t i = ds_varray_lower_bound (va, key, cmp);
+
+   if (!va || !cmp || i >= va->nitems || cmp (ELEM (va, i), key) != 0)
+      return NULL;
+
+   return ELEM (va, i);
+}
@@ -0,0 +1,90 @@
+#ifndef H_DS_VARRAY
+#define H_DS_VARRAY
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* An array of values of a fixed size, given when the array is created.
+ * Unlike ds_array_t, which stores pointers, the elements are copied into
+ * a single contiguous buffer, so an array of small structures needs no
+ * allocation per element and can be scanned sequentially.
+ *
+ * Functions that return a pointer to an element return a pointer into
+ * the buffer. It is valid until the next call that inserts or removes
+ * elements, or that changes the capacity.
+ */
+
+typedef struct ds_varray_t ds_varray_t;
+
+// Compares two elements, given pointers to them (as for qsort()),
+// returning less than, equal to or greater than zero.
+typedef int (ds_varray_cmpfn_t) (const void *a, const void *b);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+   // Create a new array of elements of elemsize bytes each. Returns NULL
+   // on error, including when elemsize is zero.
+   ds_varray_t *ds_varray_new (size_t elemsize);
+   void ds_varray_del (ds_varray_t *va);
+
+   // Returns a new array with copies of the elements from index 'from'
+   // up to, but not including, index 'to'.
+   ds_varray_t *ds_varray_copy (const ds_varray_t *src, size_t from, size_t to);
+
+   size_t ds_varray_length (const ds_varray_t *va);
+   size_t ds_varray_elemsize (const ds_varray_t *va);
+
+   // Returns a pointer to element i, or NULL if there is no such element.
+   void *ds_varray_get (const ds_varray_t *va, size_t i);
+
+   // Returns a pointer to the first element, or NULL if the array is
+   // empty. The elements follow each other with no gaps, so the array
+   // can be used as a C array of ds_varray_length() elements.
+   void *ds_varray_data (const ds_varray_t *va);
+
+   void ds_varray_iterate (const ds_varray_t *va,
+                           void (*fptr) (void *, void *), void *param);
+
+   // Copies the element at el into the array at the tail or the head. If
+   // el is NULL the new element is filled with zeros. The el may point at
+   // an element of the array itself. Returns a pointer to the new
+   // element, or NULL on error.
+   void *ds_varray_ins_tail (ds_varray_t *va, const void *el);
+   void *ds_varray_ins_head (ds_varray_t *va, const void *el);
+
+   // Removes the element at the tail, at the head or at the index,
+   // first copying it to dst if dst is not NULL. Returns false if there
+   // is no such element.
+   bool ds_varray_rm_tail (ds_varray_t *va, void *dst);
+   bool ds_varray_rm_head (ds_varray_t *va, void *dst);
+   bool ds_varray_rm (ds_varray_t *va, size_t index, void *dst);
+
+   // The array grows geometrically, as ds_array_t does. The capacity is
+   // the number of elements the array holds before it has to grow
+   // again. ds_varray_reserve() grows the array to hold at least nelems
+   // elements in total and returns false on error.
+   // ds_varray_shrink_to_fit() releases the unused capacity.
+   size_t ds_varray_capacity (const ds_varray_t *va);
+   bool ds_varray_reserve (ds_varray_t *va, size_t nelems);
+   void ds_varray_shrink_to_fit (ds_varray_t *va);
+
+   // Sorts the elements in place.
+   void ds_varray_sort (ds_varray_t *va, ds_varray_cmpfn_t *cmp);
+
+   // In an array sorted by cmp, returns the index of the first element
+   // that is not less than the key (the length of the array if there is
+   // none), or a pointer to an element equal to the key (NULL if there
+   // is none). The cmp function is called with a pointer to an element
+   // and the key.
+   size_t ds_varray_lower_bound (const ds_varray_t *va, const void *key,
+                                 ds_varray_cmpfn_t *cmp);
+   void *ds_varray_bsearch (const ds_varray_t *va, const void *key,
+                            ds_varray_cmpfn_t *cmp);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
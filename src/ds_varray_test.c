@@ -0,0 +1,244 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ds_varray.h"
+
+#define NRECORDS     (10000)
+
+typedef struct record_t record_t;
+struct record_t {
+   uint32_t    id;
+   double      value;
+   char        name[12];
+};
+
+static record_t make_record (uint32_t id)
+{
+   record_t ret;
+
+   memset (&ret, 0, sizeof ret);
+   ret.id = id;
+   ret.value = id * 0.5;
+   snprintf (ret.name, sizeof ret.name, "r%u", (unsigned int)id);
+
+   return ret;
+}
+
+static bool check_record (const record_t *r, uint32_t id)
+{
+   record_t expected = make_record (id);
+
+   return r && memcmp (r, &expected, sizeof expected) == 0;
+}
+
+static int cmp_records (const void *a, const void *b)
+{
+   const record_t *ra = a, *rb = b;
+   return ra->id < rb->id ? -1 : ra->id > rb->id;
+}
+
+static void sum_ids (void *el, void *param)
+{
+   *(uint64_t *)param += ((record_t *)el)->id;
+}
+
+static bool record_test (void)
+{
+   bool error = true;
+   ds_varray_t *va = NULL;
+   ds_varray_t *copy = NULL;
+   record_t r;
+   uint64_t sum = 0;
+
+   if (!(va = ds_varray_new (sizeof (record_t))) || ds_varray_new (0)) {
+      fprintf (stderr, "Failed to create array\n");
+      goto errorexit;
+   }
+
+   // Odd ids at the tail and even ids at the head, so that the array
+   // holds NRECORDS-2, ..., 2, 0, 1, 3, ..., NRECORDS-1
+   for (uint32_t i=0; i<NRECORDS; i++) {
+      r = make_record (i);
+      if (!(i % 2 ? ds_varray_ins_tail (va, &r) : ds_varray_ins_head (va, &r))) {
+         fprintf (stderr, "Failed to insert record %u\n", (unsigned int)i);
+         goto errorexit;
+      }
+   }
+
+   const record_t *data = ds_varray_data (va);
+   for (size_t i=0; i<NRECORDS; i++) {
+      uint32_t id = (uint32_t)(i < NRECORDS / 2 ? NRECORDS - 2 - 2 * i
+                                                : 2 * (i - NRECORDS / 2) + 1);
+      if (!(check_record (ds_varray_get (va, i), id)) || !(check_record (&data[i], id))) {
+         fprintf (stderr, "Wrong record at %zu\n", i);
+         goto errorexit;
+      }
+   }
+
+   ds_varray_iterate (va, sum_ids, &sum);
+   if (ds_varray_length (va) != NRECORDS || ds_varray_get (va, NRECORDS)
+         || ds_varray_elemsize (va) != sizeof (record_t)
+         || sum != (uint64_t)NRECORDS * (NRECORDS - 1) / 2) {
+      fprintf (stderr, "Wrong length or contents\n");
+      goto errorexit;
+   }
+
+   ds_varray_sort (va, cmp_records);
+   for (uint32_t i=0; i<NRECORDS; i++) {
+      if (!(check_record (ds_varray_get (va, i), i))) {
+         fprintf (stderr, "Wrong record at %u after sorting\n", (unsigned int)i);
+         goto errorexit;
+      }
+   }
+
+   r = make_record (1234);
+   if (!(check_record (ds_varray_bsearch (va, &r, cmp_records), 1234))
+         || ds_varray_lower_bound (va, &r, cmp_records) != 1234) {
+      fprintf (stderr, "Failed to find a record\n");
+      goto errorexit;
+   }
+   r.id = NRECORDS + 1;
+   if (ds_varray_bsearch (va, &r, cmp_records)
+         || ds_varray_lower_bound (va, &r, cmp_records) != NRECORDS) {
+      fprintf (stderr, "Found a record that is not there\n");
+      goto errorexit;
+   }
+
+   // Removing from both ends and the middle
+   if (!(ds_varray_rm_head (va, &r)) || !(check_record (&r, 0))
+         || !(ds_varray_rm_tail (va, &r)) || !(check_record (&r, NRECORDS - 1))
+         || !(ds_varray_rm (va, 99, &r)) || !(check_record (&r, 100))
+         || !(ds_varray_rm (va, 0, NULL))
+         || ds_varray_rm (va, NRECORDS - 4, NULL)
+         || ds_varray_length (va) != NRECORDS - 4
+         || !(check_record (ds_varray_get (va, 98), 101))
+         || !(check_record (ds_varray_get (va, 0), 2))) {
+      fprintf (stderr, "Failed to remove records\n");
+      goto errorexit;
+   }
+
+   // Copies of a range
+   if (!(copy = ds_varray_copy (va, 10, 20)) || ds_varray_length (copy) != 10
+         || !(check_record (ds_varray_get (copy, 0), 12))
+         || !(check_record (ds_varray_get (copy, 9), 21))) {
+      fprintf (stderr, "Failed to copy records\n");
+      goto errorexit;
+   }
+   ds_varray_del (copy);
+   if (!(copy = ds_varray_copy (va, 20, 10)) || ds_varray_length (copy)
+         || ds_varray_data (copy)) {
+      fprintf (stderr, "Failed to copy an empty range\n");
+      goto errorexit;
+   }
+
+   // A NULL element is inserted as zeros
+   record_t *zero = ds_varray_ins_tail (copy, NULL);
+   if (!zero || zero->id || zero->value != 0.0 || zero->name[0]) {
+      fprintf (stderr, "Failed to insert an empty record\n");
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_varray_del (va);
+   ds_varray_del (copy);
+
+   return !error;
+}
+
+static bool capacity_test (void)
+{
+   bool error = true;
+   ds_varray_t *va = NULL;
+   size_t ngrown = 0, capacity = 0;
+
+   if (!(va = ds_varray_new (sizeof (double)))) {
+      fprintf (stderr, "Failed to create array\n");
+      goto errorexit;
+   }
+
+   for (size_t i=0; i<100000; i++) {
+      double d = (double)i;
+      if (!(ds_varray_ins_tail (va, &d)))
+         goto errorexit;
+      if (ds_varray_capacity (va) != capacity) {
+         capacity = ds_varray_capacity (va);
+         ngrown++;
+      }
+   }
+   if (ngrown > 20) {
+      fprintf (stderr, "Capacity changed %zu times\n", ngrown);
+      goto errorexit;
+   }
+
+   // Inserting elements of the full array into itself, at both ends
+   ds_varray_shrink_to_fit (va);
+   if (!(ds_varray_ins_tail (va, ds_varray_get (va, 0)))
+         || !(ds_varray_ins_head (va, ds_varray_get (va, 5)))
+         || !(ds_varray_ins_head (va, ds_varray_get (va, ds_varray_length (va) - 1)))
+         || *(double *)ds_varray_get (va, 0) != 0.0
+         || *(double *)ds_varray_get (va, 1) != 5.0
+         || *(double *)ds_varray_get (va, 2) != 0.0
+         || *(double *)ds_varray_get (va, 100002) != 0.0) {
+      fprintf (stderr, "Failed to insert elements of the array into itself\n");
+      goto errorexit;
+   }
+   ds_varray_rm_head (va, NULL);
+   ds_varray_rm_head (va, NULL);
+   ds_varray_rm_tail (va, NULL);
+
+   ds_varray_shrink_to_fit (va);
+   if (ds_varray_capacity (va) != 100000
+         || !(ds_varray_reserve (va, 200000)) || ds_varray_capacity (va) != 200000
+         || !(ds_varray_reserve (va, 10)) || ds_varray_capacity (va) != 200000
+         || *(double *)ds_varray_get (va, 99999) != 99999.0) {
+      fprintf (stderr, "Wrong capacity %zu\n", ds_varray_capacity (va));
+      goto errorexit;
+   }
+
+   while (ds_varray_rm_tail (va, NULL))
+      ;
+   ds_varray_shrink_to_fit (va);
+   if (ds_varray_length (va) || ds_varray_capacity (va) || ds_varray_data (va)
+         || ds_varray_rm_head (va, NULL) || !(ds_varray_ins_head (va, NULL))) {
+      fprintf (stderr, "Failed to empty the array\n");
+      goto errorexit;
+   }
+
+   error = false;
+
+errorexit:
+
+   ds_varray_del (va);
+
+   return !error;
+}
+
+int main (void)
+{
+   int ret = EXIT_FAILURE;
+
+   printf ("Testing value arrays, %s\n", ds_version);
+
+   if (!(record_test ())) {
+      fprintf (stderr, "Failed record test\n");
+      goto errorexit;
+   }
+
+   if (!(capacity_test ())) {
+      fprintf (stderr, "Failed capacity test\n");
+      goto errorexit;
+   }
+
+   ret = EXIT_SUCCESS;
+
+errorexit:
+
+   return ret;
+}